@@ -30,17 +30,110 @@ G_BEGIN_DECLS
 
 #include "atspi-accessible.h"
 
+typedef struct _AtspiCharacterExtentsCache AtspiCharacterExtentsCache;
+struct _AtspiCharacterExtentsCache
+{
+  guint layout_version;
+  gint start_offset;
+  GArray *extents;
+};
+
+typedef struct _AtspiTextMirror AtspiTextMirror;
+
+typedef struct _AtspiTableCache AtspiTableCache;
+
+typedef struct _AtspiHitIndex AtspiHitIndex;
+
+/*
+ * Caches that only some accessibles ever use: text, tables, hit testing,
+ * extents, relations and actions. They are allocated on first use, so
+ * that the other accessibles do not pay for them.
+ */
+typedef struct _AtspiAccessibleExtras AtspiAccessibleExtras;
+struct _AtspiAccessibleExtras
+{
+  guint text_version;
+  guint layout_version;
+  AtspiCharacterExtentsCache character_extents[ATSPI_COORD_TYPE_COUNT];
+  AtspiTextMirror *text_mirror;
+  AtspiTableCache *table_cache;
+  AtspiHitIndex *hit_index;
+  AtspiRect extents[ATSPI_COORD_TYPE_COUNT];
+  guint extents_valid;
+  guint extents_generation;
+  GArray *relations;
+  GPtrArray *actions;
+};
+
 struct _AtspiAccessiblePrivate
 {
   GHashTable *cache;
+  AtspiAccessibleExtras *extras;
+  gint64 states;
   guint cache_ref_count;
 };
 
+AtspiAccessibleExtras *
+_atspi_accessible_get_extras (AtspiAccessible *accessible);
+
 GHashTable *
 _atspi_accessible_ref_cache (AtspiAccessible *accessible);
 
 void
 _atspi_accessible_unref_cache (AtspiAccessible *accessible);
+
+void
+_atspi_accessible_invalidate_text_cache (AtspiAccessible *accessible);
+
+void
+_atspi_accessible_invalidate_text_layout (AtspiAccessible *accessible);
+
+void
+_atspi_text_mirror_free (AtspiTextMirror *mirror);
+
+void
+_atspi_table_cache_invalidate (AtspiAccessible *accessible,
+                               const gchar *event_type);
+
+void
+_atspi_table_cache_free (AtspiTableCache *cache);
+
+void
+_atspi_hit_index_invalidate (AtspiAccessible *source);
+
+void
+_atspi_hit_index_move (AtspiAccessible *source);
+
+void
+_atspi_hit_index_free (AtspiHitIndex *index);
+
+gboolean
+_atspi_accessible_cache_is_live (void);
+
+void
+_atspi_accessible_invalidate_relations (AtspiAccessible *accessible);
+
+GPtrArray *
+_atspi_accessible_ensure_children (AtspiAccessible *accessible);
+
+gboolean
+_atspi_accessible_has_state (AtspiAccessible *accessible, AtspiStateType state);
+
+void
+_atspi_accessible_set_states (AtspiAccessible *accessible, gint64 states);
+
+void
+_atspi_accessible_prefetch (AtspiAccessible *accessible,
+                            AtspiCache properties,
+                            gint n_ancestors);
+
+void
+_atspi_accessible_set_state (AtspiAccessible *accessible,
+                             AtspiStateType state,
+                             gboolean enabled);
+
+void
+_atspi_component_invalidate_extents (AtspiAccessible *accessible);
 G_END_DECLS
 
 #endif	/* _ATSPI_ACCESSIBLE_H_ */
@@ -118,8 +118,6 @@ atspi_accessible_init (AtspiAccessible *accessible)
 #endif
 
   accessible->priv = atspi_accessible_get_instance_private (accessible);
-
-  accessible->children = g_ptr_array_new_with_free_func (g_object_unref);
 }
 
 static void
@@ -138,7 +136,33 @@ atspi_accessible_dispose (GObject *object)
   e.detail2 = 0;
   _atspi_send_event (&e);
 
-  g_clear_object (&accessible->states);
+  /* The state set may outlive us if a client still holds it */
+  if (accessible->states)
+  {
+    accessible->states->accessible = NULL;
+    g_clear_object (&accessible->states);
+  }
+
+  if (accessible->priv->extras)
+  {
+    AtspiAccessibleExtras *extras = accessible->priv->extras;
+
+    /* The table cache holds references to captions and headers */
+    if (extras->table_cache)
+    {
+      _atspi_table_cache_free (extras->table_cache);
+      extras->table_cache = NULL;
+    }
+
+    if (extras->hit_index)
+    {
+      _atspi_hit_index_free (extras->hit_index);
+      extras->hit_index = NULL;
+    }
+  }
+  _atspi_hit_index_invalidate (accessible);
+
+  _atspi_accessible_invalidate_relations (accessible);
 
   parent = accessible->accessible_parent;
   if (parent)
@@ -182,6 +206,26 @@ atspi_accessible_finalize (GObject *object)
   if (accessible->priv->cache)
     g_hash_table_destroy (accessible->priv->cache);
 
+  if (accessible->priv->extras)
+  {
+    AtspiAccessibleExtras *extras = accessible->priv->extras;
+
+    /* Calls made after dispose may have filled the caches again */
+    _atspi_accessible_invalidate_text_cache (accessible);
+    _atspi_accessible_invalidate_relations (accessible);
+    if (extras->table_cache)
+      _atspi_table_cache_free (extras->table_cache);
+    if (extras->hit_index)
+      _atspi_hit_index_free (extras->hit_index);
+    if (extras->actions)
+      g_ptr_array_unref (extras->actions);
+    g_free (extras);
+  }
+
+  /* Events processed after dispose may have recreated the array */
+  if (accessible->children)
+    g_ptr_array_free (accessible->children, TRUE);
+
 #ifdef DEBUG_REF_COUNTS
   accessible_count--;
   g_hash_table_remove (_atspi_get_live_refs (), accessible);
@@ -354,8 +398,9 @@ atspi_accessible_get_child_at_index (AtspiAccessible *obj,
 
   if (_atspi_accessible_test_cache (obj, ATSPI_CACHE_CHILDREN))
   {
-    if (!obj->children)
-      return NULL;	/* assume disposed */
+    /* Childless objects never allocate an array */
+    if (!obj->children || child_index < 0 || child_index >= obj->children->len)
+      return NULL;
 
     child = g_ptr_array_index (obj->children, child_index);
     if (child)
@@ -371,9 +416,10 @@ atspi_accessible_get_child_at_index (AtspiAccessible *obj,
 
   if (_atspi_accessible_test_cache (obj, ATSPI_CACHE_CHILDREN))
   {
-      if (child_index >= obj->children->len)
-        g_ptr_array_set_size (obj->children, child_index + 1);
-    g_ptr_array_index (obj->children, child_index) = g_object_ref (child);
+    GPtrArray *children = _atspi_accessible_ensure_children (obj);
+    if (child_index >= children->len)
+      g_ptr_array_set_size (children, child_index + 1);
+    g_ptr_array_index (children, child_index) = g_object_ref (child);
   }
   return child;
 }
@@ -421,6 +467,153 @@ typedef struct
   GArray *targets;
 } Accessibility_Relation;
 
+/* Maps each target of a cached relation set to the GSList of accessibles
+ * whose cached relation sets point at it */
+static GHashTable *relation_sources;
+
+static guint relation_cache_hits;
+static guint relation_cache_misses;
+
+static void
+free_relation_cache (AtspiAccessible *accessible)
+{
+  GArray *relations = (accessible->priv->extras ?
+                        accessible->priv->extras->relations : NULL);
+  guint i;
+  gint j;
+
+  if (!relations)
+    return;
+
+  accessible->priv->extras->relations = NULL;
+  accessible->cached_properties &= ~ATSPI_CACHE_RELATIONS;
+  for (i = 0; i < relations->len; i++)
+  {
+    AtspiRelation *relation = g_array_index (relations, AtspiRelation *, i);
+    for (j = 0; j < relation->targets->len; j++)
+    {
+      AtspiAccessible *target = g_array_index (relation->targets,
+                                               AtspiAccessible *, j);
+      GSList *sources = g_hash_table_lookup (relation_sources, target);
+
+      sources = g_slist_remove (sources, accessible);
+      if (sources)
+        g_hash_table_insert (relation_sources, target, sources);
+      else
+        g_hash_table_remove (relation_sources, target);
+    }
+    g_object_unref (relation);
+  }
+  g_array_free (relations, TRUE);
+}
+
+static void
+add_relation_cache (AtspiAccessible *accessible, GArray *relations)
+{
+  AtspiAccessibleExtras *extras = _atspi_accessible_get_extras (accessible);
+  guint i;
+  gint j;
+
+  if (!relation_sources)
+    relation_sources = g_hash_table_new (g_direct_hash, g_direct_equal);
+
+  extras->relations = g_array_sized_new (TRUE, TRUE,
+                                         sizeof (AtspiRelation *),
+                                         relations->len);
+  for (i = 0; i < relations->len; i++)
+  {
+    AtspiRelation *relation = g_array_index (relations, AtspiRelation *, i);
+
+    g_object_ref (relation);
+    g_array_append_val (extras->relations, relation);
+    for (j = 0; j < relation->targets->len; j++)
+    {
+      AtspiAccessible *target = g_array_index (relation->targets,
+                                               AtspiAccessible *, j);
+      GSList *sources = g_hash_table_lookup (relation_sources, target);
+
+      if (!g_slist_find (sources, accessible))
+        g_hash_table_insert (relation_sources, target,
+                             g_slist_prepend (sources, accessible));
+    }
+  }
+  _atspi_accessible_add_cache (accessible, ATSPI_CACHE_RELATIONS);
+}
+
+static GArray *
+relation_set_from_reply (DBusMessage *reply)
+{
+  DBusMessageIter iter, iter_array;
+  GArray *ret = g_array_new (TRUE, TRUE, sizeof (AtspiRelation *));
+
+  dbus_message_iter_init (reply, &iter);
+  dbus_message_iter_recurse (&iter, &iter_array);
+  while (dbus_message_iter_get_arg_type (&iter_array) != DBUS_TYPE_INVALID)
+  {
+    AtspiRelation *relation;
+    relation = _atspi_relation_new_from_iter (&iter_array);
+    ret = g_array_append_val (ret, relation);
+    dbus_message_iter_next (&iter_array);
+  }
+  return ret;
+}
+
+static GArray *
+copy_relation_set (GArray *relations)
+{
+  GArray *ret = g_array_sized_new (TRUE, TRUE, sizeof (AtspiRelation *),
+                                   relations->len);
+  guint i;
+
+  for (i = 0; i < relations->len; i++)
+  {
+    AtspiRelation *relation = g_array_index (relations, AtspiRelation *, i);
+    g_object_ref (relation);
+    g_array_append_val (ret, relation);
+  }
+  return ret;
+}
+
+/*
+ * Drops the cached relation set of @accessible, along with those of the
+ * accessibles whose relations point at it, since a change to a target
+ * may mean that the relation now points elsewhere.
+ */
+void
+_atspi_accessible_invalidate_relations (AtspiAccessible *accessible)
+{
+  GSList *sources, *l;
+
+  free_relation_cache (accessible);
+
+  if (!relation_sources)
+    return;
+  sources = g_slist_copy (g_hash_table_lookup (relation_sources, accessible));
+  for (l = sources; l; l = l->next)
+    free_relation_cache (l->data);
+  g_slist_free (sources);
+}
+
+/**
+ * atspi_accessible_get_relation_cache_stats:
+ * @hits: (out) (optional): return location for the number of relation
+ *        sets returned from the cache, or %NULL.
+ * @misses: (out) (optional): return location for the number of relation
+ *          sets fetched from applications, or %NULL.
+ *
+ * Gets counters of the calls to #atspi_accessible_get_relation_set
+ * answered from the cache and of those that had to query the
+ * application, to check how effective the cache is for a given client.
+ **/
+void
+atspi_accessible_get_relation_cache_stats (guint *hits, guint *misses)
+{
+  if (hits)
+    *hits = relation_cache_hits;
+  if (misses)
+    *misses = relation_cache_misses;
+}
+
 /**
  * atspi_accessible_get_relation_set:
  * @obj: a pointer to the #AtspiAccessible object on which to operate.
@@ -435,27 +628,27 @@ GArray *
 atspi_accessible_get_relation_set (AtspiAccessible *obj, GError **error)
 {
   DBusMessage *reply;
-  DBusMessageIter iter, iter_array;
   GArray *ret;
 
   g_return_val_if_fail (obj != NULL, NULL);
 
+  if (obj->priv->extras && obj->priv->extras->relations &&
+      _atspi_accessible_test_cache (obj, ATSPI_CACHE_RELATIONS))
+  {
+    relation_cache_hits++;
+    return copy_relation_set (obj->priv->extras->relations);
+  }
+
+  free_relation_cache (obj);
+  relation_cache_misses++;
   reply = _atspi_dbus_call_partial (obj, atspi_interface_accessible, "GetRelationSet", error, "");
   if (!reply)
     return NULL;
   _ATSPI_DBUS_CHECK_SIG (reply, "a(ua(so))", error, NULL);
 
-  ret = g_array_new (TRUE, TRUE, sizeof (AtspiRelation *));
-  dbus_message_iter_init (reply, &iter);
-  dbus_message_iter_recurse (&iter, &iter_array);
-  while (dbus_message_iter_get_arg_type (&iter_array) != DBUS_TYPE_INVALID)
-  {
-    AtspiRelation *relation;
-    relation = _atspi_relation_new_from_iter (&iter_array);
-    ret = g_array_append_val (ret, relation);
-    dbus_message_iter_next (&iter_array);
-  }
+  ret = relation_set_from_reply (reply);
   dbus_message_unref (reply);
+  add_relation_cache (obj, ret);
   return ret;
 }
 
@@ -584,6 +777,11 @@ atspi_accessible_get_state_set (AtspiAccessible *obj)
     _atspi_accessible_add_cache (obj, ATSPI_CACHE_STATES);
   }
 
+  /* The state set object is only created once somebody asks for it; until
+   * then the states live in the private mask. */
+  if (!obj->states)
+    obj->states = _atspi_state_set_new_internal (obj, obj->priv->states);
+
   return g_object_ref (obj->states);
 }
 
@@ -596,6 +794,10 @@ atspi_accessible_get_state_set (AtspiAccessible *obj)
  * For typographic, textual, or textually-semantic attributes, see
  * atspi_text_get_attributes instead.
  *
+ * The returned table is shared with the cache, and its strings with the
+ * other cached attribute tables, so it must not be modified; release it
+ * with g_hash_table_unref().
+ *
  * Returns: (element-type gchar* gchar*) (transfer full): The name-value-pair
  * attributes assigned to this object.
  */
@@ -617,7 +819,9 @@ atspi_accessible_get_attributes (AtspiAccessible *obj, GError **error)
   {
     message = _atspi_dbus_call_partial (obj, atspi_interface_accessible,
                                         "GetAttributes", error, "");
-    obj->attributes = _atspi_dbus_return_hash_from_message (message);
+    if (obj->attributes)
+      g_hash_table_unref (obj->attributes);
+    obj->attributes = _atspi_dbus_return_pooled_hash_from_message (message);
     _atspi_accessible_add_cache (obj, ATSPI_CACHE_ATTRIBUTES);
   }
 
@@ -733,6 +937,9 @@ atspi_accessible_get_toolkit_name (AtspiAccessible *obj, GError **error)
   if (!obj->parent.app)
     return NULL;
 
+  if (!obj->parent.app->toolkit_name &&
+      !_atspi_application_wait_for_properties (obj->parent.app, error))
+    return NULL;
   if (!obj->parent.app->toolkit_name)
     _atspi_dbus_get_property (obj, atspi_interface_application, "ToolkitName",
                               error, "s", &obj->parent.app->toolkit_name);
@@ -757,6 +964,9 @@ atspi_accessible_get_toolkit_version (AtspiAccessible *obj, GError **error)
   if (!obj->parent.app)
     return NULL;
 
+  if (!obj->parent.app->toolkit_version &&
+      !_atspi_application_wait_for_properties (obj->parent.app, error))
+    return NULL;
   if (!obj->parent.app->toolkit_version)
     _atspi_dbus_get_property (obj, atspi_interface_application, "Version",
                               error, "s", &obj->parent.app->toolkit_version);
@@ -782,6 +992,9 @@ atspi_accessible_get_atspi_version (AtspiAccessible *obj, GError **error)
   if (!obj->parent.app)
     return NULL;
 
+  if (!obj->parent.app->atspi_version &&
+      !_atspi_application_wait_for_properties (obj->parent.app, error))
+    return NULL;
   if (!obj->parent.app->atspi_version)
     _atspi_dbus_get_property (obj, atspi_interface_application, "AtspiVersion",
                               error, "s", &obj->parent.app->atspi_version);
@@ -806,8 +1019,18 @@ atspi_accessible_get_id (AtspiAccessible *obj, GError **error)
 
   g_return_val_if_fail (obj != NULL, -1);
 
+  if (obj->parent.app)
+  {
+    if (!_atspi_application_wait_for_properties (obj->parent.app, error))
+      return -1;
+    if (obj->parent.app->id > 0)
+      return obj->parent.app->id;
+  }
+
   if (!_atspi_dbus_get_property (obj, atspi_interface_application, "Id", error, "i", &ret))
       return -1;
+  if (obj->parent.app && ret > 0)
+    obj->parent.app->id = ret;
   return ret;
 }
 
@@ -1597,6 +1820,59 @@ _atspi_accessible_new (AtspiApplication *app, const gchar *path)
   return accessible;
 }
 
+/*
+ * Most accessibles are leaves, so the children array is only allocated
+ * once something is actually stored in it. A NULL array means no cached
+ * children.
+ */
+GPtrArray *
+_atspi_accessible_ensure_children (AtspiAccessible *accessible)
+{
+  if (!accessible->children)
+    accessible->children = g_ptr_array_new_with_free_func (g_object_unref);
+  return accessible->children;
+}
+
+/*
+ * States are held as a bit mask in the private data; the #AtspiStateSet
+ * returned by atspi_accessible_get_state_set() is created on demand and,
+ * once it exists, is the authoritative copy since clients may modify it.
+ */
+gboolean
+_atspi_accessible_has_state (AtspiAccessible *accessible, AtspiStateType state)
+{
+  if (accessible->states)
+    return atspi_state_set_contains (accessible->states, state);
+  return (accessible->priv->states & ((gint64)1 << state)) != 0;
+}
+
+void
+_atspi_accessible_set_states (AtspiAccessible *accessible, gint64 states)
+{
+  accessible->priv->states = states;
+  if (accessible->states)
+    accessible->states->states = states;
+}
+
+void
+_atspi_accessible_set_state (AtspiAccessible *accessible,
+                             AtspiStateType state,
+                             gboolean enabled)
+{
+  gint64 states;
+
+  if (!(accessible->cached_properties & ATSPI_CACHE_STATES))
+    return;
+
+  states = (accessible->states ? accessible->states->states
+                               : accessible->priv->states);
+  if (enabled)
+    states |= ((gint64)1 << state);
+  else
+    states &= ~((gint64)1 << state);
+  _atspi_accessible_set_states (accessible, states);
+}
+
 /**
  * atspi_accessible_set_cache_mask:
  * @accessible: The #AtspiAccessible to operate on.  Must be the desktop or
@@ -1610,6 +1886,15 @@ _atspi_accessible_new (AtspiApplication *app, const gchar *path)
  * be cached.
  * This function is intended to work around bugs in toolkits where the proper
  * events are not raised / to aid in testing for such bugs.
+ * Component extents are only cached when #ATSPI_CACHE_EXTENTS is set
+ * explicitly, since many toolkits do not raise bounds-changed for every
+ * object that moves, for instance when scrolling. Likewise, relation sets
+ * are only cached when #ATSPI_CACHE_RELATIONS is set, since toolkits do
+ * not notify relation changes; the cached sets are then only dropped on
+ * structural and property changes. Action tables are only cached when
+ * #ATSPI_CACHE_ACTIONS is set, for the same reason: they are dropped on
+ * property changes and on the states that usually change the actions,
+ * but a toolkit may change them without notice.
  **/
 void
 atspi_accessible_set_cache_mask (AtspiAccessible *accessible, AtspiCache mask)
@@ -1636,6 +1921,7 @@ atspi_accessible_clear_cache (AtspiAccessible *obj)
   if (obj)
   {
     obj->cached_properties = ATSPI_CACHE_NONE;
+    _atspi_accessible_invalidate_text_cache (obj);
     if (obj->children)
       for (i = 0; i < obj->children->len; i++)
         atspi_accessible_clear_cache (g_ptr_array_index (obj->children, i));
@@ -1720,11 +2006,21 @@ _atspi_accessible_test_cache (AtspiAccessible *accessible, AtspiCache flag)
 {
   AtspiCache mask = _atspi_accessible_get_cache_mask (accessible);
   AtspiCache result = accessible->cached_properties & mask & flag;
-  if (accessible->states && atspi_state_set_contains (accessible->states, ATSPI_STATE_TRANSIENT))
+  if (_atspi_accessible_has_state (accessible, ATSPI_STATE_TRANSIENT))
     return FALSE;
-  return (result != 0 && (atspi_main_loop || enable_caching ||
-                          flag == ATSPI_CACHE_INTERFACES) &&
-          !atspi_no_cache);
+  return (result != 0 &&
+          (_atspi_accessible_cache_is_live () ||
+           (flag == ATSPI_CACHE_INTERFACES && !atspi_no_cache)));
+}
+
+/*
+ * Whether events are being processed, so that cached values are kept
+ * up to date.
+ */
+gboolean
+_atspi_accessible_cache_is_live (void)
+{
+  return ((atspi_main_loop || enable_caching) && !atspi_no_cache);
 }
 
 void
@@ -1789,6 +2085,14 @@ _atspi_accessible_ref_cache (AtspiAccessible *accessible)
   return priv->cache;
 }
 
+AtspiAccessibleExtras *
+_atspi_accessible_get_extras (AtspiAccessible *accessible)
+{
+  if (!accessible->priv->extras)
+    accessible->priv->extras = g_new0 (AtspiAccessibleExtras, 1);
+  return accessible->priv->extras;
+}
+
 void
 _atspi_accessible_unref_cache (AtspiAccessible *accessible)
 {
@@ -1801,3 +2105,273 @@ _atspi_accessible_unref_cache (AtspiAccessible *accessible)
       priv->cache = NULL;
   }
 }
+
+/*
+ * Called when the characters of @accessible may have moved, for instance
+ * when it is scrolled. Bumping the layout version makes character extents
+ * fetched against the previous version stale; the contents are kept.
+ */
+void
+_atspi_accessible_invalidate_text_layout (AtspiAccessible *accessible)
+{
+  AtspiAccessibleExtras *extras = accessible->priv->extras;
+  gint i;
+
+  /* Nothing was cached, nor is being fetched: fetches allocate the
+   * extras before reading the layout version */
+  if (!extras)
+    return;
+
+  extras->layout_version++;
+  for (i = 0; i < ATSPI_COORD_TYPE_COUNT; i++)
+  {
+    if (extras->character_extents[i].extents)
+    {
+      g_array_free (extras->character_extents[i].extents, TRUE);
+      extras->character_extents[i].extents = NULL;
+    }
+  }
+}
+
+/*
+ * Drops everything cached about the text of @accessible. A change to the
+ * contents also moves the characters, so the layout goes too.
+ */
+void
+_atspi_accessible_invalidate_text_cache (AtspiAccessible *accessible)
+{
+  AtspiAccessibleExtras *extras = accessible->priv->extras;
+
+  if (!extras)
+    return;
+
+  extras->text_version++;
+  _atspi_accessible_invalidate_text_layout (accessible);
+
+  if (extras->text_mirror)
+  {
+    _atspi_text_mirror_free (extras->text_mirror);
+    extras->text_mirror = NULL;
+  }
+}
+
+/* Properties that _atspi_accessible_prefetch knows how to fetch */
+#define PREFETCH_PROPERTIES (ATSPI_CACHE_PARENT | ATSPI_CACHE_NAME | \
+                             ATSPI_CACHE_DESCRIPTION | ATSPI_CACHE_STATES | \
+                             ATSPI_CACHE_ROLE | ATSPI_CACHE_RELATIONS)
+
+static AtspiCache
+prefetch_wanted (AtspiAccessible *accessible, AtspiCache properties)
+{
+  AtspiCache mask = _atspi_accessible_get_cache_mask (accessible);
+  AtspiCache wanted;
+
+  if (_atspi_accessible_has_state (accessible, ATSPI_STATE_TRANSIENT))
+    return ATSPI_CACHE_NONE;
+
+  wanted = properties & mask & ~accessible->cached_properties;
+  if ((properties & ATSPI_CACHE_RELATIONS) &&
+      !(accessible->priv->extras && accessible->priv->extras->relations))
+    wanted |= ATSPI_CACHE_RELATIONS & mask;
+  return wanted;
+}
+
+static DBusMessage *
+new_prefetch_call (AtspiAccessible *accessible, AtspiCache property)
+{
+  switch (property)
+  {
+  case ATSPI_CACHE_PARENT:
+    return _atspi_dbus_new_get_property (accessible, atspi_interface_accessible,
+                                         str_parent);
+  case ATSPI_CACHE_NAME:
+    return _atspi_dbus_new_get_property (accessible, atspi_interface_accessible,
+                                         "Name");
+  case ATSPI_CACHE_DESCRIPTION:
+    return _atspi_dbus_new_get_property (accessible, atspi_interface_accessible,
+                                         "Description");
+  case ATSPI_CACHE_STATES:
+    return _atspi_dbus_new_method_call (accessible, atspi_interface_accessible,
+                                        "GetState", "");
+  case ATSPI_CACHE_ROLE:
+    return _atspi_dbus_new_method_call (accessible, atspi_interface_accessible,
+                                        "GetRole", "");
+  case ATSPI_CACHE_RELATIONS:
+    return _atspi_dbus_new_method_call (accessible, atspi_interface_accessible,
+                                        "GetRelationSet", "");
+  default:
+    return NULL;
+  }
+}
+
+static void
+apply_prefetch_reply (AtspiAccessible *accessible,
+                      AtspiCache property,
+                      DBusMessage *reply)
+{
+  const char *signature = dbus_message_get_signature (reply);
+  DBusMessageIter iter, iter_variant;
+  const char *str;
+  dbus_uint32_t role;
+  GArray *relations;
+  guint i;
+
+  dbus_message_iter_init (reply, &iter);
+  switch (property)
+  {
+  case ATSPI_CACHE_PARENT:
+    if (strcmp (signature, "v") != 0)
+      return;
+    dbus_message_iter_recurse (&iter, &iter_variant);
+    if (accessible->accessible_parent)
+      g_object_unref (accessible->accessible_parent);
+    accessible->accessible_parent = _atspi_dbus_return_accessible_from_iter (&iter_variant);
+    break;
+  case ATSPI_CACHE_NAME:
+  case ATSPI_CACHE_DESCRIPTION:
+    if (strcmp (signature, "v") != 0)
+      return;
+    dbus_message_iter_recurse (&iter, &iter_variant);
+    if (dbus_message_iter_get_arg_type (&iter_variant) != DBUS_TYPE_STRING)
+      return;
+    dbus_message_iter_get_basic (&iter_variant, &str);
+    if (property == ATSPI_CACHE_NAME)
+    {
+      g_free (accessible->name);
+      accessible->name = g_strdup (str);
+    }
+    else
+    {
+      g_free (accessible->description);
+      accessible->description = g_strdup (str);
+    }
+    break;
+  case ATSPI_CACHE_STATES:
+    if (strcmp (signature, "au") != 0)
+      return;
+    _atspi_dbus_set_state (accessible, &iter);
+    break;
+  case ATSPI_CACHE_ROLE:
+    if (strcmp (signature, "u") != 0)
+      return;
+    dbus_message_iter_get_basic (&iter, &role);
+    accessible->role = role;
+    break;
+  case ATSPI_CACHE_RELATIONS:
+    if (strcmp (signature, "a(ua(so))") != 0)
+      return;
+    free_relation_cache (accessible);
+    relations = relation_set_from_reply (reply);
+    add_relation_cache (accessible, relations);
+    for (i = 0; i < relations->len; i++)
+      g_object_unref (g_array_index (relations, AtspiRelation *, i));
+    g_array_free (relations, TRUE);
+    break;
+  default:
+    return;
+  }
+  _atspi_accessible_add_cache (accessible, property);
+}
+
+/*
+ * Fetches those of @properties that are not cached yet for @accessible
+ * and for up to @n_ancestors of its ancestors, pipelining the calls so
+ * that each batch costs about one round trip. The walk follows cached
+ * parents; where a parent is not known, it is fetched along with the
+ * batch and the walk resumes from it with the next one. The walk stops
+ * at the application, since the desktop lives in another process.
+ */
+void
+_atspi_accessible_prefetch (AtspiAccessible *accessible,
+                            AtspiCache properties,
+                            gint n_ancestors)
+{
+  AtspiApplication *app;
+  AtspiAccessible *held = NULL;
+  GPtrArray *targets, *messages;
+  GArray *flags;
+
+  if (!accessible || !accessible->parent.app ||
+      !_atspi_accessible_cache_is_live ())
+    return;
+
+  app = accessible->parent.app;
+  properties &= PREFETCH_PROPERTIES;
+  targets = g_ptr_array_new_with_free_func (g_object_unref);
+  messages = g_ptr_array_new ();
+  flags = g_array_new (FALSE, FALSE, sizeof (AtspiCache));
+
+  while (accessible)
+  {
+    AtspiAccessible *resume = NULL;
+    DBusMessage **replies;
+    guint i;
+
+    for (;;)
+    {
+      AtspiCache wanted, flag;
+
+      wanted = prefetch_wanted (accessible, (n_ancestors > 0 ?
+                                             properties | ATSPI_CACHE_PARENT :
+                                             properties));
+      for (flag = 1; flag <= ATSPI_CACHE_RELATIONS; flag <<= 1)
+      {
+        if (!(wanted & flag))
+          continue;
+        g_ptr_array_add (targets, g_object_ref (accessible));
+        g_ptr_array_add (messages, new_prefetch_call (accessible, flag));
+        g_array_append_val (flags, flag);
+      }
+
+      if (n_ancestors-- <= 0)
+        break;
+      if (wanted & ATSPI_CACHE_PARENT)
+      {
+        resume = g_object_ref (accessible);
+        break;
+      }
+      accessible = accessible->accessible_parent;
+      if (!accessible || accessible->parent.app != app)
+        break;
+    }
+
+    if (messages->len > 0)
+    {
+      replies = g_new0 (DBusMessage *, messages->len);
+      _atspi_dbus_send_batch (app, (DBusMessage **) messages->pdata, replies,
+                              messages->len, NULL);
+      for (i = 0; i < messages->len; i++)
+      {
+        if (!replies[i])
+          continue;
+        apply_prefetch_reply (g_ptr_array_index (targets, i),
+                              g_array_index (flags, AtspiCache, i),
+                              replies[i]);
+        dbus_message_unref (replies[i]);
+      }
+      g_free (replies);
+      g_ptr_array_set_size (targets, 0);
+      g_ptr_array_set_size (messages, 0);
+      g_array_set_size (flags, 0);
+    }
+
+    accessible = NULL;
+    if (resume)
+    {
+      if (_atspi_accessible_test_cache (resume, ATSPI_CACHE_PARENT) &&
+          resume->accessible_parent &&
+          resume->accessible_parent->parent.app == app)
+        accessible = resume->accessible_parent;
+      /* Keeps the next accessible alive through the next batch */
+      if (held)
+        g_object_unref (held);
+      held = resume;
+    }
+  }
+
+  if (held)
+    g_object_unref (held);
+  g_ptr_array_free (targets, TRUE);
+  g_ptr_array_free (messages, TRUE);
+  g_array_free (flags, TRUE);
+}
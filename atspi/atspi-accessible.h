@@ -49,11 +49,14 @@ struct _AtspiAccessible
 {
   AtspiObject parent;
   AtspiAccessible *accessible_parent;
+  /* NULL until children are added to the cache */
   GPtrArray *children;
   AtspiRole role;
   gint interfaces;
   char *name;
   char *description;
+  /* NULL until atspi_accessible_get_state_set() is first called; use that
+   * rather than reading the field */
   AtspiStateSet *states;
   GHashTable *attributes;
   guint cached_properties;
@@ -85,6 +88,8 @@ gint atspi_accessible_get_index_in_parent (AtspiAccessible *obj, GError **error)
 
 GArray * atspi_accessible_get_relation_set (AtspiAccessible *obj, GError **error);
 
+void atspi_accessible_get_relation_cache_stats (guint *hits, guint *misses);
+
 AtspiRole atspi_accessible_get_role (AtspiAccessible *obj, GError **error);
 
 gchar * atspi_accessible_get_role_name (AtspiAccessible *obj, GError **error);
@@ -22,6 +22,243 @@
  */
 
 #include "atspi-private.h"
+#include "atspi-accessible-private.h"
+
+/**
+ * atspi_action_info_copy:
+ * @src: an #AtspiActionInfo
+ *
+ * Copies an #AtspiActionInfo, with all of its strings.
+ *
+ * Returns: (transfer full): a newly allocated copy of @src, to be freed
+ *          with atspi_action_info_free().
+ **/
+AtspiActionInfo *
+atspi_action_info_copy (AtspiActionInfo *src)
+{
+  AtspiActionInfo *dst = g_new (AtspiActionInfo, 1);
+
+  dst->name = g_strdup (src->name);
+  dst->localized_name = g_strdup (src->localized_name);
+  dst->description = g_strdup (src->description);
+  dst->key_binding = g_strdup (src->key_binding);
+  return dst;
+}
+
+/**
+ * atspi_action_info_free:
+ * @info: (nullable): an #AtspiActionInfo
+ *
+ * Frees an #AtspiActionInfo and its strings.
+ **/
+void
+atspi_action_info_free (AtspiActionInfo *info)
+{
+  if (!info)
+    return;
+
+  g_free (info->name);
+  g_free (info->localized_name);
+  g_free (info->description);
+  g_free (info->key_binding);
+  g_free (info);
+}
+
+G_DEFINE_BOXED_TYPE (AtspiActionInfo, atspi_action_info,
+                     atspi_action_info_copy, atspi_action_info_free)
+
+/* Returns the cached action @i of @obj, or NULL if not cached */
+static AtspiActionInfo *
+get_cached_action (AtspiAction *obj, gint i)
+{
+  AtspiAccessible *accessible = ATSPI_ACCESSIBLE (obj);
+  GPtrArray *actions = (accessible->priv->extras ?
+                        accessible->priv->extras->actions : NULL);
+
+  if (!actions || !_atspi_accessible_test_cache (accessible, ATSPI_CACHE_ACTIONS) ||
+      i < 0 || i >= actions->len)
+    return NULL;
+  return g_ptr_array_index (actions, i);
+}
+
+static gchar *
+dup_string_reply (DBusMessage *reply)
+{
+  const char *str;
+
+  if (reply && dbus_message_get_args (reply, NULL, DBUS_TYPE_STRING, &str,
+                                      DBUS_TYPE_INVALID))
+    return g_strdup (str);
+  return g_strdup ("");
+}
+
+/*
+ * Fetches the whole action table of @obj: GetActions returns the
+ * localized name, description and key binding of every action, and the
+ * non-localized names follow in one pipelined batch. Applications that
+ * do not implement GetActions get one batch of the per-index calls.
+ */
+static GPtrArray *
+fetch_actions (AtspiAction *obj, GError **error)
+{
+  static const char *fallback_methods[] = { "GetLocalizedName", "GetDescription",
+                                            "GetKeyBinding" };
+  AtspiAccessible *accessible = ATSPI_ACCESSIBLE (obj);
+  GPtrArray *actions;
+  DBusMessage *reply, **messages, **replies;
+  DBusMessageIter iter, iter_array, iter_struct;
+  gboolean have_actions;
+  gint n_actions = 0, n_per_action, i, j;
+  GError *local_error = NULL;
+  gchar *error_name;
+
+  reply = _atspi_dbus_call_partial_with_error_name (obj, atspi_interface_action,
+                                                    "GetActions", &error_name,
+                                                    &local_error, "");
+  have_actions = (reply != NULL);
+  if (reply)
+  {
+    _ATSPI_DBUS_CHECK_SIG (reply, "a(sss)", error, NULL);
+  }
+  else
+  {
+    /* Only a missing GetActions is worth falling back from; any other
+     * error would hit the per-index calls too */
+    if (g_strcmp0 (error_name, DBUS_ERROR_UNKNOWN_METHOD) != 0)
+    {
+      if (local_error)
+        g_propagate_error (error, local_error);
+      g_free (error_name);
+      return NULL;
+    }
+    g_clear_error (&local_error);
+    g_free (error_name);
+    n_actions = atspi_action_get_n_actions (obj, error);
+    if (n_actions < 0)
+      return NULL;
+  }
+
+  actions = g_ptr_array_new_with_free_func ((GDestroyNotify) atspi_action_info_free);
+  if (have_actions)
+  {
+    dbus_message_iter_init (reply, &iter);
+    dbus_message_iter_recurse (&iter, &iter_array);
+    while (dbus_message_iter_get_arg_type (&iter_array) != DBUS_TYPE_INVALID)
+    {
+      AtspiActionInfo *info = g_new0 (AtspiActionInfo, 1);
+      const char *str;
+
+      dbus_message_iter_recurse (&iter_array, &iter_struct);
+      dbus_message_iter_get_basic (&iter_struct, &str);
+      info->localized_name = g_strdup (str);
+      dbus_message_iter_next (&iter_struct);
+      dbus_message_iter_get_basic (&iter_struct, &str);
+      info->description = g_strdup (str);
+      dbus_message_iter_next (&iter_struct);
+      dbus_message_iter_get_basic (&iter_struct, &str);
+      info->key_binding = g_strdup (str);
+      g_ptr_array_add (actions, info);
+      dbus_message_iter_next (&iter_array);
+    }
+    dbus_message_unref (reply);
+    n_actions = actions->len;
+  }
+  else
+  {
+    for (i = 0; i < n_actions; i++)
+      g_ptr_array_add (actions, g_new0 (AtspiActionInfo, 1));
+  }
+
+  n_per_action = (have_actions ? 1 : 4);
+  messages = g_new0 (DBusMessage *, n_actions * n_per_action + 1);
+  replies = g_new0 (DBusMessage *, n_actions * n_per_action + 1);
+  for (i = 0; i < n_actions; i++)
+  {
+    dbus_int32_t d_i = i;
+
+    messages[i * n_per_action] = _atspi_dbus_new_method_call (obj, atspi_interface_action,
+                                                              "GetName", "i", d_i);
+    for (j = 1; j < n_per_action; j++)
+      messages[i * n_per_action + j] = _atspi_dbus_new_method_call (obj, atspi_interface_action,
+                                                                    fallback_methods[j - 1],
+                                                                    "i", d_i);
+  }
+  if (n_actions > 0)
+    _atspi_dbus_send_batch (accessible->parent.app, messages, replies,
+                            n_actions * n_per_action, NULL);
+
+  for (i = 0; i < n_actions; i++)
+  {
+    AtspiActionInfo *info = g_ptr_array_index (actions, i);
+    DBusMessage **r = replies + i * n_per_action;
+
+    info->name = dup_string_reply (r[0]);
+    if (!have_actions)
+    {
+      info->localized_name = dup_string_reply (r[1]);
+      info->description = dup_string_reply (r[2]);
+      info->key_binding = dup_string_reply (r[3]);
+    }
+    for (j = 0; j < n_per_action; j++)
+      if (r[j])
+        dbus_message_unref (r[j]);
+  }
+
+  g_free (messages);
+  g_free (replies);
+  return actions;
+}
+
+/**
+ * atspi_action_get_actions:
+ * @obj: a pointer to the #AtspiAction to query.
+ *
+ * Gets the names, localized names, descriptions and key bindings of all
+ * the actions invocable on an #AtspiAction implementor at once. This
+ * costs two round trips, whatever the number of actions, instead of
+ * one per action and property. If #ATSPI_CACHE_ACTIONS is in the cache
+ * mask of the application, the result is also cached on the accessible
+ * until a property or relevant state of it changes, and the other
+ * #AtspiAction getters answer from that cache too.
+ *
+ * Returns: (element-type AtspiActionInfo) (transfer full): a
+ *          #GPtrArray of #AtspiActionInfo, in action index order, or
+ *          %NULL on exception.
+ **/
+GPtrArray *
+atspi_action_get_actions (AtspiAction *obj, GError **error)
+{
+  AtspiAccessible *accessible;
+  GPtrArray *actions, *ret;
+  guint i;
+
+  g_return_val_if_fail (obj != NULL, NULL);
+
+  accessible = ATSPI_ACCESSIBLE (obj);
+  if (!(_atspi_accessible_get_cache_mask (accessible) & ATSPI_CACHE_ACTIONS))
+    return fetch_actions (obj, error);
+
+  actions = (accessible->priv->extras ? accessible->priv->extras->actions : NULL);
+  if (!actions || !_atspi_accessible_test_cache (accessible, ATSPI_CACHE_ACTIONS))
+  {
+    AtspiAccessibleExtras *extras;
+
+    actions = fetch_actions (obj, error);
+    if (!actions)
+      return NULL;
+    extras = _atspi_accessible_get_extras (accessible);
+    if (extras->actions)
+      g_ptr_array_unref (extras->actions);
+    extras->actions = actions;
+    _atspi_accessible_add_cache (accessible, ATSPI_CACHE_ACTIONS);
+  }
+
+  ret = g_ptr_array_new_full (actions->len,
+                              (GDestroyNotify) atspi_action_info_free);
+  for (i = 0; i < actions->len; i++)
+    g_ptr_array_add (ret, atspi_action_info_copy (g_ptr_array_index (actions, i)));
+  return ret;
+}
 
 /**
  * atspi_action_get_n_actions:
@@ -35,9 +272,15 @@ gint
 atspi_action_get_n_actions (AtspiAction *obj, GError **error)
 {
   dbus_int32_t retval = 0;
+  AtspiAccessible *accessible;
 
   g_return_val_if_fail (obj != NULL, -1);
 
+  accessible = ATSPI_ACCESSIBLE (obj);
+  if (accessible->priv->extras && accessible->priv->extras->actions &&
+      _atspi_accessible_test_cache (accessible, ATSPI_CACHE_ACTIONS))
+    return accessible->priv->extras->actions->len;
+
   _atspi_dbus_get_property (obj, atspi_interface_action, "NActions", error, "i", &retval);
 
   return retval;
@@ -76,9 +319,14 @@ atspi_action_get_action_description (AtspiAction *obj, int i, GError **error)
 {
   dbus_int32_t d_i = i;
   char *retval = NULL;
+  AtspiActionInfo *info;
 
   g_return_val_if_fail (obj != NULL, NULL);
 
+  info = get_cached_action (obj, i);
+  if (info)
+    return g_strdup (info->description);
+
   _atspi_dbus_call (obj, atspi_interface_action, "GetDescription", error, "i=>s", d_i, &retval);
 
   return retval;
@@ -119,9 +367,14 @@ atspi_action_get_key_binding (AtspiAction *obj, gint i, GError **error)
 {
   dbus_int32_t d_i = i;
   char *retval = NULL;
+  AtspiActionInfo *info;
 
   g_return_val_if_fail (obj != NULL, NULL);
 
+  info = get_cached_action (obj, i);
+  if (info)
+    return g_strdup (info->key_binding);
+
   _atspi_dbus_call (obj, atspi_interface_action, "GetKeyBinding", error, "i=>s", d_i, &retval);
 
   return retval;
@@ -160,9 +413,14 @@ atspi_action_get_action_name (AtspiAction *obj, gint i, GError **error)
 {
   dbus_int32_t d_i = i;
   char *retval = NULL;
+  AtspiActionInfo *info;
 
   g_return_val_if_fail (obj != NULL, NULL);
 
+  info = get_cached_action (obj, i);
+  if (info)
+    return g_strdup (info->name);
+
   _atspi_dbus_call (obj, atspi_interface_action, "GetName", error, "i=>s", d_i, &retval);
 
   return retval;
@@ -183,9 +441,14 @@ atspi_action_get_localized_name (AtspiAction *obj, gint i, GError **error)
 {
   dbus_int32_t d_i = i;
   char *retval = NULL;
+  AtspiActionInfo *info;
 
   g_return_val_if_fail (obj != NULL, NULL);
 
+  info = get_cached_action (obj, i);
+  if (info)
+    return g_strdup (info->localized_name);
+
   _atspi_dbus_call (obj, atspi_interface_action, "GetLocalizedName", error,
                     "i=>s", d_i, &retval);
 
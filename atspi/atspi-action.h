@@ -33,6 +33,28 @@
 
 G_BEGIN_DECLS
 
+typedef struct _AtspiActionInfo AtspiActionInfo;
+struct _AtspiActionInfo
+{
+  gchar *name;
+  gchar *localized_name;
+  gchar *description;
+  gchar *key_binding;
+};
+
+/**
+ * ATSPI_TYPE_ACTION_INFO:
+ * 
+ * The #GType for a boxed type holding an #AtspiActionInfo.
+ */
+#define	ATSPI_TYPE_ACTION_INFO (atspi_action_info_get_type ())
+
+GType atspi_action_info_get_type ();
+
+AtspiActionInfo *atspi_action_info_copy (AtspiActionInfo *src);
+
+void atspi_action_info_free (AtspiActionInfo *info);
+
 #define ATSPI_TYPE_ACTION                    (atspi_action_get_type ())
 #define ATSPI_IS_ACTION(obj)                 G_TYPE_CHECK_INSTANCE_TYPE ((obj), ATSPI_TYPE_ACTION)
 #define ATSPI_ACTION(obj)                    G_TYPE_CHECK_INSTANCE_CAST ((obj), ATSPI_TYPE_ACTION, AtspiAction)
@@ -56,6 +78,8 @@ gchar * atspi_action_get_key_binding (AtspiAction *obj, gint i, GError **error);
 
 gchar * atspi_action_get_localized_name (AtspiAction *obj, gint i, GError **error);
 
+GPtrArray * atspi_action_get_actions (AtspiAction *obj, GError **error);
+
 gboolean atspi_action_do_action (AtspiAction *obj, gint i, GError **error);
 
 #ifndef ATSPI_DISABLE_DEPRECATED
@@ -41,6 +41,15 @@ atspi_application_dispose (GObject *object)
 {
   AtspiApplication *application = ATSPI_APPLICATION (object);
 
+  if (application->metadata_pending)
+  {
+    dbus_pending_call_cancel (application->metadata_pending);
+    dbus_pending_call_unref (application->metadata_pending);
+    application->metadata_pending = NULL;
+  }
+
+  _atspi_forget_application_statistics (application->bus_name);
+
   if (application->bus)
   {
     if (application->bus != _atspi_bus ())
@@ -56,6 +65,13 @@ atspi_application_dispose (GObject *object)
     application->hash = NULL;
   }
 
+  if (application->id_hash)
+  {
+    g_hash_table_foreach (application->id_hash, dispose_accessible, NULL);
+    g_hash_table_unref (application->id_hash);
+    application->id_hash = NULL;
+  }
+
   if (application->root)
   {
     g_clear_object (&application->root->parent.app);
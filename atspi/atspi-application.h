@@ -53,6 +53,10 @@ struct _AtspiApplication
   gchar *toolkit_version;
   gchar *atspi_version;
   struct timeval time_added;
+  guint extents_generation;
+  gint id;
+  DBusPendingCall *metadata_pending;
+  GHashTable *id_hash;
 };
 
 typedef struct _AtspiApplicationClass AtspiApplicationClass;
@@ -60,6 +60,61 @@ atspi_point_copy (AtspiPoint *src)
 
 G_DEFINE_BOXED_TYPE (AtspiPoint, atspi_point, atspi_point_copy, g_free)
 
+static gboolean
+lookup_cached_extents (AtspiAccessible *accessible, AtspiCoordType ctype,
+                       AtspiRect *rect)
+{
+  AtspiAccessibleExtras *extras = accessible->priv->extras;
+
+  if (ctype >= ATSPI_COORD_TYPE_COUNT || !extras ||
+      !_atspi_accessible_test_cache (accessible, ATSPI_CACHE_EXTENTS) ||
+      extras->extents_generation != accessible->parent.app->extents_generation ||
+      !(extras->extents_valid & (1 << ctype)))
+    return FALSE;
+
+  *rect = extras->extents[ctype];
+  return TRUE;
+}
+
+static void
+add_cached_extents (AtspiAccessible *accessible, AtspiCoordType ctype,
+                    const AtspiRect *rect)
+{
+  AtspiAccessibleExtras *extras;
+
+  if (ctype >= ATSPI_COORD_TYPE_COUNT || !accessible->parent.app ||
+      !(_atspi_accessible_get_cache_mask (accessible) & ATSPI_CACHE_EXTENTS))
+    return;
+
+  extras = _atspi_accessible_get_extras (accessible);
+  if (!_atspi_accessible_test_cache (accessible, ATSPI_CACHE_EXTENTS) ||
+      extras->extents_generation != accessible->parent.app->extents_generation)
+  {
+    extras->extents_valid = 0;
+    extras->extents_generation = accessible->parent.app->extents_generation;
+  }
+  extras->extents[ctype] = *rect;
+  extras->extents_valid |= (1 << ctype);
+  _atspi_accessible_add_cache (accessible, ATSPI_CACHE_EXTENTS);
+}
+
+/*
+ * Drops the cached extents of @accessible. Its descendants usually move
+ * along with it; rather than walking them, the extents cached for the
+ * whole application are dropped when it has children.
+ */
+void
+_atspi_component_invalidate_extents (AtspiAccessible *accessible)
+{
+  if (!(_atspi_accessible_get_cache_mask (accessible) & ATSPI_CACHE_EXTENTS))
+    return;
+
+  if (accessible->priv->extras)
+    accessible->priv->extras->extents_valid = 0;
+  if (accessible->children && accessible->children->len > 0)
+    accessible->parent.app->extents_generation++;
+}
+
 /**
  * atspi_component_contains:
  * @obj: a pointer to the #AtspiComponent to query.
@@ -122,6 +177,603 @@ atspi_component_get_accessible_at_point (AtspiComponent *obj,
   return _atspi_dbus_return_accessible_from_message (reply);
 }
 
+/* Side of the square cells of the hit-test grid, in pixels */
+#define HIT_INDEX_CELL_SIZE 64
+
+/* Upper bound on the number of components indexed per window */
+#define HIT_INDEX_MAX_NODES 8192
+
+typedef struct
+{
+  AtspiAccessible *accessible;
+  AtspiRect rect;
+  gint depth;
+  gboolean has_children;
+} HitIndexEntry;
+
+/*
+ * A uniform grid over the screen extents of a window. Each cell lists,
+ * in cell_entries[cell_starts[i]..cell_starts[i + 1]], the entries whose
+ * extents overlap it. Cells touched by a bounds or children change are
+ * marked dirty and answered by the application until the next rebuild.
+ * Entries that moved are listed in @moved until their new extents have
+ * been fetched.
+ */
+struct _AtspiHitIndex
+{
+  AtspiAccessible *window;
+  AtspiRect bounds;
+  gint n_columns;
+  gint n_rows;
+  GArray *entries;
+  gint *cell_starts;
+  gint *cell_entries;
+  guint8 *dirty;
+  gint n_dirty;
+  GHashTable *members;
+  GArray *moved;
+  gboolean stale;
+};
+
+/* Live indexes, to map events to the windows they affect */
+static GList *hit_indexes;
+
+void
+_atspi_hit_index_free (AtspiHitIndex *index)
+{
+  guint i;
+
+  hit_indexes = g_list_remove (hit_indexes, index);
+  for (i = 0; i < index->entries->len; i++)
+    g_object_unref (g_array_index (index->entries, HitIndexEntry, i).accessible);
+  g_array_free (index->entries, TRUE);
+  g_hash_table_destroy (index->members);
+  g_array_free (index->moved, TRUE);
+  g_free (index->cell_starts);
+  g_free (index->cell_entries);
+  g_free (index->dirty);
+  g_free (index);
+}
+
+static gboolean
+read_extents_from_reply (DBusMessage *reply, AtspiRect *rect)
+{
+  DBusMessageIter iter, iter_struct;
+  dbus_int32_t d_val[4];
+  gint i;
+
+  if (strcmp (dbus_message_get_signature (reply), "(iiii)") != 0)
+    return FALSE;
+
+  dbus_message_iter_init (reply, &iter);
+  dbus_message_iter_recurse (&iter, &iter_struct);
+  for (i = 0; i < 4; i++)
+  {
+    dbus_message_iter_get_basic (&iter_struct, &d_val[i]);
+    dbus_message_iter_next (&iter_struct);
+  }
+  rect->x = d_val[0];
+  rect->y = d_val[1];
+  rect->width = d_val[2];
+  rect->height = d_val[3];
+  return TRUE;
+}
+
+static gboolean
+get_cached_screen_extents (AtspiAccessible *accessible, AtspiRect *rect)
+{
+  GValue *val;
+
+  if (lookup_cached_extents (accessible, ATSPI_COORD_TYPE_SCREEN, rect))
+    return TRUE;
+  if (!accessible->priv->cache)
+    return FALSE;
+  val = g_hash_table_lookup (accessible->priv->cache, "Component.ScreenExtents");
+  if (!val)
+    return FALSE;
+  *rect = *(AtspiRect *) g_value_get_boxed (val);
+  return TRUE;
+}
+
+/* Whether @accessible is known not to be showing */
+static gboolean
+known_hidden (AtspiAccessible *accessible)
+{
+  return (_atspi_accessible_test_cache (accessible, ATSPI_CACHE_STATES) &&
+          !_atspi_accessible_has_state (accessible, ATSPI_STATE_SHOWING));
+}
+
+/*
+ * Whether the subtree below @accessible should be indexed. Objects that
+ * are known not to be showing are skipped, and so are the descendants of
+ * objects managing their own descendants, which can be arbitrarily many.
+ */
+static gboolean
+index_children_of (AtspiAccessible *accessible)
+{
+  if (!_atspi_accessible_test_cache (accessible, ATSPI_CACHE_STATES))
+    return TRUE;
+  return (_atspi_accessible_has_state (accessible, ATSPI_STATE_SHOWING) &&
+          !_atspi_accessible_has_state (accessible,
+                                        ATSPI_STATE_MANAGES_DESCENDANTS));
+}
+
+/*
+ * Walks the subtree below @window and fetches the screen extents of every
+ * component in it with one pipelined batch.
+ */
+static GArray *
+collect_entries (AtspiAccessible *window)
+{
+  GArray *entries = g_array_new (FALSE, FALSE, sizeof (HitIndexEntry));
+  GPtrArray *messages = g_ptr_array_new ();
+  GArray *pending = g_array_new (FALSE, FALSE, sizeof (guint));
+  DBusMessage **replies;
+  HitIndexEntry entry;
+  dbus_uint32_t d_ctype = ATSPI_COORD_TYPE_SCREEN;
+  guint i, head = 0;
+
+  entry.accessible = g_object_ref (window);
+  entry.depth = 0;
+  entry.has_children = FALSE;
+  g_array_append_val (entries, entry);
+
+  /* Breadth-first, so that the limit cuts the deepest levels */
+  while (head < entries->len && entries->len < HIT_INDEX_MAX_NODES)
+  {
+    HitIndexEntry *parent = &g_array_index (entries, HitIndexEntry, head++);
+    AtspiAccessible *accessible = parent->accessible;
+    gint depth = parent->depth;
+    gint n_children, j;
+
+    if (!index_children_of (accessible))
+      continue;
+
+    n_children = atspi_accessible_get_child_count (accessible, NULL);
+    for (j = 0; j < n_children && entries->len < HIT_INDEX_MAX_NODES; j++)
+    {
+      AtspiAccessible *child = atspi_accessible_get_child_at_index (accessible,
+                                                                   j, NULL);
+      AtspiComponent *component;
+
+      if (!child)
+        continue;
+      /* Hidden siblings, such as inactive notebook pages, often share
+       * the extents of the visible one */
+      if (known_hidden (child))
+      {
+        g_object_unref (child);
+        continue;
+      }
+      component = atspi_accessible_get_component_iface (child);
+      if (!component)
+      {
+        g_object_unref (child);
+        continue;
+      }
+      g_object_unref (component);
+      entry.accessible = child;
+      entry.depth = depth + 1;
+      g_array_append_val (entries, entry);
+      g_array_index (entries, HitIndexEntry, head - 1).has_children = TRUE;
+    }
+  }
+
+  for (i = 1; i < entries->len; i++)
+  {
+    HitIndexEntry *e = &g_array_index (entries, HitIndexEntry, i);
+    DBusMessage *message;
+
+    if (get_cached_screen_extents (e->accessible, &e->rect))
+      continue;
+    e->rect.width = e->rect.height = 0;
+    message = _atspi_dbus_new_method_call (e->accessible,
+                                           atspi_interface_component,
+                                           "GetExtents", "u", d_ctype);
+    if (!message)
+      continue;
+    g_ptr_array_add (messages, message);
+    g_array_append_val (pending, i);
+  }
+
+  replies = g_new0 (DBusMessage *, messages->len + 1);
+  if (messages->len > 0)
+    _atspi_dbus_send_batch (window->parent.app,
+                            (DBusMessage **) messages->pdata, replies,
+                            messages->len, NULL);
+  for (i = 0; i < messages->len; i++)
+  {
+    HitIndexEntry *e = &g_array_index (entries, HitIndexEntry,
+                                       g_array_index (pending, guint, i));
+    if (!replies[i])
+      continue;
+    if (read_extents_from_reply (replies[i], &e->rect))
+      add_cached_extents (e->accessible, ATSPI_COORD_TYPE_SCREEN, &e->rect);
+    dbus_message_unref (replies[i]);
+  }
+
+  g_free (replies);
+  g_ptr_array_free (messages, TRUE);
+  g_array_free (pending, TRUE);
+  return entries;
+}
+
+/* Computes the range of grid cells overlapped by @rect; FALSE if none */
+static gboolean
+get_cell_range (AtspiHitIndex *index, const AtspiRect *rect,
+                gint *col0, gint *row0, gint *col1, gint *row1)
+{
+  gint x0 = MAX (rect->x, index->bounds.x) - index->bounds.x;
+  gint y0 = MAX (rect->y, index->bounds.y) - index->bounds.y;
+  gint x1 = MIN (rect->x + rect->width,
+                 index->bounds.x + index->bounds.width) - index->bounds.x;
+  gint y1 = MIN (rect->y + rect->height,
+                 index->bounds.y + index->bounds.height) - index->bounds.y;
+
+  if (x1 <= x0 || y1 <= y0)
+    return FALSE;
+
+  *col0 = x0 / HIT_INDEX_CELL_SIZE;
+  *row0 = y0 / HIT_INDEX_CELL_SIZE;
+  *col1 = (x1 - 1) / HIT_INDEX_CELL_SIZE;
+  *row1 = (y1 - 1) / HIT_INDEX_CELL_SIZE;
+  return TRUE;
+}
+
+static AtspiHitIndex *
+hit_index_new (AtspiAccessible *window, GError **error)
+{
+  AtspiHitIndex *index;
+  AtspiRect bounds;
+  dbus_uint32_t d_ctype = ATSPI_COORD_TYPE_SCREEN;
+  gint n_cells, col0, row0, col1, row1, r, c;
+  gint *fill;
+  guint i;
+
+  if (!_atspi_dbus_call (window, atspi_interface_component, "GetExtents",
+                         error, "u=>(iiii)", d_ctype, &bounds))
+    return NULL;
+  if (bounds.width <= 0 || bounds.height <= 0)
+    return NULL;
+  /* Keeps the cell count, and the sizes derived from it, in range */
+  if (bounds.width / HIT_INDEX_CELL_SIZE + 1 >
+      G_MAXINT / (gint) sizeof (gint) /
+      (bounds.height / HIT_INDEX_CELL_SIZE + 1) - 1)
+    return NULL;
+
+  index = g_new0 (AtspiHitIndex, 1);
+  index->window = window;
+  index->bounds = bounds;
+  index->n_columns = (bounds.width + HIT_INDEX_CELL_SIZE - 1) / HIT_INDEX_CELL_SIZE;
+  index->n_rows = (bounds.height + HIT_INDEX_CELL_SIZE - 1) / HIT_INDEX_CELL_SIZE;
+  n_cells = index->n_columns * index->n_rows;
+  index->entries = collect_entries (window);
+  index->members = g_hash_table_new (g_direct_hash, g_direct_equal);
+  index->moved = g_array_new (FALSE, FALSE, sizeof (guint));
+  index->cell_starts = g_new0 (gint, n_cells + 1);
+  index->dirty = g_new0 (guint8, n_cells);
+
+  /* Count the entries of each cell, then lay them out contiguously */
+  for (i = 1; i < index->entries->len; i++)
+  {
+    HitIndexEntry *e = &g_array_index (index->entries, HitIndexEntry, i);
+    g_hash_table_insert (index->members, e->accessible, GUINT_TO_POINTER (i));
+    if (!get_cell_range (index, &e->rect, &col0, &row0, &col1, &row1))
+      continue;
+    for (r = row0; r <= row1; r++)
+      for (c = col0; c <= col1; c++)
+        index->cell_starts[r * index->n_columns + c + 1]++;
+  }
+  for (c = 0; c < n_cells; c++)
+    index->cell_starts[c + 1] += index->cell_starts[c];
+
+  index->cell_entries = g_new (gint, index->cell_starts[n_cells] + 1);
+  fill = g_new (gint, n_cells);
+  memcpy (fill, index->cell_starts, n_cells * sizeof (gint));
+  for (i = 1; i < index->entries->len; i++)
+  {
+    HitIndexEntry *e = &g_array_index (index->entries, HitIndexEntry, i);
+    if (!get_cell_range (index, &e->rect, &col0, &row0, &col1, &row1))
+      continue;
+    for (r = row0; r <= row1; r++)
+      for (c = col0; c <= col1; c++)
+        index->cell_entries[fill[r * index->n_columns + c]++] = i;
+  }
+  g_free (fill);
+
+  hit_indexes = g_list_prepend (hit_indexes, index);
+  return index;
+}
+
+static void
+hit_index_mark_dirty (AtspiHitIndex *index, const AtspiRect *rect)
+{
+  gint col0, row0, col1, row1, r, c;
+
+  if (!get_cell_range (index, rect, &col0, &row0, &col1, &row1))
+    return;
+  for (r = row0; r <= row1; r++)
+    for (c = col0; c <= col1; c++)
+    {
+      gint cell = r * index->n_columns + c;
+      if (!index->dirty[cell])
+      {
+        index->dirty[cell] = 1;
+        index->n_dirty++;
+      }
+    }
+}
+
+/*
+ * Called for the events that can change what is found at a point:
+ * children and showing changes. A change to the window itself
+ * invalidates its whole index; a change to an indexed component only
+ * the cells it covers. Objects that were hidden when the index was
+ * built are not in it, so for those the closest indexed ancestor is
+ * used instead.
+ */
+void
+_atspi_hit_index_invalidate (AtspiAccessible *source)
+{
+  GList *l;
+
+  for (l = hit_indexes; l; l = l->next)
+  {
+    AtspiHitIndex *index = l->data;
+    AtspiAccessible *accessible;
+    guint i;
+
+    for (accessible = source; accessible;
+         accessible = accessible->accessible_parent)
+    {
+      if (accessible == index->window)
+      {
+        index->stale = TRUE;
+        break;
+      }
+      i = GPOINTER_TO_UINT (g_hash_table_lookup (index->members, accessible));
+      if (i)
+      {
+        hit_index_mark_dirty (index,
+                              &g_array_index (index->entries, HitIndexEntry, i).rect);
+        break;
+      }
+    }
+  }
+}
+
+/*
+ * Called on bounds-changed. The rectangle sent with the event does not
+ * say which coordinate system it is in, so it is not used: the cells
+ * that @source covered are marked dirty, and its new extents are fetched
+ * on the next hit test. The whole index is dropped if @source has
+ * indexed descendants, which may have moved along with it.
+ */
+void
+_atspi_hit_index_move (AtspiAccessible *source)
+{
+  GList *l;
+
+  for (l = hit_indexes; l; l = l->next)
+  {
+    AtspiHitIndex *index = l->data;
+    HitIndexEntry *e;
+    guint i, j;
+
+    if (source == index->window)
+    {
+      index->stale = TRUE;
+      continue;
+    }
+    i = GPOINTER_TO_UINT (g_hash_table_lookup (index->members, source));
+    if (!i)
+      continue;
+    e = &g_array_index (index->entries, HitIndexEntry, i);
+    if (e->has_children)
+    {
+      index->stale = TRUE;
+      continue;
+    }
+    hit_index_mark_dirty (index, &e->rect);
+    for (j = 0; j < index->moved->len; j++)
+      if (g_array_index (index->moved, guint, j) == i)
+        break;
+    if (j == index->moved->len)
+      g_array_append_val (index->moved, i);
+  }
+}
+
+/*
+ * Fetches the screen extents of the entries of @index that moved, in
+ * one pipelined batch, and marks the cells they now cover dirty. The
+ * index of @window may be dropped while the replies are awaited.
+ */
+static void
+hit_index_update_moved (AtspiAccessible *window, AtspiHitIndex *index)
+{
+  GArray *moved = index->moved;
+  GPtrArray *messages;
+  DBusMessage **replies;
+  dbus_uint32_t d_ctype = ATSPI_COORD_TYPE_SCREEN;
+  guint i;
+
+  if (moved->len == 0)
+    return;
+
+  /* Moves reported while the batch is out are handled next time */
+  index->moved = g_array_new (FALSE, FALSE, sizeof (guint));
+  messages = g_ptr_array_new ();
+  for (i = 0; i < moved->len; i++)
+  {
+    HitIndexEntry *e = &g_array_index (index->entries, HitIndexEntry,
+                                       g_array_index (moved, guint, i));
+    g_ptr_array_add (messages,
+                     _atspi_dbus_new_method_call (e->accessible,
+                                                  atspi_interface_component,
+                                                  "GetExtents", "u", d_ctype));
+  }
+
+  replies = g_new0 (DBusMessage *, messages->len + 1);
+  _atspi_dbus_send_batch (window->parent.app, (DBusMessage **) messages->pdata,
+                          replies, messages->len, NULL);
+
+  for (i = 0; i < moved->len; i++)
+  {
+    HitIndexEntry *e;
+
+    if (window->priv->extras->hit_index != index)
+    {
+      if (replies[i])
+        dbus_message_unref (replies[i]);
+      continue;
+    }
+    e = &g_array_index (index->entries, HitIndexEntry,
+                        g_array_index (moved, guint, i));
+    if (replies[i] && read_extents_from_reply (replies[i], &e->rect))
+    {
+      hit_index_mark_dirty (index, &e->rect);
+      add_cached_extents (e->accessible, ATSPI_COORD_TYPE_SCREEN, &e->rect);
+    }
+    else
+      index->stale = TRUE;
+    if (replies[i])
+      dbus_message_unref (replies[i]);
+  }
+
+  g_free (replies);
+  g_ptr_array_free (messages, TRUE);
+  g_array_free (moved, TRUE);
+}
+
+/* Asks the application, descending one level per round trip */
+static AtspiAccessible *
+hit_test_remote (AtspiAccessible *start, gint x, gint y, AtspiCoordType ctype,
+                 GError **error)
+{
+  AtspiAccessible *result = NULL;
+  AtspiAccessible *current = g_object_ref (start);
+  gint depth;
+
+  for (depth = 0; depth < 64; depth++)
+  {
+    AtspiAccessible *child;
+
+    child = atspi_component_get_accessible_at_point (ATSPI_COMPONENT (current),
+                                                     x, y, ctype, error);
+    if (!child || child == current)
+    {
+      g_clear_object (&child);
+      break;
+    }
+    g_object_unref (current);
+    current = child;
+    g_clear_object (&result);
+    result = g_object_ref (child);
+  }
+
+  g_object_unref (current);
+  return result;
+}
+
+/**
+ * atspi_component_hit_test:
+ * @obj: a pointer to the #AtspiComponent of a window.
+ * @x: a #gint specifying the x coordinate of the point in question.
+ * @y: a #gint specifying the y coordinate of the point in question.
+ * @ctype: the coordinate system of the point (@x, @y)
+ *         (e.g. ATSPI_COORD_TYPE_WINDOW, ATSPI_COORD_TYPE_SCREEN).
+ *
+ * Gets the deepest descendant of a window containing a given point.
+ * Unlike #atspi_component_get_accessible_at_point, this answers from a
+ * spatial index of the extents of the components in the window, built
+ * on the first call with batched requests and kept up to date through
+ * bounds-changed, children-changed and showing events. The application
+ * is only queried for the parts of the window that changed since the
+ * index was built, and below objects that manage their descendants.
+ *
+ * The index is only trusted while events are being processed, as with
+ * the other cached properties; otherwise every call asks the application.
+ *
+ * Returns: (nullable) (transfer full): the deepest #AtspiAccessible
+ *          below @obj containing the point (@x, @y), or NULL if no
+ *          descendant contains the point.
+ **/
+AtspiAccessible *
+atspi_component_hit_test (AtspiComponent *obj,
+                          gint x,
+                          gint y,
+                          AtspiCoordType ctype,
+                          GError **error)
+{
+  AtspiAccessible *window;
+  AtspiAccessibleExtras *extras;
+  AtspiHitIndex *index;
+  HitIndexEntry *best = NULL;
+  gint cell, i;
+
+  g_return_val_if_fail (obj != NULL, NULL);
+
+  window = ATSPI_ACCESSIBLE (obj);
+  if (!_atspi_accessible_cache_is_live ())
+    return hit_test_remote (window, x, y, ctype, error);
+
+  extras = _atspi_accessible_get_extras (window);
+  if (extras->hit_index && !extras->hit_index->stale)
+    hit_index_update_moved (window, extras->hit_index);
+  index = extras->hit_index;
+  if (index && (index->stale ||
+                index->n_dirty * 4 > index->n_columns * index->n_rows))
+  {
+    _atspi_hit_index_free (index);
+    index = extras->hit_index = NULL;
+  }
+  if (!index)
+    index = extras->hit_index = hit_index_new (window, NULL);
+  if (!index)
+    return hit_test_remote (window, x, y, ctype, error);
+
+  if (ctype == ATSPI_COORD_TYPE_WINDOW)
+  {
+    x += index->bounds.x;
+    y += index->bounds.y;
+  }
+  x -= index->bounds.x;
+  y -= index->bounds.y;
+  if (x < 0 || y < 0 || x >= index->bounds.width || y >= index->bounds.height)
+    return NULL;
+
+  cell = (y / HIT_INDEX_CELL_SIZE) * index->n_columns + x / HIT_INDEX_CELL_SIZE;
+  x += index->bounds.x;
+  y += index->bounds.y;
+  if (index->dirty[cell])
+    return hit_test_remote (window, x, y, ATSPI_COORD_TYPE_SCREEN, error);
+
+  for (i = index->cell_starts[cell]; i < index->cell_starts[cell + 1]; i++)
+  {
+    HitIndexEntry *e = &g_array_index (index->entries, HitIndexEntry,
+                                       index->cell_entries[i]);
+    if (x < e->rect.x || y < e->rect.y ||
+        x >= e->rect.x + e->rect.width || y >= e->rect.y + e->rect.height)
+      continue;
+    /* Later entries at the same depth were painted above earlier ones */
+    if (!best || e->depth >= best->depth)
+      best = e;
+  }
+
+  if (!best)
+    return NULL;
+  if (!index_children_of (best->accessible))
+  {
+    AtspiAccessible *descendant;
+
+    descendant = hit_test_remote (best->accessible, x, y,
+                                  ATSPI_COORD_TYPE_SCREEN, error);
+    if (descendant)
+      return descendant;
+  }
+  return g_object_ref (best->accessible);
+}
+
 /**
  * atspi_component_get_extents:
  * @obj: a pointer to the #AtspiComponent to query.
@@ -153,7 +805,11 @@ atspi_component_get_extents (AtspiComponent *obj,
     }
   }
 
-  _atspi_dbus_call (obj, atspi_interface_component, "GetExtents", error, "u=>(iiii)", d_ctype, &bbox);
+  if (lookup_cached_extents (accessible, ctype, &bbox))
+    return atspi_rect_copy (&bbox);
+
+  if (_atspi_dbus_call (obj, atspi_interface_component, "GetExtents", error, "u=>(iiii)", d_ctype, &bbox))
+    add_cached_extents (accessible, ctype, &bbox);
   return atspi_rect_copy (&bbox);
 }
 
@@ -174,12 +830,20 @@ atspi_component_get_position (AtspiComponent *obj,
   dbus_int32_t d_x, d_y;
   dbus_uint32_t d_ctype = ctype;
   AtspiPoint ret;
+  AtspiRect bbox;
 
   ret.x = ret.y = -1;
 
   if (!obj)
     return atspi_point_copy (&ret);
 
+  if (lookup_cached_extents (ATSPI_ACCESSIBLE (obj), ctype, &bbox))
+  {
+    ret.x = bbox.x;
+    ret.y = bbox.y;
+    return atspi_point_copy (&ret);
+  }
+
   _atspi_dbus_call (obj, atspi_interface_component, "GetPosition", error, "u=>ii", d_ctype, &d_x, &d_y);
 
   ret.x = d_x;
@@ -200,11 +864,23 @@ atspi_component_get_size (AtspiComponent *obj, GError **error)
 {
   dbus_int32_t d_w, d_h;
   AtspiPoint ret;
+  AtspiRect bbox;
+  AtspiCoordType ctype;
 
   ret.x = ret.y = -1;
   if (!obj)
     return atspi_point_copy (&ret);
 
+  for (ctype = ATSPI_COORD_TYPE_SCREEN; ctype < ATSPI_COORD_TYPE_COUNT; ctype++)
+  {
+    if (lookup_cached_extents (ATSPI_ACCESSIBLE (obj), ctype, &bbox))
+    {
+      ret.x = bbox.width;
+      ret.y = bbox.height;
+      return atspi_point_copy (&ret);
+    }
+  }
+
   _atspi_dbus_call (obj, atspi_interface_component, "GetSize", error, "=>ii", &d_w, &d_h);
   ret.x = d_w;
   ret.y = d_h;
@@ -351,6 +1027,7 @@ atspi_component_set_extents (AtspiComponent *obj,
   dbus_message_get_args (reply, NULL, DBUS_TYPE_BOOLEAN, &retval,
                               DBUS_TYPE_INVALID);
   dbus_message_unref (reply);
+  _atspi_component_invalidate_extents (aobj);
   return retval;
 }
 
@@ -381,6 +1058,7 @@ atspi_component_set_position (AtspiComponent *obj,
 
   _atspi_dbus_call (obj, atspi_interface_component, "SetPosition", error,
                     "iiu=>b", d_x, d_y, d_ctype, &ret);
+  _atspi_component_invalidate_extents (ATSPI_ACCESSIBLE (obj));
 
   return ret;
 }
@@ -408,6 +1086,7 @@ atspi_component_set_size (AtspiComponent *obj,
 
   _atspi_dbus_call (obj, atspi_interface_component, "SetSize", error, "ii=>b",
                     d_width, d_height, &ret);
+  _atspi_component_invalidate_extents (ATSPI_ACCESSIBLE (obj));
 
   return ret;
 }
@@ -379,6 +379,24 @@ typedef enum {
  */
 #define ATSPI_TEXT_BOUNDARY_TYPE_COUNT (6+1)
 
+/**
+ *AtspiTextSearchFlags:
+ *@ATSPI_TEXT_SEARCH_NONE: Search forward for the literal pattern, matching case.
+ *@ATSPI_TEXT_SEARCH_BACKWARD: Search backward, for the last match starting
+ * before the given offset.
+ *@ATSPI_TEXT_SEARCH_CASE_INSENSITIVE: Ignore case when matching.
+ *@ATSPI_TEXT_SEARCH_REGEX: Interpret the pattern as a Perl-compatible
+ * regular expression, as understood by #GRegex.
+ *
+ * Flags used to control #atspi_text_find.
+ **/
+typedef enum {
+  ATSPI_TEXT_SEARCH_NONE             = 0,
+  ATSPI_TEXT_SEARCH_BACKWARD         = 1 << 0,
+  ATSPI_TEXT_SEARCH_CASE_INSENSITIVE = 1 << 1,
+  ATSPI_TEXT_SEARCH_REGEX            = 1 << 2,
+} AtspiTextSearchFlags;
+
 /**
  * AtspiTextClipType:
  * @ATSPI_TEXT_CLIP_NONE: No characters/glyphs are omitted.
@@ -1378,11 +1396,34 @@ typedef enum
   ATSPI_CACHE_ROLE        = 1 << 5,
   ATSPI_CACHE_INTERFACES  = 1 << 6,
   ATSPI_CACHE_ATTRIBUTES = 1 << 7,
+  ATSPI_CACHE_TABLE       = 1 << 8,
+  ATSPI_CACHE_EXTENTS     = 1 << 9,
+  ATSPI_CACHE_RELATIONS   = 1 << 10,
+  ATSPI_CACHE_ACTIONS     = 1 << 11,
   ATSPI_CACHE_ALL         = 0x3fffffff,
-  ATSPI_CACHE_DEFAULT = ATSPI_CACHE_PARENT | ATSPI_CACHE_CHILDREN | ATSPI_CACHE_NAME | ATSPI_CACHE_DESCRIPTION | ATSPI_CACHE_STATES | ATSPI_CACHE_ROLE | ATSPI_CACHE_INTERFACES,
+  ATSPI_CACHE_DEFAULT = ATSPI_CACHE_PARENT | ATSPI_CACHE_CHILDREN | ATSPI_CACHE_NAME | ATSPI_CACHE_DESCRIPTION | ATSPI_CACHE_STATES | ATSPI_CACHE_ROLE | ATSPI_CACHE_INTERFACES | ATSPI_CACHE_TABLE,
   ATSPI_CACHE_UNDEFINED   = 0x40000000,
 } AtspiCache;
 
+/**
+ * AtspiSnapshotChangeType:
+ * @ATSPI_SNAPSHOT_CHANGE_INSERTED: The node only exists in the new snapshot.
+ * @ATSPI_SNAPSHOT_CHANGE_REMOVED: The node only exists in the old snapshot.
+ * @ATSPI_SNAPSHOT_CHANGE_MOVED: The node has a different parent, or has
+ * been reordered among its siblings. Its properties may also have changed.
+ * @ATSPI_SNAPSHOT_CHANGE_PROPERTIES: The node is in the same place, but
+ * some of its properties differ.
+ *
+ * The kinds of change reported by atspi_snapshot_diff().
+ **/
+typedef enum
+{
+  ATSPI_SNAPSHOT_CHANGE_INSERTED,
+  ATSPI_SNAPSHOT_CHANGE_REMOVED,
+  ATSPI_SNAPSHOT_CHANGE_MOVED,
+  ATSPI_SNAPSHOT_CHANGE_PROPERTIES,
+} AtspiSnapshotChangeType;
+
 #define ATSPI_DBUS_NAME_REGISTRY "org.a11y.atspi.Registry"
 #define ATSPI_DBUS_PATH_REGISTRY "/org/a11y/atspi/registry"
 #define ATSPI_DBUS_INTERFACE_REGISTRY "org.a11y.atspi.Registry"
@@ -203,7 +203,7 @@ cache_process_children_changed (AtspiEvent *event)
 
   if (!G_VALUE_HOLDS (&event->any_data, ATSPI_TYPE_ACCESSIBLE) ||
       !(event->source->cached_properties & ATSPI_CACHE_CHILDREN) ||
-      atspi_state_set_contains (event->source->states, ATSPI_STATE_MANAGES_DESCENDANTS))
+      _atspi_accessible_has_state (event->source, ATSPI_STATE_MANAGES_DESCENDANTS))
     return;
 
   child = g_value_get_object (&event->any_data);
@@ -212,6 +212,7 @@ cache_process_children_changed (AtspiEvent *event)
 
   if (!strncmp (event->type, "object:children-changed:add", 27))
   {
+    _atspi_accessible_ensure_children (event->source);
     g_ptr_array_remove (event->source->children, child); /* just to be safe */
     if (event->detail1 < 0 || event->detail1 > event->source->children->len)
     {
@@ -227,7 +228,8 @@ cache_process_children_changed (AtspiEvent *event)
   }
   else
   {
-    g_ptr_array_remove (event->source->children, child);
+    if (event->source->children)
+      g_ptr_array_remove (event->source->children, child);
     if (child == child->parent.app->root)
       g_object_run_dispose (G_OBJECT (child->parent.app));
   }
@@ -298,9 +300,10 @@ cache_process_property_change (AtspiEvent *event)
 static void
 cache_process_state_changed (AtspiEvent *event)
 {
-  if (event->source->states)
-    atspi_state_set_set_by_name (event->source->states, event->type + 21,
-                                 event->detail1);
+  gint state = _atspi_state_type_from_name (event->type + 21);
+
+  if (state >= 0)
+    _atspi_accessible_set_state (event->source, state, event->detail1);
 }
 
 static dbus_bool_t
@@ -862,6 +865,34 @@ atspi_event_listener_deregister_no_data (AtspiEventListenerSimpleCB callback,
                                                         error);
 }
 
+static AtspiCache focus_prefetch_properties = ATSPI_CACHE_NONE;
+static gint focus_prefetch_ancestors = 0;
+
+/**
+ * atspi_set_focus_prefetch:
+ * @properties: the #AtspiCache flags of the properties to fetch; only
+ *              %ATSPI_CACHE_PARENT, %ATSPI_CACHE_NAME,
+ *              %ATSPI_CACHE_DESCRIPTION, %ATSPI_CACHE_STATES,
+ *              %ATSPI_CACHE_ROLE and %ATSPI_CACHE_RELATIONS are
+ *              supported. %ATSPI_CACHE_NONE turns prefetching off.
+ * @n_ancestors: the number of ancestors of the focused object whose
+ *               properties are fetched as well.
+ *
+ * Sets the properties fetched when a "focus:" or
+ * "object:state-changed:focused" event arrives, before the listeners for
+ * it are called, so that they find the values in the cache. The calls
+ * are pipelined: the whole set costs about one round trip, plus one per
+ * ancestor whose parent is not cached yet. Properties that are already
+ * cached, or that the application does not allow to cache, are not
+ * fetched.
+ **/
+void
+atspi_set_focus_prefetch (AtspiCache properties, gint n_ancestors)
+{
+  focus_prefetch_properties = properties;
+  focus_prefetch_ancestors = MAX (n_ancestors, 0);
+}
+
 static AtspiEvent *
 atspi_event_copy (AtspiEvent *src)
 {
@@ -899,6 +930,29 @@ detail_matches_listener (const char *event_detail, const char *listener_detail)
                : strcmp (listener_detail, event_detail));
 }
 
+/* Returns TRUE if _atspi_send_event would call a listener for @e */
+static gboolean
+has_listener_for (AtspiEvent *e)
+{
+  char *category, *name, *detail;
+  GList *l;
+
+  if (!convert_event_type_to_dbus (e->type, &category, &name, &detail, NULL))
+    return FALSE;
+  for (l = event_listeners; l; l = g_list_next (l))
+  {
+    EventListenerEntry *entry = l->data;
+    if (!strcmp (category, entry->category) &&
+        (entry->name == NULL || !strcmp (name, entry->name)) &&
+        detail_matches_listener (detail, entry->detail))
+      break;
+  }
+  if (detail) g_free (detail);
+  g_free (name);
+  g_free (category);
+  return (l != NULL);
+}
+
 void
 _atspi_send_event (AtspiEvent *e)
 {
@@ -1057,6 +1111,12 @@ _atspi_dbus_handle_event (DBusConnection *bus, DBusMessage *message, void *data)
     break;
   }
 
+  /* BGO#663992 - TODO: figure out the real problem.
+   * Done before parsing the properties below, so that states sent with
+   * the event are kept. */
+  if (!strncmp (e.type, "focus", 5))
+    e.source->cached_properties &= ~(ATSPI_CACHE_STATES);
+
   dbus_message_iter_next (&iter);
   if (dbus_message_iter_get_arg_type (&iter) == DBUS_TYPE_ARRAY)
   {
@@ -1076,11 +1136,74 @@ _atspi_dbus_handle_event (DBusConnection *bus, DBusMessage *message, void *data)
   {
     cache_process_state_changed (&e);
   }
-  else if (!strncmp (e.type, "focus", 5))
+
+  /* Only a change to the contents invalidates the text mirror; attribute
+   * changes and scrolling only move the characters */
+  if (!strncmp (e.type, "object:text-changed", 19))
+    _atspi_accessible_invalidate_text_cache (e.source);
+  else if (!strncmp (e.type, "object:text-attributes-changed", 30) ||
+           !strncmp (e.type, "object:bounds-changed", 21))
+    _atspi_accessible_invalidate_text_layout (e.source);
+  else if (!strncmp (e.type, "object:row-", 11) ||
+           !strncmp (e.type, "object:column-", 14) ||
+           !strncmp (e.type, "object:model-changed", 20) ||
+           !strncmp (e.type, "object:property-change:accessible-table-", 40))
+    _atspi_table_cache_invalidate (e.source, e.type);
+
+  if (!strncmp (e.type, "object:bounds-changed", 21))
   {
-    /* BGO#663992 - TODO: figure out the real problem */
-    e.source->cached_properties &= ~(ATSPI_CACHE_STATES);
+    _atspi_component_invalidate_extents (e.source);
+    _atspi_hit_index_move (e.source);
+  }
+  else if (!strncmp (e.type, "window:move", 11) ||
+           !strncmp (e.type, "window:resize", 13) ||
+           !strncmp (e.type, "window:maximize", 15) ||
+           !strncmp (e.type, "window:restore", 14))
+  {
+    /* Everything in the window moved with it */
+    if (e.source->parent.app)
+      e.source->parent.app->extents_generation++;
+    _atspi_hit_index_invalidate (e.source);
+  }
+
+  /* Action names and key bindings follow the name and a few states */
+  if (!strncmp (e.type, "object:property-change:", 23) ||
+      !strncmp (e.type, "object:state-changed:expand", 27) ||
+      !strncmp (e.type, "object:state-changed:collapsed", 30) ||
+      !strncmp (e.type, "object:state-changed:checked", 28) ||
+      !strncmp (e.type, "object:state-changed:sensitive", 30) ||
+      !strncmp (e.type, "object:state-changed:enabled", 28) ||
+      !strncmp (e.type, "object:state-changed:editable", 29))
+    e.source->cached_properties &= ~ATSPI_CACHE_ACTIONS;
+
+  /* Relations are not notified on their own; drop them on structural
+   * changes and on property changes other than the frequent ones */
+  if (!strncmp (e.type, "object:children-changed", 23))
+  {
+    _atspi_accessible_invalidate_relations (e.source);
+    if (G_VALUE_HOLDS (&e.any_data, ATSPI_TYPE_ACCESSIBLE) &&
+        g_value_get_object (&e.any_data))
+      _atspi_accessible_invalidate_relations (g_value_get_object (&e.any_data));
   }
+  else if (!strncmp (e.type, "object:property-change:accessible-", 34) &&
+           strcmp (e.type + 34, "name") != 0 &&
+           strcmp (e.type + 34, "description") != 0 &&
+           strcmp (e.type + 34, "value") != 0)
+    _atspi_accessible_invalidate_relations (e.source);
+
+  if (!strncmp (e.type, "object:children-changed", 23) ||
+      !strncmp (e.type, "object:state-changed:showing", 28) ||
+      !strncmp (e.type, "object:state-changed:visible", 28))
+    _atspi_hit_index_invalidate (e.source);
+
+  /* The prefetch blocks dispatch, so it is only worth it when someone
+   * will read the values */
+  if (focus_prefetch_properties != ATSPI_CACHE_NONE &&
+      (!strncmp (e.type, "focus", 5) ||
+       (!strcmp (e.type, "object:state-changed:focused") && e.detail1)) &&
+      has_listener_for (&e))
+    _atspi_accessible_prefetch (e.source, focus_prefetch_properties,
+                                focus_prefetch_ancestors);
 
   _atspi_send_event (&e);
 
@@ -135,6 +135,9 @@ atspi_event_listener_deregister_no_data (AtspiEventListenerSimpleCB callback,
 				   const gchar              *event_type,
 				   GError **error);
 
+void
+atspi_set_focus_prefetch (AtspiCache properties, gint n_ancestors);
+
 G_END_DECLS
 
 #endif	/* _ATSPI_EVENT_LISTENER_H_ */
@@ -93,12 +93,40 @@ dbus_bool_t _atspi_dbus_call (gpointer obj, const char *interface, const char *m
 
 DBusMessage *_atspi_dbus_call_partial (gpointer obj, const char *interface, const char *method, GError **error, const char *type, ...);
 
+DBusMessage *_atspi_dbus_call_partial_with_error_name (gpointer obj, const char *interface, const char *method, gchar **error_name, GError **error, const char *type, ...);
+
 DBusMessage *_atspi_dbus_call_partial_va (gpointer obj, const char *interface, const char *method, GError **error, const char *type, va_list args);
 
 dbus_bool_t _atspi_dbus_get_property (gpointer obj, const char *interface, const char *name, GError **error, const char *type, void *data);
 
+gboolean _atspi_application_wait_for_properties (AtspiApplication *app, GError **error);
+
+void _atspi_forget_application_statistics (const gchar *bus_name);
+
+dbus_bool_t _atspi_dbus_get_property_from_reply (DBusMessage *reply, const char *interface, const char *name, const char *type, void *data);
+
 DBusMessage * _atspi_dbus_send_with_reply_and_block (DBusMessage *message, GError **error);
 
+DBusMessage *_atspi_dbus_new_method_call (gpointer obj, const char *interface, const char *method, const char *type, ...);
+
+DBusMessage *_atspi_dbus_new_get_property (gpointer obj, const char *interface, const char *name);
+
+gboolean _atspi_dbus_send_batch (AtspiApplication *app, DBusMessage **messages, DBusMessage **replies, gint n_messages, GError **error);
+
+DBusPendingCall *_atspi_dbus_send_with_reply (AtspiApplication *app, DBusMessage *message);
+
+DBusMessage *_atspi_dbus_pending_call_finish (AtspiApplication *app, DBusPendingCall *pending, GError **error);
+
+gchar *_atspi_string_pool_intern (const gchar *str);
+
+void _atspi_string_pool_release (gpointer str);
+
+GHashTable *_atspi_dbus_return_pooled_hash_from_message (DBusMessage *message);
+
+GHashTable *_atspi_dbus_pooled_hash_from_iter (DBusMessageIter *iter);
+
+gboolean _atspi_write_all (gint fd, gconstpointer data, gsize len, GError **error);
+
 GHashTable *_atspi_dbus_return_hash_from_message (DBusMessage *message);
 
 GHashTable *_atspi_dbus_hash_from_iter (DBusMessageIter *iter);
@@ -33,10 +33,16 @@
 #include "X11/Xlib.h"
 #endif
 #include "atspi-gmain.h"
+#include <errno.h>
 #include <stdio.h>
 #include <string.h>
+#include <unistd.h>
 
 static void handle_get_items (DBusPendingCall *pending, void *user_data);
+static void add_accessible_from_iter (DBusMessageIter *iter);
+static void call_completed (DBusMessage *message, DBusMessage *reply,
+                            dbus_int64_t start_time, dbus_int64_t duration,
+                            dbus_bool_t reentered);
 
 static DBusConnection *bus = NULL;
 static GHashTable *live_refs = NULL;
@@ -156,7 +162,7 @@ cleanup ()
     return;
 
   /* TODO: Do we need this code, or should we just dispose the desktop? */
-  for (i = desktop->children->len - 1; i >= 0; i--)
+  if (desktop->children) for (i = desktop->children->len - 1; i >= 0; i--)
   {
     AtspiAccessible *child = g_ptr_array_index (desktop->children, i);
     g_object_run_dispose (G_OBJECT (child->parent.app));
@@ -172,6 +178,200 @@ static gboolean atspi_inited = FALSE;
 
 static GHashTable *app_hash = NULL;
 
+/*
+ * Each new application is asked for its bus address and then for the
+ * contents of its cache. At most MAX_DISCOVERIES applications are queried
+ * at a time, so that a desktop full of applications does not flood the
+ * bus, and GetItems replies are parsed in slices of at most
+ * DISCOVERY_BUDGET_US per main loop iteration, so that a large tree does
+ * not hold up event delivery. Applications being discovered hold a
+ * reference from the time they are queued until their cache is filled.
+ *
+ * A GetItems reply describes the tree as it was when the application
+ * answered, so signals it sent afterwards must not be applied before the
+ * reply has been parsed, or the parse would revert them. They are held
+ * back with the parse and put back at the front of the queue once it is
+ * done.
+ */
+#define MAX_DISCOVERIES 8
+#define DISCOVERY_BUDGET_US 5000
+
+typedef struct
+{
+  AtspiApplication *app;
+  DBusMessage *reply;
+  DBusMessageIter iter;
+  GQueue *held;
+} ItemsParse;
+
+static GQueue *queued_discoveries;
+static guint n_discoveries;
+static GQueue *items_parses;
+static GSource *items_parse_source;
+static AtspiDiscoveryCallback discovery_callback;
+static gpointer discovery_data;
+static GDestroyNotify discovery_data_destroy;
+
+static void handle_get_bus_address (DBusPendingCall *pending, void *user_data);
+static int get_timeout (AtspiApplication *app);
+static gboolean check_app (AtspiApplication *app, GError **error);
+static void check_for_hang (DBusMessage *message, DBusError *error, DBusConnection *bus, const char *bus_name);
+static void release_held_messages (GQueue *held);
+
+static gboolean
+start_discovery (AtspiApplication *app)
+{
+  DBusMessage *message;
+  DBusPendingCall *pending = NULL;
+
+  if (!app->bus)
+    return FALSE;
+
+  message = dbus_message_new_method_call (app->bus_name, atspi_path_root,
+                                          atspi_interface_application, "GetApplicationBusAddress");
+
+  dbus_connection_send_with_reply (app->bus, message, &pending, 2000);
+  dbus_message_unref (message);
+  if (!pending)
+    return FALSE;
+  dbus_pending_call_set_notify (pending, handle_get_bus_address, app, NULL);
+  n_discoveries++;
+  return TRUE;
+}
+
+static void
+start_queued_discoveries (void)
+{
+  AtspiApplication *app;
+
+  while (n_discoveries < MAX_DISCOVERIES && queued_discoveries &&
+         (app = g_queue_pop_head (queued_discoveries)))
+  {
+    if (!start_discovery (app))
+      g_object_unref (app);
+  }
+}
+
+/* Returns FALSE if the discovery could not be started */
+static gboolean
+schedule_discovery (AtspiApplication *app)
+{
+  if (n_discoveries < MAX_DISCOVERIES)
+  {
+    if (!start_discovery (app))
+      return FALSE;
+    g_object_ref (app);
+    return TRUE;
+  }
+
+  if (!queued_discoveries)
+    queued_discoveries = g_queue_new ();
+  g_queue_push_tail (queued_discoveries, g_object_ref (app));
+  return TRUE;
+}
+
+static void
+discovery_done (AtspiApplication *app)
+{
+  g_object_unref (app);
+  n_discoveries--;
+  start_queued_discoveries ();
+  if (n_discoveries == 0 && discovery_callback)
+    discovery_callback (discovery_data);
+}
+
+static gboolean
+parse_items_callback (gpointer data)
+{
+  gint64 deadline = g_get_monotonic_time () + DISCOVERY_BUDGET_US;
+  ItemsParse *parse;
+
+  while ((parse = g_queue_peek_head (items_parses)))
+  {
+    /* A disposed application has lost its connection */
+    while (parse->app->bus &&
+           dbus_message_iter_get_arg_type (&parse->iter) != DBUS_TYPE_INVALID)
+    {
+      add_accessible_from_iter (&parse->iter);
+      dbus_message_iter_next (&parse->iter);
+      if (g_get_monotonic_time () > deadline)
+        return G_SOURCE_CONTINUE;
+    }
+    g_queue_pop_head (items_parses);
+    dbus_message_unref (parse->reply);
+    release_held_messages (parse->held);
+    discovery_done (parse->app);
+    g_free (parse);
+  }
+
+  items_parse_source = NULL;
+  return G_SOURCE_REMOVE;
+}
+
+static void
+queue_items_parse (AtspiApplication *app, DBusMessage *reply)
+{
+  ItemsParse *parse = g_new (ItemsParse, 1);
+  DBusMessageIter iter;
+
+  parse->app = app;
+  parse->reply = reply;
+  parse->held = g_queue_new ();
+  dbus_message_iter_init (reply, &iter);
+  dbus_message_iter_recurse (&iter, &parse->iter);
+
+  if (!items_parses)
+    items_parses = g_queue_new ();
+  g_queue_push_tail (items_parses, parse);
+
+  if (!items_parse_source)
+  {
+    items_parse_source = g_idle_source_new ();
+    g_source_set_callback (items_parse_source, parse_items_callback, NULL, NULL);
+    g_source_attach (items_parse_source, atspi_main_context);
+    g_source_unref (items_parse_source);
+  }
+}
+
+/**
+ * atspi_set_discovery_callback:
+ * @callback: (scope notified) (allow-none): the function to call when
+ *            discovery completes, or %NULL.
+ * @user_data: (closure): data to pass to @callback.
+ * @destroy: (destroy user_data): function to free @user_data when it is
+ *           no longer needed.
+ *
+ * Arranges for @callback to be called each time every application seen
+ * so far has been discovered, that is, once the contents of its cache
+ * have been fetched and stored. The first call after the desktop has
+ * been enumerated thus signals that the initial cache is complete.
+ **/
+void
+atspi_set_discovery_callback (AtspiDiscoveryCallback callback,
+                              gpointer user_data, GDestroyNotify destroy)
+{
+  if (discovery_data_destroy)
+    discovery_data_destroy (discovery_data);
+  discovery_callback = callback;
+  discovery_data = user_data;
+  discovery_data_destroy = destroy;
+}
+
+/**
+ * atspi_is_discovery_complete:
+ *
+ * Indicates whether every application seen so far has been discovered;
+ * see atspi_set_discovery_callback().
+ *
+ * Returns: #TRUE if no discovery is pending.
+ **/
+gboolean
+atspi_is_discovery_complete (void)
+{
+  return (n_discoveries == 0 &&
+          (!queued_discoveries || g_queue_is_empty (queued_discoveries)));
+}
+
 static void
 handle_get_bus_address (DBusPendingCall *pending, void *user_data)
 {
@@ -212,7 +412,11 @@ handle_get_bus_address (DBusPendingCall *pending, void *user_data)
   dbus_pending_call_unref (pending);
 
   if (!app->bus)
-    return; /* application has gone away / been disposed */
+  {
+    /* application has gone away / been disposed */
+    discovery_done (app);
+    return;
+  }
 
   message = dbus_message_new_method_call (app->bus_name,
                                           "/org/a11y/atspi/cache",
@@ -221,17 +425,291 @@ handle_get_bus_address (DBusPendingCall *pending, void *user_data)
   dbus_connection_send_with_reply (app->bus, message, &new_pending, 2000);
   dbus_message_unref (message);
   if (!new_pending)
+  {
+    discovery_done (app);
     return;
+  }
   dbus_pending_call_set_notify (new_pending, handle_get_items, app, NULL);
 }
 
+/*
+ * Calls whose reply is collected later carry the message they were made
+ * for and the time it was sent, so that they are traced and counted like
+ * blocking calls once the reply arrives.
+ */
+typedef struct
+{
+  DBusMessage *message;
+  gint64 start_time;
+} PendingCallInfo;
+
+static dbus_int32_t pending_call_slot = -1;
+
+static void
+pending_call_info_free (void *data)
+{
+  PendingCallInfo *info = data;
+
+  dbus_message_unref (info->message);
+  g_free (info);
+}
+
+static void
+track_pending_call (DBusPendingCall *pending, DBusMessage *message,
+                    gint64 start_time)
+{
+  PendingCallInfo *info;
+
+  if (!pending ||
+      (pending_call_slot < 0 &&
+       !dbus_pending_call_allocate_data_slot (&pending_call_slot)))
+    return;
+
+  info = g_new (PendingCallInfo, 1);
+  info->message = dbus_message_ref (message);
+  info->start_time = start_time;
+  if (!dbus_pending_call_set_data (pending, pending_call_slot, info,
+                                   pending_call_info_free))
+    pending_call_info_free (info);
+}
+
+static void
+pending_call_completed (DBusPendingCall *pending, DBusMessage *reply)
+{
+  PendingCallInfo *info;
+
+  if (pending_call_slot < 0)
+    return;
+
+  info = dbus_pending_call_get_data (pending, pending_call_slot);
+  if (info)
+    call_completed (info->message, reply, info->start_time,
+                    g_get_monotonic_time () - info->start_time, FALSE);
+}
+
+static void
+handle_get_application_properties (DBusPendingCall *pending, void *user_data)
+{
+  AtspiApplication *app = user_data;
+  DBusMessage *reply = dbus_pending_call_steal_reply (pending);
+  DBusMessageIter iter, iter_dict, iter_entry, iter_variant;
+
+  /* Also covers _atspi_application_wait_for_properties, which blocks
+   * until this has run */
+  pending_call_completed (pending, reply);
+
+  dbus_pending_call_unref (app->metadata_pending);
+  app->metadata_pending = NULL;
+
+  if (!reply)
+    return;
+  if (dbus_message_get_type (reply) == DBUS_MESSAGE_TYPE_ERROR)
+  {
+    DBusError err;
+
+    dbus_error_init (&err);
+    dbus_set_error_from_message (&err, reply);
+    check_for_hang (NULL, &err, app->bus, app->bus_name);
+    dbus_error_free (&err);
+    dbus_message_unref (reply);
+    return;
+  }
+  if (strcmp (dbus_message_get_signature (reply), "a{sv}") != 0)
+  {
+    dbus_message_unref (reply);
+    return;
+  }
+
+  dbus_message_iter_init (reply, &iter);
+  dbus_message_iter_recurse (&iter, &iter_dict);
+  while (dbus_message_iter_get_arg_type (&iter_dict) != DBUS_TYPE_INVALID)
+  {
+    const char *key, *value;
+    gchar **field = NULL;
+
+    dbus_message_iter_recurse (&iter_dict, &iter_entry);
+    dbus_message_iter_get_basic (&iter_entry, &key);
+    dbus_message_iter_next (&iter_entry);
+    dbus_message_iter_recurse (&iter_entry, &iter_variant);
+
+    if (!strcmp (key, "ToolkitName"))
+      field = &app->toolkit_name;
+    else if (!strcmp (key, "Version"))
+      field = &app->toolkit_version;
+    else if (!strcmp (key, "AtspiVersion"))
+      field = &app->atspi_version;
+    else if (!strcmp (key, "Id") &&
+             dbus_message_iter_get_arg_type (&iter_variant) == DBUS_TYPE_INT32)
+    {
+      dbus_int32_t id;
+      dbus_message_iter_get_basic (&iter_variant, &id);
+      /* The registry assigns the id, so it may not be known yet */
+      if (id > 0)
+        app->id = id;
+    }
+
+    if (field && !*field &&
+        dbus_message_iter_get_arg_type (&iter_variant) == DBUS_TYPE_STRING)
+    {
+      dbus_message_iter_get_basic (&iter_variant, &value);
+      *field = g_strdup (value);
+    }
+    dbus_message_iter_next (&iter_dict);
+  }
+  dbus_message_unref (reply);
+}
+
+/*
+ * Fetches the immutable properties of the application in one GetAll,
+ * so that toolkit and version lookups do not each cost a round trip.
+ */
+static void
+get_application_properties (AtspiApplication *app)
+{
+  DBusMessage *message;
+  const char *interface = atspi_interface_application;
+  gint64 start_time;
+
+  message = dbus_message_new_method_call (app->bus_name, atspi_path_root,
+                                          "org.freedesktop.DBus.Properties",
+                                          "GetAll");
+  if (!message)
+    return;
+  dbus_message_append_args (message, DBUS_TYPE_STRING, &interface,
+                            DBUS_TYPE_INVALID);
+  start_time = g_get_monotonic_time ();
+  dbus_connection_send_with_reply (app->bus, message, &app->metadata_pending,
+                                   get_timeout (app));
+  track_pending_call (app->metadata_pending, message, start_time);
+  dbus_message_unref (message);
+  if (app->metadata_pending)
+    dbus_pending_call_set_notify (app->metadata_pending,
+                                  handle_get_application_properties, app,
+                                  NULL);
+}
+
+/*
+ * Waits for the reply to the GetAll sent when @app was first seen, if it
+ * has not arrived yet. Returns FALSE if the application is gone or hung,
+ * or if it would have to block while synchronous calls are not allowed.
+ * A GetAll sent to ourselves is dropped instead, since nothing would
+ * answer it while we block; the callers then fall back to a Get, which
+ * dispatches while it waits.
+ */
+gboolean
+_atspi_application_wait_for_properties (AtspiApplication *app, GError **error)
+{
+  const char *unique_name;
+
+  if (!app->metadata_pending)
+    return TRUE;
+
+  if (!check_app (app, error))
+    return FALSE;
+
+  if (!allow_sync)
+  {
+    _atspi_set_error_no_sync (error);
+    return FALSE;
+  }
+
+  unique_name = dbus_bus_get_unique_name (app->bus);
+  if (!unique_name || !strcmp (unique_name, app->bus_name))
+  {
+    dbus_pending_call_cancel (app->metadata_pending);
+    dbus_pending_call_unref (app->metadata_pending);
+    app->metadata_pending = NULL;
+    return TRUE;
+  }
+
+  /* Runs handle_get_application_properties, which checks for a hang */
+  dbus_pending_call_block (app->metadata_pending);
+  return TRUE;
+}
+
+#define ACCESSIBLE_PATH_PREFIX "/org/a11y/atspi/accessible/"
+#define ACCESSIBLE_PATH_PREFIX_LEN (sizeof (ACCESSIBLE_PATH_PREFIX) - 1)
+
+/*
+ * Toolkits name almost all of their objects with a fixed prefix followed by
+ * a number. Such paths are decoded to an integer id, so that objects can be
+ * looked up without hashing or copying the path string. Only the canonical
+ * decimal form is accepted, so that every id maps to exactly one path.
+ */
+static gboolean
+path_to_id (const char *path, guint *id)
+{
+  const char *p;
+  guint64 val = 0;
+
+  if (strncmp (path, ACCESSIBLE_PATH_PREFIX, ACCESSIBLE_PATH_PREFIX_LEN) != 0)
+    return FALSE;
+
+  p = path + ACCESSIBLE_PATH_PREFIX_LEN;
+  if (*p < '0' || *p > '9' || (p[0] == '0' && p[1] != '\0'))
+    return FALSE;
+
+  for (; *p; p++)
+  {
+    if (*p < '0' || *p > '9')
+      return FALSE;
+    val = val * 10 + (*p - '0');
+    if (val > G_MAXUINT)
+      return FALSE;
+  }
+
+  *id = (guint) val;
+  return TRUE;
+}
+
+static gpointer
+lookup_object (AtspiApplication *app, const char *path)
+{
+  guint id;
+
+  if (path_to_id (path, &id))
+    return (app->id_hash ?
+            g_hash_table_lookup (app->id_hash, GUINT_TO_POINTER (id)) : NULL);
+  return g_hash_table_lookup (app->hash, path);
+}
+
+/* Takes over the reference to @obj held by the caller */
+static void
+insert_object (AtspiApplication *app, gpointer object)
+{
+  AtspiObject *obj = object;
+  guint id;
+
+  if (path_to_id (obj->path, &id))
+  {
+    if (!app->id_hash)
+      app->id_hash = g_hash_table_new_full (g_direct_hash, g_direct_equal,
+                                            NULL, g_object_unref);
+    g_hash_table_replace (app->id_hash, GUINT_TO_POINTER (id), obj);
+  }
+  else
+    g_hash_table_replace (app->hash, obj->path, obj);
+}
+
+static void
+remove_object (AtspiApplication *app, const char *path)
+{
+  guint id;
+
+  if (path_to_id (path, &id))
+  {
+    if (app->id_hash)
+      g_hash_table_remove (app->id_hash, GUINT_TO_POINTER (id));
+  }
+  else
+    g_hash_table_remove (app->hash, path);
+}
+
 static AtspiApplication *
 get_application (const char *bus_name)
 {
   AtspiApplication *app = NULL;
   char *bus_name_dup;
-  DBusMessage *message;
-  DBusPendingCall *pending = NULL;
 
   if (!app_hash)
   {
@@ -244,22 +722,19 @@ get_application (const char *bus_name)
   if (!bus_name_dup) return NULL;
   // TODO: change below to something that will send state-change:defunct notification if necessary */
   app = _atspi_application_new (bus_name);
-  app->hash = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_object_unref);
+  /* Keys are the objects' own path strings, so they need no copy */
+  app->hash = g_hash_table_new_full (g_str_hash, g_str_equal, NULL, g_object_unref);
   app->bus = dbus_connection_ref (_atspi_bus ());
   gettimeofday (&app->time_added, NULL);
   app->cache = ATSPI_CACHE_UNDEFINED;
   g_hash_table_insert (app_hash, bus_name_dup, app);
-  message = dbus_message_new_method_call (bus_name, atspi_path_root,
-                                          atspi_interface_application, "GetApplicationBusAddress");
-
-  dbus_connection_send_with_reply (app->bus, message, &pending, 2000);
-  dbus_message_unref (message);
-  if (!pending)
+  if (!schedule_discovery (app))
   {
     g_hash_table_remove (app_hash, bus_name_dup);
     return NULL;
   }
-  dbus_pending_call_set_notify (pending, handle_get_bus_address, app, NULL);
+  if (!APP_IS_REGISTRY (app))
+    get_application_properties (app);
   return app;
 }
 
@@ -280,12 +755,15 @@ ref_accessible (const char *app_name, const char *path)
     {
       app->root = _atspi_accessible_new (app, atspi_path_root);
       app->root->accessible_parent = atspi_get_desktop (0);
-      g_ptr_array_add (app->root->accessible_parent->children, g_object_ref (app->root));
+      /* There is no desktop to attach to when no registry is running */
+      if (app->root->accessible_parent)
+        g_ptr_array_add (_atspi_accessible_ensure_children (app->root->accessible_parent),
+                         g_object_ref (app->root));
     }
     return g_object_ref (app->root);
   }
 
-  a = g_hash_table_lookup (app->hash, path);
+  a = lookup_object (app, path);
   if (a)
   {
     return g_object_ref (a);
@@ -293,7 +771,7 @@ ref_accessible (const char *app_name, const char *path)
   a = _atspi_accessible_new (app, path);
   if (!a)
     return NULL;
-  g_hash_table_insert (app->hash, g_strdup (a->parent.path), g_object_ref (a));
+  insert_object (app, g_object_ref (a));
   return a;
 }
 
@@ -306,15 +784,14 @@ ref_hyperlink (const char *app_name, const char *path)
   if (!strcmp (path, ATSPI_DBUS_PATH_NULL))
     return NULL;
 
-  hyperlink = g_hash_table_lookup (app->hash, path);
+  hyperlink = lookup_object (app, path);
   if (hyperlink)
   {
     return g_object_ref (hyperlink);
   }
   hyperlink = _atspi_hyperlink_new (app, path);
-  g_hash_table_insert (app->hash, g_strdup (hyperlink->parent.path), hyperlink);
   /* TODO: This should be a weak ref */
-  g_object_ref (hyperlink);	/* for the hash */
+  insert_object (app, g_object_ref (hyperlink));
   return hyperlink;
 }
 
@@ -356,7 +833,7 @@ handle_remove_accessible (DBusConnection *bus, DBusMessage *message, void *user_
   if (!a)
     return DBUS_HANDLER_RESULT_HANDLED;
   g_object_run_dispose (G_OBJECT (a));
-  g_hash_table_remove (app->hash, a->parent.path);
+  remove_object (app, a->parent.path);
   g_object_unref (a);	/* unref our own ref */
   return DBUS_HANDLER_RESULT_HANDLED;
 }
@@ -387,11 +864,16 @@ handle_name_owner_changed (DBusConnection *bus, DBusMessage *message, void *user
     else if (!new[0])
       registry_lost = TRUE;
   }
-  else if (app_hash)
+  else
   {
-    AtspiApplication *app = g_hash_table_lookup (app_hash, old);
-    if (app && !strcmp (app->bus_name, old))
-      g_object_run_dispose (G_OBJECT (app));
+    if (app_hash)
+    {
+      AtspiApplication *app = g_hash_table_lookup (app_hash, old);
+      if (app && !strcmp (app->bus_name, old))
+        g_object_run_dispose (G_OBJECT (app));
+    }
+    if (!new[0])
+      _atspi_forget_application_statistics (name);
   }
   return DBUS_HANDLER_RESULT_HANDLED;
 }
@@ -452,19 +934,21 @@ add_accessible_from_iter (DBusMessageIter *iter)
     dbus_message_iter_get_basic (&iter_struct, &index);
     if (index >= 0 && accessible->accessible_parent)
     {
-      if (index >= accessible->accessible_parent->children->len)
-        g_ptr_array_set_size (accessible->accessible_parent->children, index + 1);
-      g_ptr_array_index (accessible->accessible_parent->children, index) = g_object_ref (accessible);
+      GPtrArray *siblings = _atspi_accessible_ensure_children (accessible->accessible_parent);
+      if (index >= siblings->len)
+        g_ptr_array_set_size (siblings, index + 1);
+      g_ptr_array_index (siblings, index) = g_object_ref (accessible);
     }
 
     /* get child count */
     dbus_message_iter_next (&iter_struct);
     dbus_message_iter_get_basic (&iter_struct, &count);
+    if (count > 0)
+      g_ptr_array_set_size (_atspi_accessible_ensure_children (accessible), count);
+    else if (count == 0 && accessible->children)
+      g_ptr_array_set_size (accessible->children, 0);
     if (count >= 0)
-    {
-      g_ptr_array_set_size (accessible->children, count);
       children_cached = TRUE;
-    }
   }
   else if (dbus_message_iter_get_arg_type (&iter_struct) == 'a')
   {
@@ -476,7 +960,7 @@ add_accessible_from_iter (DBusMessageIter *iter)
       AtspiAccessible *child;
       get_reference_from_iter (&iter_array, &app_name, &path);
       child = ref_accessible (app_name, path);
-      g_ptr_array_remove (accessible->children, child);
+      g_ptr_array_remove (_atspi_accessible_ensure_children (accessible), child);
       g_ptr_array_add (accessible->children, child);
     }
     children_cached = TRUE;
@@ -511,9 +995,9 @@ add_accessible_from_iter (DBusMessageIter *iter)
 
   _atspi_accessible_add_cache (accessible, ATSPI_CACHE_NAME | ATSPI_CACHE_ROLE |
                                ATSPI_CACHE_PARENT | ATSPI_CACHE_DESCRIPTION);
-  if (!atspi_state_set_contains (accessible->states,
-                                       ATSPI_STATE_MANAGES_DESCENDANTS) &&
-                                       children_cached)
+  if (!_atspi_accessible_has_state (accessible,
+                                    ATSPI_STATE_MANAGES_DESCENDANTS) &&
+                                    children_cached)
     _atspi_accessible_add_cache (accessible, ATSPI_CACHE_CHILDREN);
 
   /* This is a bit of a hack since the cache holds a ref, so we don't need
@@ -524,8 +1008,10 @@ add_accessible_from_iter (DBusMessageIter *iter)
 static void
 handle_get_items (DBusPendingCall *pending, void *user_data)
 {
+  AtspiApplication *app = user_data;
   DBusMessage *reply = dbus_pending_call_steal_reply (pending);
-  DBusMessageIter iter, iter_array;
+
+  dbus_pending_call_unref (pending);
 
   if (dbus_message_get_type (reply) == DBUS_MESSAGE_TYPE_ERROR)
   {
@@ -542,19 +1028,11 @@ handle_get_items (DBusPendingCall *pending, void *user_data)
       g_warning ("AT-SPI: Error in GetItems, sender=%s, error=%s", sender, error);
     }
     dbus_message_unref (reply);
-    dbus_pending_call_unref (pending);
+    discovery_done (app);
     return;
   }
 
-  dbus_message_iter_init (reply, &iter);
-  dbus_message_iter_recurse (&iter, &iter_array);
-  while (dbus_message_iter_get_arg_type (&iter_array) != DBUS_TYPE_INVALID)
-  {
-    add_accessible_from_iter (&iter_array);
-    dbus_message_iter_next (&iter_array);
-  }
-  dbus_message_unref (reply);
-  dbus_pending_call_unref (pending);
+  queue_items_parse (app, reply);
 }
 
 /* TODO: Do we stil need this function? */
@@ -576,8 +1054,7 @@ ref_accessible_desktop (AtspiApplication *app)
   {
     return NULL;
   }
-  g_hash_table_insert (app->hash, g_strdup (desktop->parent.path),
-                       g_object_ref (desktop));
+  insert_object (app, g_object_ref (desktop));
   app->root = g_object_ref (desktop);
   desktop->name = g_strdup ("main");
   message = dbus_message_new_method_call (atspi_bus_registry,
@@ -729,18 +1206,33 @@ typedef struct
 
 static GSource *process_deferred_messages_source = NULL;
 
+static gboolean process_deferred_messages_callback (gpointer data);
+
 static void
-process_deferred_message (BusDataClosure *closure)
+schedule_deferred_messages (void)
 {
-  int type = dbus_message_get_type (closure->message);
-  const char *interface = dbus_message_get_interface (closure->message);
-
-  if (type == DBUS_MESSAGE_TYPE_SIGNAL &&
-      !strncmp (interface, "org.a11y.atspi.Event.", 21))
+  if (process_deferred_messages_source == NULL)
   {
-    _atspi_dbus_handle_event (closure->bus, closure->message, closure->data);
-  }
-  if (dbus_message_is_method_call (closure->message, atspi_interface_device_event_listener, "NotifyEvent"))
+    process_deferred_messages_source = g_idle_source_new ();
+    g_source_set_callback (process_deferred_messages_source,
+                           process_deferred_messages_callback, NULL, NULL);
+    g_source_attach (process_deferred_messages_source, atspi_main_context);
+    g_source_unref (process_deferred_messages_source);
+  }
+}
+
+static void
+process_deferred_message (BusDataClosure *closure)
+{
+  int type = dbus_message_get_type (closure->message);
+  const char *interface = dbus_message_get_interface (closure->message);
+
+  if (type == DBUS_MESSAGE_TYPE_SIGNAL &&
+      !strncmp (interface, "org.a11y.atspi.Event.", 21))
+  {
+    _atspi_dbus_handle_event (closure->bus, closure->message, closure->data);
+  }
+  if (dbus_message_is_method_call (closure->message, atspi_interface_device_event_listener, "NotifyEvent"))
   {
     _atspi_dbus_handle_DeviceEvent (closure->bus,
                                    closure->message, closure->data);
@@ -761,6 +1253,83 @@ process_deferred_message (BusDataClosure *closure)
 
 static GQueue *deferred_messages = NULL;
 
+/* Maps each sender with messages in deferred_messages to the link of the
+ * last of them */
+static GHashTable *deferred_tails = NULL;
+
+/* Focus changes are what a screen reader speaks first, so they are kept
+ * apart from bulk traffic such as children-changed and dispatched ahead
+ * of it. Messages from the same application never overtake each other,
+ * since an event may refer to objects added or removed before it. */
+static GQueue *focus_messages = NULL;
+
+static void
+push_deferred_message (BusDataClosure *closure)
+{
+  const char *sender = dbus_message_get_sender (closure->message);
+
+  g_queue_push_tail (deferred_messages, closure);
+  if (sender)
+    g_hash_table_replace (deferred_tails, (gpointer) sender,
+                          deferred_messages->tail);
+}
+
+static BusDataClosure *
+pop_deferred_message (void)
+{
+  GList *link = deferred_messages->head;
+  const char *sender;
+
+  if (!link)
+    return NULL;
+
+  sender = dbus_message_get_sender (((BusDataClosure *) link->data)->message);
+  if (sender && g_hash_table_lookup (deferred_tails, sender) == link)
+    g_hash_table_remove (deferred_tails, sender);
+  return g_queue_pop_head (deferred_messages);
+}
+
+/* Returns TRUE if @closure was set aside until a GetItems reply from its
+ * sender has been parsed */
+static gboolean
+hold_for_items_parse (BusDataClosure *closure)
+{
+  const char *sender = dbus_message_get_sender (closure->message);
+  GList *l;
+
+  if (!sender || !items_parses)
+    return FALSE;
+
+  for (l = items_parses->head; l; l = l->next)
+  {
+    ItemsParse *parse = l->data;
+    if (parse->app->bus_name && !strcmp (parse->app->bus_name, sender))
+    {
+      g_queue_push_tail (parse->held, closure);
+      return TRUE;
+    }
+  }
+  return FALSE;
+}
+
+/* Puts messages held back during a GetItems parse in front of the ones
+ * that arrived since, keeping their order. They go to the focus queue,
+ * which is processed first, so that no later message about the same
+ * object overtakes them. */
+static void
+release_held_messages (GQueue *held)
+{
+  BusDataClosure *closure;
+
+  if (!g_queue_is_empty (held))
+  {
+    while ((closure = g_queue_pop_tail (held)))
+      g_queue_push_head (focus_messages, closure);
+    schedule_deferred_messages ();
+  }
+  g_queue_free (held);
+}
+
 static gboolean
 process_deferred_messages (void)
 {
@@ -770,8 +1339,11 @@ process_deferred_messages (void)
   if (in_process_deferred_messages)
     return TRUE;
   in_process_deferred_messages = 1;
-  while ((closure = g_queue_pop_head (deferred_messages)))
+  while ((closure = g_queue_pop_head (focus_messages)) ||
+         (closure = pop_deferred_message ()))
   {
+    if (hold_for_items_parse (closure))
+      continue;
     process_deferred_message (closure);
     dbus_message_unref (closure->message);
     dbus_connection_unref (closure->bus);
@@ -791,25 +1363,623 @@ process_deferred_messages_callback (gpointer data)
   return G_SOURCE_REMOVE;
 }
 
+/*
+ * An event recording is a header followed by one record per deferred
+ * message: the arrival time in microseconds since recording started, the
+ * length of the marshalled message and the message itself, with the
+ * integers in host byte order.
+ */
+#define RECORDING_MAGIC "ATSPIREC"
+#define RECORDING_VERSION 1
+
+typedef struct
+{
+  gchar magic[8];
+  guint32 version;
+  guint32 byte_order;
+} RecordingHeader;
+
+typedef struct
+{
+  gint64 timestamp;
+  guint32 length;
+  guint32 reserved;
+} RecordHeader;
+
+static gint record_fd = -1;
+static gint64 record_start;
+
+static void
+record_message (DBusMessage *message)
+{
+  RecordHeader header;
+  char *data;
+  int len;
+  GError *error = NULL;
+
+  if (!dbus_message_marshal (message, &data, &len))
+    return;
+
+  memset (&header, 0, sizeof (header));
+  header.timestamp = g_get_monotonic_time () - record_start;
+  header.length = len;
+  if (!_atspi_write_all (record_fd, &header, sizeof (header), &error) ||
+      !_atspi_write_all (record_fd, data, len, &error))
+  {
+    g_warning ("AT-SPI: Stopping event recording: %s", error->message);
+    g_error_free (error);
+    record_fd = -1;
+  }
+  dbus_free (data);
+}
+
+/**
+ * atspi_start_recording:
+ * @fd: a file descriptor open for writing.
+ *
+ * Starts writing every event and cache signal received from the
+ * accessibility bus to @fd, together with its arrival time, so that the
+ * stream can later be fed back with atspi_replay(). The caller keeps
+ * ownership of @fd, which must stay open until atspi_stop_recording() is
+ * called. Recording stops by itself if a write fails.
+ *
+ * Returns: #TRUE if recording started, #FALSE on error.
+ **/
+gboolean
+atspi_start_recording (gint fd, GError **error)
+{
+  RecordingHeader header;
+
+  g_return_val_if_fail (fd >= 0, FALSE);
+
+  memset (&header, 0, sizeof (header));
+  memcpy (header.magic, RECORDING_MAGIC, sizeof (header.magic));
+  header.version = RECORDING_VERSION;
+  header.byte_order = 0x01020304;
+  if (!_atspi_write_all (fd, &header, sizeof (header), error))
+    return FALSE;
+
+  record_start = g_get_monotonic_time ();
+  record_fd = fd;
+  return TRUE;
+}
+
+/**
+ * atspi_stop_recording:
+ *
+ * Stops a recording started with atspi_start_recording(). The file
+ * descriptor is not closed.
+ **/
+void
+atspi_stop_recording (void)
+{
+  record_fd = -1;
+}
+
+static gboolean
+invalid_recording (GError **error, const gchar *reason)
+{
+  g_set_error (error, G_FILE_ERROR, G_FILE_ERROR_INVAL,
+               "Invalid event recording: %s", reason);
+  return FALSE;
+}
+
+/**
+ * atspi_replay:
+ * @fd: a file descriptor, open for reading, holding a recording made with
+ *      atspi_start_recording().
+ * @realtime: #TRUE to reproduce the original timing, #FALSE to replay
+ *            as fast as possible.
+ *
+ * Feeds a recorded message stream through the same code that handles
+ * messages from the bus, so that listeners are notified and the cache is
+ * updated exactly as during the recording. The recorded applications need
+ * not be running. Synchronous calls are disallowed while the stream is
+ * handled: any call that would need a round trip, made by the library or
+ * by a listener, fails at once rather than waiting for a recorded
+ * application to answer, or reaching whichever application now owns its
+ * bus name.
+ * Messages are processed synchronously, before this returns.
+ *
+ * Returns: #TRUE if the whole recording was replayed, #FALSE on error.
+ **/
+gboolean
+atspi_replay (gint fd, gboolean realtime, GError **error)
+{
+  GMappedFile *file;
+  const gchar *data;
+  gsize length, offset;
+  const RecordingHeader *header;
+  gint64 start;
+  gboolean ret = TRUE;
+  gboolean allow_sync_was;
+
+  g_return_val_if_fail (fd >= 0, FALSE);
+
+  file = g_mapped_file_new_from_fd (fd, FALSE, error);
+  if (!file)
+    return FALSE;
+  data = g_mapped_file_get_contents (file);
+  length = g_mapped_file_get_length (file);
+  header = (const RecordingHeader *) data;
+
+  if (!data || length < sizeof (RecordingHeader) ||
+      memcmp (header->magic, RECORDING_MAGIC, sizeof (header->magic)) != 0 ||
+      header->version != RECORDING_VERSION ||
+      header->byte_order != 0x01020304)
+  {
+    g_mapped_file_unref (file);
+    return invalid_recording (error, "bad header");
+  }
+
+  allow_sync_was = _atspi_set_allow_sync (FALSE);
+  start = g_get_monotonic_time ();
+  offset = sizeof (RecordingHeader);
+  while (offset < length)
+  {
+    RecordHeader record;
+    BusDataClosure closure;
+    DBusError derror;
+
+    if (length - offset < sizeof (RecordHeader))
+    {
+      ret = invalid_recording (error, "truncated");
+      break;
+    }
+    memcpy (&record, data + offset, sizeof (record));
+    offset += sizeof (RecordHeader);
+    if (length - offset < record.length)
+    {
+      ret = invalid_recording (error, "truncated");
+      break;
+    }
+
+    dbus_error_init (&derror);
+    closure.message = dbus_message_demarshal (data + offset, record.length,
+                                              &derror);
+    offset += record.length;
+    if (!closure.message)
+    {
+      ret = invalid_recording (error, derror.message);
+      dbus_error_free (&derror);
+      break;
+    }
+
+    if (realtime)
+    {
+      gint64 delay = start + record.timestamp - g_get_monotonic_time ();
+      if (delay > 0)
+        g_usleep (delay);
+    }
+
+    closure.bus = _atspi_bus ();
+    closure.data = NULL;
+    process_deferred_message (&closure);
+    dbus_message_unref (closure.message);
+  }
+
+  _atspi_set_allow_sync (allow_sync_was);
+  g_mapped_file_unref (file);
+  return ret;
+}
+
+static AtspiIpcTraceFunc trace_func;
+static gpointer trace_data;
+static GDestroyNotify trace_data_destroy;
+static gint trace_fd = -1;
+static gboolean trace_first_event;
+
+static gsize
+message_size (DBusMessage *message)
+{
+  char *data;
+  int len;
+
+  if (!message || !dbus_message_marshal (message, &data, &len))
+    return 0;
+  dbus_free (data);
+  return len;
+}
+
+/*
+ * Writes @trace as a complete ("X") event of the Trace Event Format, which
+ * chrome://tracing and Perfetto display as a timeline. Bus names, object
+ * paths and member names never need escaping in JSON.
+ */
+static void
+write_trace_event (const AtspiIpcTrace *trace, const char *path)
+{
+  GError *error = NULL;
+  gchar *event;
+
+  event = g_strdup_printf ("%s{\"name\": \"%s.%s\", \"cat\": \"dbus\", "
+                           "\"ph\": \"X\", \"ts\": %" G_GINT64_FORMAT ", "
+                           "\"dur\": %" G_GINT64_FORMAT ", \"pid\": %d, "
+                           "\"tid\": %d, \"args\": {\"destination\": \"%s\", "
+                           "\"path\": \"%s\", \"bytes_sent\": %" G_GSIZE_FORMAT ", "
+                           "\"bytes_received\": %" G_GSIZE_FORMAT ", "
+                           "\"reentered\": %s}}",
+                           trace_first_event ? "" : ",\n",
+                           trace->interface, trace->method,
+                           trace->start_time, trace->duration,
+                           (gint) getpid (), (gint) getpid (),
+                           trace->destination, path ? path : "",
+                           trace->bytes_sent, trace->bytes_received,
+                           trace->reentered ? "true" : "false");
+  trace_first_event = FALSE;
+  if (!_atspi_write_all (trace_fd, event, strlen (event), &error))
+  {
+    g_warning ("AT-SPI: Stopping IPC tracing: %s", error->message);
+    g_error_free (error);
+    trace_fd = -1;
+  }
+  g_free (event);
+}
+
+/*
+ * Latency statistics, kept for every call whether or not tracing is on.
+ * Histogram buckets are fixed so that updating one is a few comparisons.
+ */
+static const gint64 bucket_limits[ATSPI_IPC_HISTOGRAM_N_BUCKETS - 1] =
+{
+  50, 100, 250, 500, 1000, 2500, 5000, 10000, 25000, 50000, 100000,
+  250000, 500000, 1000000, 5000000
+};
+
+/* Keyed by "interface.method" and by bus name, respectively */
+static GHashTable *method_statistics;
+static GHashTable *application_statistics;
+
+/**
+ * atspi_ipc_statistics_copy:
+ * @src: the #AtspiIpcStatistics to copy.
+ *
+ * Returns: (transfer full): a copy of @src.
+ **/
+AtspiIpcStatistics *
+atspi_ipc_statistics_copy (AtspiIpcStatistics *src)
+{
+  AtspiIpcStatistics *dst = g_new (AtspiIpcStatistics, 1);
+
+  *dst = *src;
+  dst->interface = g_strdup (src->interface);
+  dst->method = g_strdup (src->method);
+  dst->application = g_strdup (src->application);
+  return dst;
+}
+
+/**
+ * atspi_ipc_statistics_free:
+ * @stats: the #AtspiIpcStatistics to free.
+ **/
+void
+atspi_ipc_statistics_free (AtspiIpcStatistics *stats)
+{
+  g_free (stats->interface);
+  g_free (stats->method);
+  g_free (stats->application);
+  g_free (stats);
+}
+
+G_DEFINE_BOXED_TYPE (AtspiIpcStatistics, atspi_ipc_statistics,
+                     atspi_ipc_statistics_copy, atspi_ipc_statistics_free)
+
+/**
+ * atspi_ipc_histogram_get_bucket_limit:
+ * @bucket: the index of a histogram bucket, less than
+ *          #ATSPI_IPC_HISTOGRAM_N_BUCKETS.
+ *
+ * Gets the upper bound of the latencies counted in a bucket of the
+ * histograms returned by atspi_get_ipc_statistics(). A bucket counts the
+ * calls that took at least the limit of the previous bucket and less
+ * than its own limit.
+ *
+ * Returns: the limit in microseconds, or %G_MAXINT64 for the last bucket.
+ **/
+gint64
+atspi_ipc_histogram_get_bucket_limit (guint bucket)
+{
+  g_return_val_if_fail (bucket < ATSPI_IPC_HISTOGRAM_N_BUCKETS, G_MAXINT64);
+
+  return (bucket < G_N_ELEMENTS (bucket_limits) ?
+          bucket_limits[bucket] : G_MAXINT64);
+}
+
+static void
+update_statistics (GHashTable **table, const gchar *key,
+                   const gchar *interface, const gchar *method,
+                   const gchar *application, gint64 duration)
+{
+  AtspiIpcStatistics *stats;
+  guint bucket = 0;
+
+  if (!*table)
+    *table = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+                                    (GDestroyNotify) atspi_ipc_statistics_free);
+
+  stats = g_hash_table_lookup (*table, key);
+  if (!stats)
+  {
+    stats = g_new0 (AtspiIpcStatistics, 1);
+    stats->interface = g_strdup (interface);
+    stats->method = g_strdup (method);
+    stats->application = g_strdup (application);
+    g_hash_table_insert (*table, g_strdup (key), stats);
+  }
+
+  while (bucket < G_N_ELEMENTS (bucket_limits) &&
+         duration >= bucket_limits[bucket])
+    bucket++;
+  stats->buckets[bucket]++;
+  stats->count++;
+  stats->total_time += duration;
+  if (duration > stats->max_time)
+    stats->max_time = duration;
+}
+
+static void
+append_statistics (GHashTable *table, GArray *array)
+{
+  GHashTableIter iter;
+  AtspiIpcStatistics *stats, copy;
+
+  if (!table)
+    return;
+
+  g_hash_table_iter_init (&iter, table);
+  while (g_hash_table_iter_next (&iter, NULL, (gpointer *) &stats))
+  {
+    copy = *stats;
+    copy.interface = g_strdup (stats->interface);
+    copy.method = g_strdup (stats->method);
+    copy.application = g_strdup (stats->application);
+    g_array_append_val (array, copy);
+  }
+}
+
+static void
+clear_statistics (gpointer data)
+{
+  AtspiIpcStatistics *stats = data;
+
+  g_free (stats->interface);
+  g_free (stats->method);
+  g_free (stats->application);
+}
+
+static gint
+compare_total_time (gconstpointer a, gconstpointer b)
+{
+  gint64 x = ((const AtspiIpcStatistics *) a)->total_time;
+  gint64 y = ((const AtspiIpcStatistics *) b)->total_time;
+
+  return (y > x) - (y < x);
+}
+
+/**
+ * atspi_get_ipc_statistics:
+ *
+ * Gets latency statistics for the D-Bus calls whose reply the library
+ * waited for, including batched and asynchronous ones, since it was
+ * initialized or since the last call to atspi_reset_ipc_statistics().
+ * There is one entry per D-Bus method, whose application member is %NULL,
+ * and one entry per application still on the bus, whose interface and
+ * method members are %NULL. Entries are sorted by
+ * decreasing total time, so that the slowest methods and applications
+ * come first.
+ *
+ * Returns: (element-type AtspiIpcStatistics) (transfer full): the
+ *          statistics.
+ **/
+GArray *
+atspi_get_ipc_statistics (void)
+{
+  GArray *array = g_array_new (FALSE, FALSE, sizeof (AtspiIpcStatistics));
+
+  g_array_set_clear_func (array, clear_statistics);
+  append_statistics (method_statistics, array);
+  append_statistics (application_statistics, array);
+  g_array_sort (array, compare_total_time);
+  return array;
+}
+
+/**
+ * atspi_reset_ipc_statistics:
+ *
+ * Discards the statistics returned by atspi_get_ipc_statistics().
+ **/
+void
+atspi_reset_ipc_statistics (void)
+{
+  g_clear_pointer (&method_statistics, g_hash_table_destroy);
+  g_clear_pointer (&application_statistics, g_hash_table_destroy);
+}
+
+/*
+ * Drops the per-application statistics for @bus_name once it has left the
+ * bus, so that they do not pile up as applications come and go.
+ */
+void
+_atspi_forget_application_statistics (const gchar *bus_name)
+{
+  if (application_statistics && bus_name)
+    g_hash_table_remove (application_statistics, bus_name);
+}
+
+static void
+call_completed (DBusMessage *message, DBusMessage *reply,
+                dbus_int64_t start_time, dbus_int64_t duration,
+                dbus_bool_t reentered)
+{
+  AtspiIpcTrace trace;
+  const char *interface = dbus_message_get_interface (message);
+  const char *method = dbus_message_get_member (message);
+  const char *destination = dbus_message_get_destination (message);
+  gchar key[512];
+
+  if (!interface || !method || !destination)
+    return;
+
+  /* Interface and member names are limited to 255 bytes by D-Bus */
+  g_snprintf (key, sizeof (key), "%s.%s", interface, method);
+  update_statistics (&method_statistics, key, interface, method, NULL,
+                     duration);
+  update_statistics (&application_statistics, destination, NULL, NULL,
+                     destination, duration);
+
+  if (!trace_func && trace_fd < 0)
+    return;
+
+  trace.interface = interface;
+  trace.method = method;
+  trace.destination = destination;
+  trace.bytes_sent = message_size (message);
+  trace.bytes_received = message_size (reply);
+  trace.start_time = start_time;
+  trace.duration = duration;
+  trace.reentered = reentered;
+
+  if (trace_func)
+    trace_func (&trace, trace_data);
+  if (trace_fd >= 0)
+    write_trace_event (&trace, dbus_message_get_path (message));
+}
+
+/**
+ * atspi_set_ipc_trace_func:
+ * @func: (scope notified) (allow-none): the function to call after each
+ *        D-Bus call, or %NULL to stop tracing.
+ * @user_data: (closure): data to pass to @func.
+ * @destroy: (destroy user_data): function to free @user_data when it is
+ *           no longer needed.
+ *
+ * Arranges for @func to be called after every D-Bus call whose reply the
+ * library waits for, with the name of the method, the destination, the
+ * size of the messages, how long the call took and whether other messages
+ * were dispatched while waiting for the reply. Calls sent in a batch or
+ * answered asynchronously are reported when their reply is collected, so
+ * their durations may overlap. Message sizes are only computed while a
+ * trace function or a trace file is set.
+ **/
+void
+atspi_set_ipc_trace_func (AtspiIpcTraceFunc func, gpointer user_data,
+                          GDestroyNotify destroy)
+{
+  if (trace_data_destroy)
+    trace_data_destroy (trace_data);
+  trace_func = func;
+  trace_data = user_data;
+  trace_data_destroy = destroy;
+}
+
+/**
+ * atspi_start_ipc_trace:
+ * @fd: a file descriptor open for writing.
+ *
+ * Starts writing a record of every synchronous D-Bus call made by the
+ * library to @fd, in the JSON Trace Event Format understood by timeline
+ * viewers such as chrome://tracing and Perfetto. The caller keeps
+ * ownership of @fd, which must stay open until atspi_stop_ipc_trace() is
+ * called. Tracing stops by itself if a write fails.
+ *
+ * Returns: #TRUE if tracing started, #FALSE on error.
+ **/
+gboolean
+atspi_start_ipc_trace (gint fd, GError **error)
+{
+  g_return_val_if_fail (fd >= 0, FALSE);
+
+  if (!_atspi_write_all (fd, "[\n", 2, error))
+    return FALSE;
+
+  trace_fd = fd;
+  trace_first_event = TRUE;
+  return TRUE;
+}
+
+/**
+ * atspi_stop_ipc_trace:
+ *
+ * Stops a trace started with atspi_start_ipc_trace() and terminates the
+ * JSON array. The file descriptor is not closed.
+ **/
+void
+atspi_stop_ipc_trace (void)
+{
+  if (trace_fd < 0)
+    return;
+
+  _atspi_write_all (trace_fd, "\n]\n", 3, NULL);
+  trace_fd = -1;
+}
+
+static gboolean
+is_focus_message (DBusMessage *message)
+{
+  DBusMessageIter iter;
+  const char *detail;
+
+  if (dbus_message_is_signal (message, "org.a11y.atspi.Event.Focus", "Focus") ||
+      dbus_message_is_signal (message, "org.a11y.atspi.Event.Object",
+                              "ActiveDescendantChanged"))
+    return TRUE;
+
+  if (!dbus_message_is_signal (message, "org.a11y.atspi.Event.Object",
+                               "StateChanged") ||
+      strcmp (dbus_message_get_signature (message), "siiva{sv}") != 0)
+    return FALSE;
+
+  /* Losing focus or activation matters as much as gaining it */
+  dbus_message_iter_init (message, &iter);
+  dbus_message_iter_get_basic (&iter, &detail);
+  return (!strcmp (detail, "focused") || !strcmp (detail, "active"));
+}
+
+/* Moves the deferred messages up to the last one from the sender of
+ * @message to the focus queue, in order, so that @message does not
+ * overtake any of them. Those from other senders in between come along,
+ * which keeps the order between applications too. */
+static void
+promote_sender (DBusMessage *message)
+{
+  const char *sender = dbus_message_get_sender (message);
+  GList *tail;
+  gboolean last;
+
+  if (!sender || !(tail = g_hash_table_lookup (deferred_tails, sender)))
+    return;
+
+  do
+  {
+    last = (deferred_messages->head == tail);
+    g_queue_push_tail (focus_messages, pop_deferred_message ());
+  }
+  while (!last);
+}
+
 static DBusHandlerResult
 defer_message (DBusConnection *connection, DBusMessage *message, void *user_data)
 {
-  BusDataClosure *closure = g_new (BusDataClosure, 1);
+  BusDataClosure *closure;
+
+  if (record_fd >= 0)
+    record_message (message);
+
+  closure = g_new (BusDataClosure, 1);
 
   closure->bus = dbus_connection_ref (bus);
   closure->message = dbus_message_ref (message);
   closure->data = user_data;
 
-  g_queue_push_tail (deferred_messages, closure);
-
-  if (process_deferred_messages_source == NULL)
+  if (is_focus_message (message))
   {
-    process_deferred_messages_source = g_idle_source_new ();
-    g_source_set_callback (process_deferred_messages_source,
-                           process_deferred_messages_callback, NULL, NULL);
-    g_source_attach (process_deferred_messages_source, atspi_main_context);
-    g_source_unref (process_deferred_messages_source);
+    promote_sender (message);
+    g_queue_push_tail (focus_messages, closure);
   }
+  else
+    push_deferred_message (closure);
+
+  schedule_deferred_messages ();
 
   return DBUS_HANDLER_RESULT_HANDLED;
 }
@@ -935,6 +2105,10 @@ atspi_init (void)
     atspi_no_cache = TRUE;
 
   deferred_messages = g_queue_new ();
+  deferred_tails = g_hash_table_new (g_str_hash, g_str_equal);
+  focus_messages = g_queue_new ();
+
+  dbind_set_trace_func (call_completed);
 
   return 0;
 }
@@ -1084,8 +2258,8 @@ check_app (AtspiApplication *app, GError **error)
   return TRUE;
 }
 
-static void
-set_timeout (AtspiApplication *app)
+static int
+get_timeout (AtspiApplication *app)
 {
   struct timeval tv;
   int diff;
@@ -1094,10 +2268,16 @@ set_timeout (AtspiApplication *app)
   {
     gettimeofday (&tv, NULL);
     diff = (tv.tv_sec - app->time_added.tv_sec) * 1000 + (tv.tv_usec - app->time_added.tv_usec) / 1000;
-    dbind_set_timeout (MAX(method_call_timeout, app_startup_time - diff));
+    return MAX(method_call_timeout, app_startup_time - diff);
   }
   else
-    dbind_set_timeout (method_call_timeout);
+    return method_call_timeout;
+}
+
+static void
+set_timeout (AtspiApplication *app)
+{
+  dbind_set_timeout (get_timeout (app));
 }
 
 dbus_bool_t
@@ -1134,6 +2314,15 @@ _atspi_dbus_call (gpointer obj, const char *interface, const char *method, GErro
   return retval;
 }
 
+static DBusMessage *
+call_partial_va (gpointer obj,
+                 const char *interface,
+                 const char *method,
+                 gchar **error_name,
+                 GError **error,
+                 const char *type,
+                 va_list args);
+
 DBusMessage *
 _atspi_dbus_call_partial (gpointer obj,
                           const char *interface,
@@ -1147,6 +2336,32 @@ _atspi_dbus_call_partial (gpointer obj,
   return _atspi_dbus_call_partial_va (obj, interface, method, error, type, args);
 }
 
+/*
+ * Like _atspi_dbus_call_partial, but also honours allow_sync, and stores
+ * the D-Bus name of the error in @error_name when the call fails, so that
+ * callers can tell a missing method from a timeout.
+ */
+DBusMessage *
+_atspi_dbus_call_partial_with_error_name (gpointer obj,
+                                          const char *interface,
+                                          const char *method,
+                                          gchar **error_name,
+                                          GError **error,
+                                          const char *type, ...)
+{
+  va_list args;
+
+  *error_name = NULL;
+  if (!allow_sync)
+  {
+    _atspi_set_error_no_sync (error);
+    return NULL;
+  }
+
+  va_start (args, type);
+  return call_partial_va (obj, interface, method, error_name, error, type,
+                          args);
+}
 
 DBusMessage *
 _atspi_dbus_call_partial_va (gpointer obj,
@@ -1155,6 +2370,18 @@ _atspi_dbus_call_partial_va (gpointer obj,
                           GError **error,
                           const char *type,
                           va_list args)
+{
+  return call_partial_va (obj, interface, method, NULL, error, type, args);
+}
+
+static DBusMessage *
+call_partial_va (gpointer obj,
+                 const char *interface,
+                 const char *method,
+                 gchar **error_name,
+                 GError **error,
+                 const char *type,
+                 va_list args)
 {
   AtspiObject *aobj = ATSPI_OBJECT (obj);
   DBusError err;
@@ -1185,13 +2412,19 @@ out:
   process_deferred_messages ();
   if (dbus_error_is_set (&err))
   {
-    /* TODO: Set gerror */
+    if (error_name)
+    {
+      *error_name = g_strdup (err.name);
+      g_set_error_literal (error, ATSPI_ERROR, ATSPI_ERROR_IPC, err.message);
+    }
     dbus_error_free (&err);
   }
 
   if (reply && dbus_message_get_type (reply) == DBUS_MESSAGE_TYPE_ERROR)
   {
     const char *err_str = NULL;
+    if (error_name)
+      *error_name = g_strdup (dbus_message_get_error_name (reply));
     dbus_message_get_args (reply, NULL, DBUS_TYPE_STRING, &err_str, DBUS_TYPE_INVALID);
     if (err_str)
       g_set_error_literal (error, ATSPI_ERROR, ATSPI_ERROR_IPC, err_str);
@@ -1202,15 +2435,54 @@ out:
   return reply;
 }
 
+/*
+ * Extracts the value of a property from the reply to a
+ * org.freedesktop.DBus.Properties.Get call; @interface and @name are
+ * only used in warnings. Strings are duplicated, and object references
+ * are returned as a new reference to the #AtspiAccessible.
+ */
+dbus_bool_t
+_atspi_dbus_get_property_from_reply (DBusMessage *reply,
+                                     const char *interface,
+                                     const char *name,
+                                     const char *type,
+                                     void *data)
+{
+  DBusMessageIter iter, iter_variant;
+  char expected_type = (type [0] == '(' ? 'r' : type [0]);
+
+  dbus_message_iter_init (reply, &iter);
+  if (dbus_message_iter_get_arg_type (&iter) != 'v')
+  {
+    g_warning ("AT-SPI: expected a variant when fetching %s from interface %s; got %s\n", name, interface, dbus_message_get_signature (reply));
+    return FALSE;
+  }
+  dbus_message_iter_recurse (&iter, &iter_variant);
+  if (dbus_message_iter_get_arg_type (&iter_variant) != expected_type)
+  {
+    g_warning ("atspi_dbus_get_property: Wrong type: expected %s, got %c\n", type, dbus_message_iter_get_arg_type (&iter_variant));
+    return FALSE;
+  }
+  if (!strcmp (type, "(so)"))
+  {
+    *((AtspiAccessible **)data) = _atspi_dbus_return_accessible_from_iter (&iter_variant);
+  }
+  else
+  {
+    dbus_message_iter_get_basic (&iter_variant, data);
+    if (type [0] == 's')
+      *(char **)data = g_strdup (*(char **)data);
+  }
+  return TRUE;
+}
+
 dbus_bool_t
 _atspi_dbus_get_property (gpointer obj, const char *interface, const char *name, GError **error, const char *type, void *data)
 {
   DBusMessage *message, *reply;
-  DBusMessageIter iter, iter_variant;
   DBusError err;
   dbus_bool_t retval = FALSE;
   AtspiObject *aobj = ATSPI_OBJECT (obj);
-  char expected_type = (type [0] == '(' ? 'r' : type [0]);
 
   if (!aobj)
     return FALSE;
@@ -1255,66 +2527,299 @@ _atspi_dbus_get_property (gpointer obj, const char *interface, const char *name,
     goto done;
   }
 
-  dbus_message_iter_init (reply, &iter);
-  if (dbus_message_iter_get_arg_type (&iter) != 'v')
+  retval = _atspi_dbus_get_property_from_reply (reply, interface, name, type,
+                                                data);
+done:
+  dbus_error_free (&err);
+  if (reply)
+    dbus_message_unref (reply);
+  return retval;
+}
+
+DBusMessage *
+_atspi_dbus_send_with_reply_and_block (DBusMessage *message, GError **error)
+{
+  DBusMessage *reply;
+  DBusError err;
+  AtspiApplication *app;
+  DBusConnection *bus;
+
+  app = get_application (dbus_message_get_destination (message));
+
+  if (app && !app->bus)
+    return NULL;	/* will fail anyway; app has been disposed */
+
+  bus = (app ? app->bus : _atspi_bus());
+  dbus_error_init (&err);
+  set_timeout (app);
+  reply = dbind_send_and_allow_reentry (bus, message, &err);
+  process_deferred_messages ();
+  dbus_message_unref (message);
+  if (dbus_error_is_set (&err))
   {
-    g_warning ("AT-SPI: expected a variant when fetching %s from interface %s; got %s\n", name, interface, dbus_message_get_signature (reply));
-    goto done;
+    if (error)
+      g_set_error_literal (error, ATSPI_ERROR, ATSPI_ERROR_IPC, err.message);
+    dbus_error_free (&err);
   }
-  dbus_message_iter_recurse (&iter, &iter_variant);
-  if (dbus_message_iter_get_arg_type (&iter_variant) != expected_type)
+  return reply;
+}
+
+DBusMessage *
+_atspi_dbus_new_method_call (gpointer obj,
+                             const char *interface,
+                             const char *method,
+                             const char *type, ...)
+{
+  AtspiObject *aobj = ATSPI_OBJECT (obj);
+  DBusMessage *msg;
+  DBusMessageIter iter;
+  va_list args;
+  const char *p;
+
+  if (!aobj->app || !aobj->app->bus_name)
+    return NULL;
+
+  msg = dbus_message_new_method_call (aobj->app->bus_name, aobj->path,
+                                      interface, method);
+  if (!msg)
+    return NULL;
+
+  va_start (args, type);
+  p = type;
+  dbus_message_iter_init_append (msg, &iter);
+  dbind_any_marshal_va (&iter, &p, args);
+  va_end (args);
+  return msg;
+}
+
+DBusMessage *
+_atspi_dbus_new_get_property (gpointer obj,
+                              const char *interface,
+                              const char *name)
+{
+  return _atspi_dbus_new_method_call (obj, "org.freedesktop.DBus.Properties",
+                                      "Get", "ss", interface, name);
+}
+
+/*
+ * Sends @n_messages method calls to @app, pipelining them so that the
+ * whole batch costs about one round trip. The messages are consumed.
+ * On return, each slot of @replies holds the corresponding method
+ * return, or NULL if that call failed; @error is set from the first
+ * failure. Returns FALSE if nothing could be sent at all.
+ */
+gboolean
+_atspi_dbus_send_batch (AtspiApplication *app,
+                        DBusMessage **messages,
+                        DBusMessage **replies,
+                        gint n_messages,
+                        GError **error)
+{
+  DBusError err;
+  gint i, n_replies = 0;
+
+  memset (replies, 0, n_messages * sizeof (DBusMessage *));
+  dbus_error_init (&err);
+
+  for (i = 0; i < n_messages; i++)
+    if (!messages[i])
+      goto out;
+
+  if (!check_app (app, error))
+    goto out;
+
+  if (!allow_sync)
   {
-    g_warning ("atspi_dbus_get_property: Wrong type: expected %s, got %c\n", type, dbus_message_iter_get_arg_type (&iter_variant));
-    goto done;
+    _atspi_set_error_no_sync (error);
+    goto out;
   }
-  if (!strcmp (type, "(so)"))
+
+  set_timeout (app);
+  n_replies = dbind_send_batch_and_allow_reentry (app->bus, messages,
+                                                  replies, n_messages, &err);
+  check_for_hang (NULL, &err, app->bus, app->bus_name);
+out:
+  for (i = 0; i < n_messages; i++)
   {
-    *((AtspiAccessible **)data) = _atspi_dbus_return_accessible_from_iter (&iter_variant);
+    if (messages[i])
+      dbus_message_unref (messages[i]);
+    if (replies[i] &&
+        dbus_message_get_type (replies[i]) == DBUS_MESSAGE_TYPE_ERROR)
+    {
+      dbus_message_unref (replies[i]);
+      replies[i] = NULL;
+    }
+  }
+  process_deferred_messages ();
+  if (dbus_error_is_set (&err))
+  {
+    g_set_error_literal (error, ATSPI_ERROR, ATSPI_ERROR_IPC, err.message);
+    dbus_error_free (&err);
+  }
+  return (n_replies > 0);
+}
+
+/*
+ * Sends @message to @app without waiting for the reply, so that the
+ * caller can do other work while the application answers. The message
+ * is consumed. Returns NULL if the call could not be started, or if it
+ * is addressed to ourselves and thus cannot be completed by blocking;
+ * callers should then fall back to a synchronous call.
+ */
+DBusPendingCall *
+_atspi_dbus_send_with_reply (AtspiApplication *app, DBusMessage *message)
+{
+  DBusPendingCall *pending = NULL;
+  const char *unique_name;
+  gint64 start_time = g_get_monotonic_time ();
+
+  if (!message)
+    return NULL;
+
+  if (check_app (app, NULL) && allow_sync)
+  {
+    unique_name = dbus_bus_get_unique_name (app->bus);
+    if (unique_name && strcmp (unique_name, app->bus_name) != 0 &&
+        !dbus_connection_send_with_reply (app->bus, message, &pending,
+                                          get_timeout (app)))
+      pending = NULL;
   }
+  track_pending_call (pending, message, start_time);
+  dbus_message_unref (message);
+  return pending;
+}
+
+/*
+ * Waits for the reply to a call started with _atspi_dbus_send_with_reply
+ * and releases @pending. Error replies are turned into @error.
+ */
+DBusMessage *
+_atspi_dbus_pending_call_finish (AtspiApplication *app,
+                                 DBusPendingCall *pending,
+                                 GError **error)
+{
+  DBusMessage *reply;
+
+  dbus_pending_call_block (pending);
+  reply = dbus_pending_call_steal_reply (pending);
+  pending_call_completed (pending, reply);
+  dbus_pending_call_unref (pending);
+  process_deferred_messages ();
+
+  if (reply && dbus_message_get_type (reply) == DBUS_MESSAGE_TYPE_ERROR)
+  {
+    DBusError err;
+
+    dbus_error_init (&err);
+    dbus_set_error_from_message (&err, reply);
+    if (app && app->bus)
+      check_for_hang (NULL, &err, app->bus, app->bus_name);
+    g_set_error_literal (error, ATSPI_ERROR, ATSPI_ERROR_IPC, err.message);
+    dbus_error_free (&err);
+    dbus_message_unref (reply);
+    return NULL;
+  }
+
+  return reply;
+}
+
+/*
+ * Pool of the strings used as attribute keys and values in the attribute
+ * tables that are shared rather than handed over: the ones kept in the
+ * cache and the sets of attribute runs. Attribute dictionaries repeat the
+ * same few dozen strings ("weight", "700", "family-name"...) over and
+ * over, so those tables borrow a reference to a single pooled copy
+ * instead of duplicating each of them. Tables that callers own outright,
+ * such as those of the per-offset text attribute getters, own their
+ * strings, as they always did.
+ */
+typedef struct
+{
+  guint ref_count;
+  gchar str[1];
+} PooledString;
+
+/* Maps the str member of each PooledString to the PooledString itself */
+static GHashTable *string_pool;
+G_LOCK_DEFINE_STATIC (string_pool);
+
+/* Returns a pooled copy of @str, holding a reference to it */
+gchar *
+_atspi_string_pool_intern (const gchar *str)
+{
+  PooledString *entry;
+  gsize len;
+
+  G_LOCK (string_pool);
+  if (!string_pool)
+    string_pool = g_hash_table_new_full (g_str_hash, g_str_equal, NULL, g_free);
+
+  entry = g_hash_table_lookup (string_pool, str);
+  if (entry)
+    entry->ref_count++;
   else
   {
-    dbus_message_iter_get_basic (&iter_variant, data);
-    if (type [0] == 's')
-      *(char **)data = g_strdup (*(char **)data);
+    len = strlen (str);
+    entry = g_malloc (G_STRUCT_OFFSET (PooledString, str) + len + 1);
+    entry->ref_count = 1;
+    memcpy (entry->str, str, len + 1);
+    g_hash_table_insert (string_pool, entry->str, entry);
   }
-  retval = TRUE;
-done:
-  dbus_error_free (&err);
-  if (reply)
-    dbus_message_unref (reply);
-  return retval;
+  G_UNLOCK (string_pool);
+  return entry->str;
 }
 
-DBusMessage *
-_atspi_dbus_send_with_reply_and_block (DBusMessage *message, GError **error)
+/* Releases a reference obtained from _atspi_string_pool_intern */
+void
+_atspi_string_pool_release (gpointer str)
 {
-  DBusMessage *reply;
-  DBusError err;
-  AtspiApplication *app;
-  DBusConnection *bus;
+  PooledString *entry;
 
-  app = get_application (dbus_message_get_destination (message));
+  if (!str)
+    return;
 
-  if (app && !app->bus)
-    return NULL;	/* will fail anyway; app has been disposed */
+  G_LOCK (string_pool);
+  entry = (string_pool ? g_hash_table_lookup (string_pool, str) : NULL);
+  if (entry && entry->str == str && --entry->ref_count == 0)
+    g_hash_table_remove (string_pool, str);
+  G_UNLOCK (string_pool);
+}
 
-  bus = (app ? app->bus : _atspi_bus());
-  dbus_error_init (&err);
-  set_timeout (app);
-  reply = dbind_send_and_allow_reentry (bus, message, &err);
-  process_deferred_messages ();
-  dbus_message_unref (message);
-  if (dbus_error_is_set (&err))
+static GHashTable *
+hash_from_iter (DBusMessageIter *iter, gboolean pooled)
+{
+  GHashTable *hash;
+  DBusMessageIter iter_array, iter_dict;
+
+  if (pooled)
+    hash = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                  _atspi_string_pool_release,
+                                  _atspi_string_pool_release);
+  else
+    hash = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                  (GDestroyNotify) g_free,
+                                  (GDestroyNotify) g_free);
+
+  dbus_message_iter_recurse (iter, &iter_array);
+  while (dbus_message_iter_get_arg_type (&iter_array) != DBUS_TYPE_INVALID)
   {
-    if (error)
-      g_set_error_literal (error, ATSPI_ERROR, ATSPI_ERROR_IPC, err.message);
-    dbus_error_free (&err);
+    const char *name, *value;
+    dbus_message_iter_recurse (&iter_array, &iter_dict);
+    dbus_message_iter_get_basic (&iter_dict, &name);
+    dbus_message_iter_next (&iter_dict);
+    dbus_message_iter_get_basic (&iter_dict, &value);
+    if (pooled)
+      g_hash_table_insert (hash, _atspi_string_pool_intern (name),
+                           _atspi_string_pool_intern (value));
+    else
+      g_hash_table_insert (hash, g_strdup (name), g_strdup (value));
+    dbus_message_iter_next (&iter_array);
   }
-  return reply;
+  return hash;
 }
 
-GHashTable *
-_atspi_dbus_return_hash_from_message (DBusMessage *message)
+static GHashTable *
+return_hash_from_message (DBusMessage *message, gboolean pooled)
 {
   DBusMessageIter iter;
   GHashTable *ret;
@@ -1325,31 +2830,38 @@ _atspi_dbus_return_hash_from_message (DBusMessage *message)
   _ATSPI_DBUS_CHECK_SIG (message, "a{ss}", NULL, NULL);
 
   dbus_message_iter_init (message, &iter);
-  ret = _atspi_dbus_hash_from_iter (&iter);
+  ret = hash_from_iter (&iter, pooled);
   dbus_message_unref (message);
   return ret;
 }
 
+GHashTable *
+_atspi_dbus_return_hash_from_message (DBusMessage *message)
+{
+  return return_hash_from_message (message, FALSE);
+}
+
 GHashTable *
 _atspi_dbus_hash_from_iter (DBusMessageIter *iter)
 {
-  GHashTable *hash = g_hash_table_new_full (g_str_hash, g_str_equal,
-                                            (GDestroyNotify) g_free,
-                                            (GDestroyNotify) g_free);
-  DBusMessageIter iter_array, iter_dict;
+  return hash_from_iter (iter, FALSE);
+}
 
-  dbus_message_iter_recurse (iter, &iter_array);
-  while (dbus_message_iter_get_arg_type (&iter_array) != DBUS_TYPE_INVALID)
-  {
-    const char *name, *value;
-    dbus_message_iter_recurse (&iter_array, &iter_dict);
-    dbus_message_iter_get_basic (&iter_dict, &name);
-    dbus_message_iter_next (&iter_dict);
-    dbus_message_iter_get_basic (&iter_dict, &value);
-    g_hash_table_insert (hash, g_strdup (name), g_strdup (value));
-    dbus_message_iter_next (&iter_array);
-  }
-  return hash;
+/*
+ * Like _atspi_dbus_return_hash_from_message, but the strings of the table
+ * are pooled. Only for tables kept in the cache, which callers are given
+ * a reference to and must not modify.
+ */
+GHashTable *
+_atspi_dbus_return_pooled_hash_from_message (DBusMessage *message)
+{
+  return return_hash_from_message (message, TRUE);
+}
+
+GHashTable *
+_atspi_dbus_pooled_hash_from_iter (DBusMessageIter *iter)
+{
+  return hash_from_iter (iter, TRUE);
 }
 
 GArray *
@@ -1385,7 +2897,7 @@ _atspi_dbus_attribute_array_from_iter (DBusMessageIter *iter)
     dbus_message_iter_get_basic (&iter_dict, &name);
     dbus_message_iter_next (&iter_dict);
     dbus_message_iter_get_basic (&iter_dict, &value);
-    str = g_strdup_printf ("%s:%s", name, value);
+    str = g_strconcat (name, ":", value, NULL);
     array = g_array_append_val (array, str);
     dbus_message_iter_next (&iter_array);;
   }
@@ -1437,17 +2949,13 @@ _atspi_dbus_set_state (AtspiAccessible *accessible, DBusMessageIter *iter)
   if (count != 2)
   {
     g_warning ("AT-SPI: expected 2 values in states array; got %d\n", count);
-    if (!accessible->states)
-      accessible->states = _atspi_state_set_new_internal (accessible, 0);
+    _atspi_accessible_set_states (accessible, 0);
   }
   else
   {
     guint64 val = ((guint64)states [1]) << 32;
     val += states [0];
-    if (!accessible->states)
-      accessible->states = _atspi_state_set_new_internal (accessible, val);
-    else
-      accessible->states->states = val;
+    _atspi_accessible_set_states (accessible, val);
   }
   _atspi_accessible_add_cache (accessible, ATSPI_CACHE_STATES);
 }
@@ -1569,63 +3077,296 @@ a11y_bus_free (void *data)
     }
 }
 
-/**
- * atspi_get_a11y_bus: (skip)
+/* Connects and registers with the bus at @address, without warnings */
+static DBusConnection *
+open_bus (const char *address, DBusError *error)
+{
+  DBusConnection *connection;
+
+  connection = dbus_connection_open_private (address, error);
+  if (!connection)
+    return NULL;
+
+  if (!dbus_bus_register (connection, error))
+  {
+    dbus_connection_close (connection);
+    dbus_connection_unref (connection);
+    return NULL;
+  }
+  return connection;
+}
+
+/*
+ * Connects to the accessibility bus at @address, which is consumed. This
+ * blocks, but touches no global state, so that it can run in a separate
+ * thread.
  */
-DBusConnection *
-atspi_get_a11y_bus (void)
+static DBusConnection *
+open_a11y_bus_at (char *address, gchar **address_out)
 {
+  DBusConnection *connection;
   DBusError error;
-  char *address = NULL;
-  const char *address_env = NULL;
 
-  if (a11y_bus && dbus_connection_get_is_connected (a11y_bus))
-    return a11y_bus;
+  dbus_error_init (&error);
+  connection = open_bus (address, &error);
+  if (!connection)
+    {
+      if (!g_getenv("SSH_CONNECTION"))
+        g_warning ("Couldn't connect to accessibility bus: %s", error.message);
+      dbus_error_free (&error);
+      g_free (address);
+      return NULL;
+    }
 
-  if (a11y_dbus_slot == -1)
-    if (!dbus_connection_allocate_data_slot (&a11y_dbus_slot))
-      g_warning ("at-spi: Unable to allocate D-Bus slot");
+  if (address_out)
+    *address_out = address;
+  else
+    g_free (address);
+  return connection;
+}
+
+/*
+ * Looks up the address of the accessibility bus in the places that do not
+ * involve a D-Bus round trip: the environment and, with X11, the root
+ * window. Xlib is not used from other threads, so this must be called
+ * from the thread that initializes AT-SPI.
+ */
+static char *
+get_accessibility_bus_address_local (void)
+{
+  const char *address_env = g_getenv ("AT_SPI_BUS_ADDRESS");
 
-  address_env = g_getenv ("AT_SPI_BUS_ADDRESS");
   if (address_env != NULL && *address_env != 0)
-    address = g_strdup (address_env);
+    return g_strdup (address_env);
 #ifdef HAVE_X11
-  if (!address)
-    address = get_accessibility_bus_address_x11 ();
+  return get_accessibility_bus_address_x11 ();
+#else
+  return NULL;
 #endif
+}
+
+/* Finds the accessibility bus and connects to it */
+static DBusConnection *
+open_a11y_bus (gchar **address_out)
+{
+  char *address;
+
+  address = get_accessibility_bus_address_local ();
   if (!address)
     address = get_accessibility_bus_address_dbus ();
   if (!address)
     return NULL;
 
+  return open_a11y_bus_at (address, address_out);
+}
+
+static void
+adopt_a11y_bus (DBusConnection *connection)
+{
+  if (a11y_dbus_slot == -1)
+    if (!dbus_connection_allocate_data_slot (&a11y_dbus_slot))
+      g_warning ("at-spi: Unable to allocate D-Bus slot");
+
+  a11y_bus = connection;
+  /* Simulate a weak ref on the bus */
+  dbus_connection_set_data (a11y_bus, a11y_dbus_slot, a11y_bus, a11y_bus_free);
+}
+
+/**
+ * atspi_get_a11y_bus: (skip)
+ */
+DBusConnection *
+atspi_get_a11y_bus (void)
+{
+  DBusConnection *connection;
+
+  if (a11y_bus && dbus_connection_get_is_connected (a11y_bus))
+    return a11y_bus;
+
+  connection = open_a11y_bus (NULL);
+  if (!connection)
+    return NULL;
+
+  adopt_a11y_bus (connection);
+  return a11y_bus;
+}
+
+/*
+ * The address found by atspi_init_async() is remembered, together with
+ * the session bus it belongs to, so that the next AT to start can connect
+ * straight away. A remembered address is only used if connecting to it
+ * succeeds and the session bus has not changed.
+ */
+static gchar *
+bus_address_cache_file (void)
+{
+  return g_build_filename (g_get_user_runtime_dir (), "at-spi-bus-address",
+                           NULL);
+}
+
+/* An explicit address takes precedence, as in atspi_get_a11y_bus(), so
+ * the cache is neither read nor written when one is set. */
+static gboolean
+bus_address_is_explicit (void)
+{
+  const gchar *address_env = g_getenv ("AT_SPI_BUS_ADDRESS");
+
+  return (address_env != NULL && *address_env != 0);
+}
+
+static DBusConnection *
+open_cached_a11y_bus (void)
+{
+  DBusConnection *connection = NULL;
+  const gchar *session_address = g_getenv ("DBUS_SESSION_BUS_ADDRESS");
+  gchar *file, *contents = NULL;
+  gchar **lines = NULL;
+  DBusError error;
+
+  if (!session_address || bus_address_is_explicit ())
+    return NULL;
+
+  file = bus_address_cache_file ();
+  if (!g_file_get_contents (file, &contents, NULL, NULL))
+    goto out;
+
+  lines = g_strsplit (contents, "\n", 3);
+  if (!lines[0] || !lines[1] || strcmp (lines[0], session_address) != 0)
+    goto out;
+
   dbus_error_init (&error);
-  a11y_bus = dbus_connection_open_private (address, &error);
-  g_free (address);
+  connection = open_bus (lines[1], &error);
+  if (!connection)
+  {
+    /* Stale; the bus has been restarted since */
+    dbus_error_free (&error);
+    unlink (file);
+  }
+
+out:
+  g_strfreev (lines);
+  g_free (contents);
+  g_free (file);
+  return connection;
+}
+
+static void
+cache_a11y_bus_address (const gchar *address)
+{
+  const gchar *session_address = g_getenv ("DBUS_SESSION_BUS_ADDRESS");
+  gchar *file, *contents;
+
+  if (!session_address || bus_address_is_explicit ())
+    return;
+
+  file = bus_address_cache_file ();
+  contents = g_strdup_printf ("%s\n%s\n", session_address, address);
+  g_file_set_contents (file, contents, -1, NULL);
+  g_free (contents);
+  g_free (file);
+}
+
+typedef struct
+{
+  AtspiInitCallback callback;
+  gpointer user_data;
+  /* Found by the caller of atspi_init_async(), if anything */
+  gchar *address;
+  DBusConnection *connection;
+} InitClosure;
+
+static gboolean
+init_async_done (gpointer data)
+{
+  InitClosure *closure = data;
+  gint ret;
 
-  if (!a11y_bus)
+  if (closure->connection)
+  {
+    if (a11y_bus && dbus_connection_get_is_connected (a11y_bus))
     {
-      if (!g_getenv("SSH_CONNECTION"))
-        g_warning ("Couldn't connect to accessibility bus: %s", error.message);
-      dbus_error_free (&error);
-      return NULL;
+      /* Someone called atspi_init() in the meantime */
+      dbus_connection_close (closure->connection);
+      dbus_connection_unref (closure->connection);
     }
-  else
+    else
+      adopt_a11y_bus (closure->connection);
+  }
+
+  /* With the bus in place, this does not block: AddMatch calls are sent
+   * without waiting for their replies. */
+  ret = (closure->connection || atspi_inited ? atspi_init () : 2);
+  if (closure->callback)
+    closure->callback (ret, closure->user_data);
+  g_free (closure);
+  return G_SOURCE_REMOVE;
+}
+
+static gpointer
+init_async_thread (gpointer data)
+{
+  InitClosure *closure = data;
+  gchar *address = closure->address;
+  gboolean from_session_bus = FALSE;
+
+  closure->address = NULL;
+  if (!address)
+    closure->connection = open_cached_a11y_bus ();
+  if (!closure->connection)
+  {
+    if (!address)
     {
-      if (!dbus_bus_register (a11y_bus, &error))
-	{
-	  g_warning ("Couldn't register with accessibility bus: %s", error.message);
-          dbus_error_free (&error);
-          dbus_connection_close (a11y_bus);
-          dbus_connection_unref (a11y_bus);
-          a11y_bus = NULL;
-	  return NULL;
-	}
+      address = get_accessibility_bus_address_dbus ();
+      from_session_bus = TRUE;
     }
-  
-  /* Simulate a weak ref on the bus */
-  dbus_connection_set_data (a11y_bus, a11y_dbus_slot, a11y_bus, a11y_bus_free);
+    if (address)
+      closure->connection = open_a11y_bus_at (address, &address);
+    if (!closure->connection)
+      address = NULL;
+    else if (from_session_bus)
+      cache_a11y_bus_address (address);
+    g_free (address);
+  }
 
-  return a11y_bus;
+  g_idle_add (init_async_done, closure);
+  return NULL;
+}
+
+/**
+ * atspi_init_async:
+ * @callback: (scope async) (allow-none): function to call once
+ *            initialization is complete.
+ * @user_data: (closure): data to pass to @callback.
+ *
+ * Initializes AT-SPI like atspi_init(), but without blocking the caller
+ * while the accessibility bus is looked up and connected to; this happens
+ * in a separate thread, while the main loop keeps running. Only the
+ * address advertised on the X root window, which Xlib must not read from
+ * another thread, is looked up before returning. @callback is then called
+ * from the default main context with the value that atspi_init() would
+ * have returned.
+ *
+ * When the address has to be asked from the session bus, it is remembered
+ * for the session, and tried first the next time, which spares that round
+ * trip at startup.
+ **/
+void
+atspi_init_async (AtspiInitCallback callback, gpointer user_data)
+{
+  InitClosure *closure = g_new0 (InitClosure, 1);
+
+  closure->callback = callback;
+  closure->user_data = user_data;
+
+  if (atspi_inited)
+  {
+    g_idle_add (init_async_done, closure);
+    return;
+  }
+
+  closure->address = get_accessibility_bus_address_local ();
+  dbus_threads_init_default ();
+  g_thread_unref (g_thread_new ("atspi-init", init_async_thread, closure));
 }
 
 /**
@@ -1684,7 +3425,7 @@ atspi_set_main_context (GMainContext *cnx)
   atspi_main_context = cnx;
   atspi_dbus_connection_setup_with_g_main (atspi_get_a11y_bus (), cnx);
 
-  if (desktop)
+  if (desktop && desktop->children)
   {
     gint i;
     for (i = desktop->children->len - 1; i >= 0; i--)
@@ -1791,7 +3532,39 @@ _atspi_dbus_update_cache_from_dict (AtspiAccessible *accessible, DBusMessageIter
         break;
       }
       dbus_free (iter_sig);
-      g_value_take_boxed (val, _atspi_dbus_hash_from_iter (&iter_variant));
+      g_value_take_boxed (val, _atspi_dbus_pooled_hash_from_iter (&iter_variant));
+    }
+    else if (!strcmp (key, "States"))
+    {
+      /* Sent with focus events so that the states need not be fetched */
+      char *iter_sig = dbus_message_iter_get_signature (&iter_variant);
+      if (!strcmp (iter_sig, "au"))
+      {
+        _atspi_dbus_set_state (accessible, &iter_variant);
+        _atspi_accessible_add_cache (accessible, ATSPI_CACHE_STATES);
+      }
+      dbus_free (iter_sig);
+    }
+    else if (!strcmp (key, "Name"))
+    {
+      const char *name;
+      if (dbus_message_iter_get_arg_type (&iter_variant) == DBUS_TYPE_STRING)
+      {
+        dbus_message_iter_get_basic (&iter_variant, &name);
+        g_free (accessible->name);
+        accessible->name = g_strdup (name);
+        _atspi_accessible_add_cache (accessible, ATSPI_CACHE_NAME);
+      }
+    }
+    else if (!strcmp (key, "Role"))
+    {
+      dbus_uint32_t role;
+      if (dbus_message_iter_get_arg_type (&iter_variant) == DBUS_TYPE_UINT32)
+      {
+        dbus_message_iter_get_basic (&iter_variant, &role);
+        accessible->role = role;
+        _atspi_accessible_add_cache (accessible, ATSPI_CACHE_ROLE);
+      }
     }
     else if (!strcmp (key, "Component.ScreenExtents"))
     {
@@ -1849,3 +3622,27 @@ _atspi_set_error_no_sync (GError **error)
   g_set_error_literal (error, ATSPI_ERROR, ATSPI_ERROR_SYNC_NOT_ALLOWED,
                         _("Attempted synchronous call where prohibited"));
 }
+
+/* Writes all of @data to @fd, retrying after interruptions */
+gboolean
+_atspi_write_all (gint fd, gconstpointer data, gsize len, GError **error)
+{
+  const gchar *p = data;
+
+  while (len > 0)
+  {
+    gssize written = write (fd, p, len);
+    if (written < 0)
+    {
+      gint errsv = errno;
+      if (errsv == EINTR)
+        continue;
+      g_set_error (error, G_FILE_ERROR, g_file_error_from_errno (errsv),
+                   "Failed to write: %s", g_strerror (errsv));
+      return FALSE;
+    }
+    p += written;
+    len -= written;
+  }
+  return TRUE;
+}
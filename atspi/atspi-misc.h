@@ -31,6 +31,32 @@ G_BEGIN_DECLS
 int atspi_init (void);
 gboolean atspi_is_initialized (void);
 
+/**
+ * AtspiInitCallback:
+ * @result: 0 on success, 1 if already initialized, or 2 if the
+ *          accessibility bus could not be reached, as for atspi_init().
+ * @user_data: the data passed to atspi_init_async().
+ *
+ * A function called when atspi_init_async() completes.
+ **/
+typedef void (*AtspiInitCallback) (gint result, gpointer user_data);
+
+void atspi_init_async (AtspiInitCallback callback, gpointer user_data);
+
+/**
+ * AtspiDiscoveryCallback:
+ * @user_data: the data passed to atspi_set_discovery_callback().
+ *
+ * A function called when every known application has been discovered.
+ **/
+typedef void (*AtspiDiscoveryCallback) (gpointer user_data);
+
+void atspi_set_discovery_callback (AtspiDiscoveryCallback callback,
+                                   gpointer user_data,
+                                   GDestroyNotify destroy);
+
+gboolean atspi_is_discovery_complete (void);
+
 void atspi_event_main ();
 
 void atspi_event_quit ();
@@ -46,6 +72,123 @@ atspi_set_timeout (gint val, gint startup_time);
 void
 atspi_set_main_context (GMainContext *cnx);
 
+gboolean
+atspi_start_recording (gint fd, GError **error);
+
+void
+atspi_stop_recording (void);
+
+gboolean
+atspi_replay (gint fd, gboolean realtime, GError **error);
+
+typedef struct _AtspiIpcTrace AtspiIpcTrace;
+/**
+ * AtspiIpcTrace:
+ * @interface: the D-Bus interface of the method.
+ * @method: the name of the method.
+ * @destination: the bus name the call was sent to.
+ * @bytes_sent: the size of the marshalled method call.
+ * @bytes_received: the size of the marshalled reply, or 0 if there was none.
+ * @start_time: the monotonic time at which the call was sent, in
+ *              microseconds, as returned by g_get_monotonic_time().
+ * @duration: how long the call took, in microseconds.
+ * @reentered: whether other messages were dispatched while the call was
+ *             in progress.
+ *
+ * Describes a completed D-Bus call, for atspi_set_ipc_trace_func().
+ **/
+struct _AtspiIpcTrace
+{
+  const gchar *interface;
+  const gchar *method;
+  const gchar *destination;
+  gsize bytes_sent;
+  gsize bytes_received;
+  gint64 start_time;
+  gint64 duration;
+  gboolean reentered;
+};
+
+/**
+ * AtspiIpcTraceFunc:
+ * @trace: the call that completed; only valid during the callback.
+ * @user_data: the data passed to atspi_set_ipc_trace_func().
+ *
+ * A function called after each D-Bus call made by the library.
+ **/
+typedef void (*AtspiIpcTraceFunc) (const AtspiIpcTrace *trace,
+                                   gpointer user_data);
+
+void
+atspi_set_ipc_trace_func (AtspiIpcTraceFunc func, gpointer user_data,
+                          GDestroyNotify destroy);
+
+gboolean
+atspi_start_ipc_trace (gint fd, GError **error);
+
+void
+atspi_stop_ipc_trace (void);
+
+/**
+ * ATSPI_IPC_HISTOGRAM_N_BUCKETS:
+ *
+ * The number of buckets in the latency histograms of #AtspiIpcStatistics.
+ **/
+#define ATSPI_IPC_HISTOGRAM_N_BUCKETS 16
+
+typedef struct _AtspiIpcStatistics AtspiIpcStatistics;
+/**
+ * AtspiIpcStatistics:
+ * @interface: the D-Bus interface of the method, or %NULL for the
+ *             statistics of an application.
+ * @method: the name of the method, or %NULL for the statistics of an
+ *          application.
+ * @application: the bus name of the application, or %NULL for the
+ *               statistics of a method.
+ * @count: the number of calls.
+ * @total_time: the time spent in these calls, in microseconds.
+ * @max_time: the duration of the slowest call, in microseconds.
+ * @buckets: a histogram of the call durations; see
+ *           atspi_ipc_histogram_get_bucket_limit().
+ *
+ * Latency statistics for the D-Bus calls made to one method or to one
+ * application.
+ **/
+struct _AtspiIpcStatistics
+{
+  gchar *interface;
+  gchar *method;
+  gchar *application;
+  guint count;
+  gint64 total_time;
+  gint64 max_time;
+  guint buckets[ATSPI_IPC_HISTOGRAM_N_BUCKETS];
+};
+
+/**
+ * ATSPI_TYPE_IPC_STATISTICS:
+ *
+ * The #GType for a boxed type holding IPC latency statistics.
+ */
+#define ATSPI_TYPE_IPC_STATISTICS (atspi_ipc_statistics_get_type ())
+
+GType atspi_ipc_statistics_get_type (void);
+
+AtspiIpcStatistics *
+atspi_ipc_statistics_copy (AtspiIpcStatistics *src);
+
+void
+atspi_ipc_statistics_free (AtspiIpcStatistics *stats);
+
+gint64
+atspi_ipc_histogram_get_bucket_limit (guint bucket);
+
+GArray *
+atspi_get_ipc_statistics (void);
+
+void
+atspi_reset_ipc_statistics (void);
+
 gchar * atspi_role_get_name (AtspiRole role);
 G_END_DECLS
 
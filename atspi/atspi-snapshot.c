@@ -0,0 +1,893 @@
+/*
+ * AT-SPI - Assistive Technology Service Provider Interface
+ * (Gnome Accessibility Project; http://developer.gnome.org/projects/gap)
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include "atspi-private.h"
+#include <string.h>
+
+/*
+ * A snapshot file is laid out as a header, followed by a fixed-size record
+ * for each node and a table of NUL-terminated strings that the records refer
+ * to by offset. Nodes are stored in breadth-first order, so node 0 is the
+ * root and the children of a node occupy a contiguous run of records.
+ * Everything is in host byte order; the loader rejects foreign files.
+ */
+
+#define SNAPSHOT_MAGIC "ATSPISNP"
+#define SNAPSHOT_VERSION 1
+#define SNAPSHOT_BYTE_ORDER 0x01020304
+#define SNAPSHOT_NO_STRING G_MAXUINT32
+
+#define SNAPSHOT_FIELDS (ATSPI_CACHE_NAME | ATSPI_CACHE_DESCRIPTION | \
+                         ATSPI_CACHE_ROLE | ATSPI_CACHE_STATES | \
+                         ATSPI_CACHE_CHILDREN | ATSPI_CACHE_EXTENTS)
+
+typedef struct
+{
+  gchar magic[8];
+  guint32 version;
+  guint32 byte_order;
+  guint32 n_nodes;
+  guint32 node_size;
+  guint32 strings_size;
+  guint32 reserved;
+} SnapshotHeader;
+
+typedef struct
+{
+  guint32 cached;
+  guint32 role;
+  guint64 states;
+  guint32 bus_name;
+  guint32 path;
+  guint32 name;
+  guint32 description;
+  gint32 parent;
+  guint32 first_child;
+  guint32 n_children;
+  gint32 extents[4];
+  guint32 reserved;
+} SnapshotNode;
+
+G_DEFINE_TYPE (AtspiSnapshot, atspi_snapshot, G_TYPE_OBJECT)
+
+/**
+ * atspi_snapshot_change_copy:
+ * @src: the #AtspiSnapshotChange to copy.
+ *
+ * Returns: (transfer full): a copy of @src.
+ **/
+AtspiSnapshotChange *
+atspi_snapshot_change_copy (AtspiSnapshotChange *src)
+{
+  AtspiSnapshotChange *dst = g_new (AtspiSnapshotChange, 1);
+
+  *dst = *src;
+  return dst;
+}
+
+G_DEFINE_BOXED_TYPE (AtspiSnapshotChange, atspi_snapshot_change,
+                     atspi_snapshot_change_copy, g_free)
+
+static void
+atspi_snapshot_init (AtspiSnapshot *snapshot)
+{
+}
+
+static void
+atspi_snapshot_finalize (GObject *object)
+{
+  AtspiSnapshot *snapshot = ATSPI_SNAPSHOT (object);
+
+  if (snapshot->file)
+    g_mapped_file_unref (snapshot->file);
+
+  G_OBJECT_CLASS (atspi_snapshot_parent_class)->finalize (object);
+}
+
+static void
+atspi_snapshot_class_init (AtspiSnapshotClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+  object_class->finalize = atspi_snapshot_finalize;
+}
+
+typedef struct
+{
+  GByteArray *strings;
+  GHashTable *offsets;
+} StringTable;
+
+static guint32
+intern_string (StringTable *table, const gchar *str)
+{
+  gpointer offset;
+
+  if (!str)
+    return SNAPSHOT_NO_STRING;
+
+  if (g_hash_table_lookup_extended (table->offsets, str, NULL, &offset))
+    return GPOINTER_TO_UINT (offset);
+
+  offset = GUINT_TO_POINTER (table->strings->len);
+  g_byte_array_append (table->strings, (const guint8 *) str, strlen (str) + 1);
+  g_hash_table_insert (table->offsets, (gpointer) str, offset);
+  return GPOINTER_TO_UINT (offset);
+}
+
+static void
+fill_node (SnapshotNode *node, AtspiAccessible *accessible, AtspiCache mask,
+           StringTable *table)
+{
+  AtspiAccessiblePrivate *priv = accessible->priv;
+  AtspiAccessibleExtras *extras = priv->extras;
+  AtspiCache cached = 0;
+  AtspiCache flags[] = { ATSPI_CACHE_NAME, ATSPI_CACHE_DESCRIPTION,
+                         ATSPI_CACHE_ROLE, ATSPI_CACHE_STATES };
+  gint i;
+
+  memset (node, 0, sizeof (*node));
+  for (i = 0; i < G_N_ELEMENTS (flags); i++)
+    if ((mask & flags[i]) && _atspi_accessible_test_cache (accessible, flags[i]))
+      cached |= flags[i];
+
+  node->bus_name = intern_string (table, accessible->parent.app ?
+                                  accessible->parent.app->bus_name : NULL);
+  node->path = intern_string (table, accessible->parent.path);
+  node->name = intern_string (table, (cached & ATSPI_CACHE_NAME) ?
+                              accessible->name : NULL);
+  node->description = intern_string (table, (cached & ATSPI_CACHE_DESCRIPTION) ?
+                                     accessible->description : NULL);
+  if (cached & ATSPI_CACHE_ROLE)
+    node->role = accessible->role;
+  if (cached & ATSPI_CACHE_STATES)
+    node->states = (accessible->states ? accessible->states->states
+                                       : priv->states);
+
+  if ((mask & ATSPI_CACHE_EXTENTS) &&
+      extras && _atspi_accessible_test_cache (accessible, ATSPI_CACHE_EXTENTS) &&
+      extras->extents_generation == accessible->parent.app->extents_generation &&
+      (extras->extents_valid & (1 << ATSPI_COORD_TYPE_SCREEN)))
+  {
+    AtspiRect *rect = &extras->extents[ATSPI_COORD_TYPE_SCREEN];
+    node->extents[0] = rect->x;
+    node->extents[1] = rect->y;
+    node->extents[2] = rect->width;
+    node->extents[3] = rect->height;
+    cached |= ATSPI_CACHE_EXTENTS;
+  }
+
+  node->cached = cached;
+}
+
+/**
+ * atspi_accessible_snapshot_save:
+ * @root: the #AtspiAccessible at the top of the subtree to save.
+ * @fd: a file descriptor open for writing.
+ * @mask: an #AtspiCache mask selecting the properties to save.
+ *
+ * Writes a compact binary snapshot of the cached subtree below @root to
+ * @fd. Only data already held in the cache is saved; no calls are made to
+ * the application. Use atspi_snapshot_load() to read the snapshot back.
+ *
+ * The snapshot is written in host byte order and is meant for offline
+ * analysis on the same kind of machine.
+ *
+ * Returns: #TRUE on success, #FALSE if writing failed.
+ **/
+gboolean
+atspi_accessible_snapshot_save (AtspiAccessible *root, gint fd,
+                                AtspiCache mask, GError **error)
+{
+  GPtrArray *accessibles;
+  GHashTable *seen;
+  GArray *nodes;
+  StringTable table;
+  SnapshotHeader header;
+  gboolean ret;
+  guint i;
+
+  g_return_val_if_fail (root != NULL, FALSE);
+  g_return_val_if_fail (fd >= 0, FALSE);
+
+  accessibles = g_ptr_array_new ();
+  seen = g_hash_table_new (g_direct_hash, g_direct_equal);
+  nodes = g_array_new (FALSE, FALSE, sizeof (SnapshotNode));
+  table.strings = g_byte_array_new ();
+  table.offsets = g_hash_table_new (g_str_hash, g_str_equal);
+
+  g_ptr_array_add (accessibles, root);
+  g_hash_table_add (seen, root);
+
+  for (i = 0; i < accessibles->len; i++)
+  {
+    AtspiAccessible *accessible = g_ptr_array_index (accessibles, i);
+    SnapshotNode node;
+
+    fill_node (&node, accessible, mask, &table);
+    node.first_child = accessibles->len;
+
+    if ((mask & ATSPI_CACHE_CHILDREN) && accessible->children &&
+        _atspi_accessible_test_cache (accessible, ATSPI_CACHE_CHILDREN))
+    {
+      guint j;
+
+      node.cached |= ATSPI_CACHE_CHILDREN;
+      for (j = 0; j < accessible->children->len; j++)
+      {
+        AtspiAccessible *child = g_ptr_array_index (accessible->children, j);
+        if (!child || g_hash_table_contains (seen, child))
+          continue;
+        g_hash_table_add (seen, child);
+        g_ptr_array_add (accessibles, child);
+        node.n_children++;
+      }
+    }
+
+    g_array_append_val (nodes, node);
+  }
+
+  /* Parents are filled in once the whole array exists */
+  g_array_index (nodes, SnapshotNode, 0).parent = -1;
+  for (i = 0; i < nodes->len; i++)
+  {
+    SnapshotNode *node = &g_array_index (nodes, SnapshotNode, i);
+    guint j;
+
+    for (j = 0; j < node->n_children; j++)
+      g_array_index (nodes, SnapshotNode, node->first_child + j).parent = i;
+  }
+
+  memset (&header, 0, sizeof (header));
+  memcpy (header.magic, SNAPSHOT_MAGIC, sizeof (header.magic));
+  header.version = SNAPSHOT_VERSION;
+  header.byte_order = SNAPSHOT_BYTE_ORDER;
+  header.n_nodes = nodes->len;
+  header.node_size = sizeof (SnapshotNode);
+  header.strings_size = table.strings->len;
+
+  ret = (_atspi_write_all (fd, &header, sizeof (header), error) &&
+         _atspi_write_all (fd, nodes->data, nodes->len * sizeof (SnapshotNode), error) &&
+         _atspi_write_all (fd, table.strings->data, table.strings->len, error));
+
+  g_hash_table_unref (table.offsets);
+  g_byte_array_free (table.strings, TRUE);
+  g_array_free (nodes, TRUE);
+  g_hash_table_unref (seen);
+  g_ptr_array_free (accessibles, TRUE);
+  return ret;
+}
+
+static gboolean
+invalid_snapshot (GError **error, const gchar *reason)
+{
+  g_set_error (error, G_FILE_ERROR, G_FILE_ERROR_INVAL,
+               "Invalid accessibility snapshot: %s", reason);
+  return FALSE;
+}
+
+static gboolean
+validate (const gchar *data, gsize length, GError **error)
+{
+  const SnapshotHeader *header = (const SnapshotHeader *) data;
+  guint64 size;
+
+  if (length < sizeof (SnapshotHeader) ||
+      memcmp (header->magic, SNAPSHOT_MAGIC, sizeof (header->magic)) != 0)
+    return invalid_snapshot (error, "bad magic");
+  if (header->byte_order != SNAPSHOT_BYTE_ORDER)
+    return invalid_snapshot (error, "written with a different byte order");
+  if (header->version != SNAPSHOT_VERSION ||
+      header->node_size != sizeof (SnapshotNode))
+    return invalid_snapshot (error, "unsupported version");
+
+  size = sizeof (SnapshotHeader) +
+         (guint64) header->n_nodes * sizeof (SnapshotNode) +
+         header->strings_size;
+  if (size > length)
+    return invalid_snapshot (error, "truncated");
+  if (header->strings_size > 0 &&
+      data[sizeof (SnapshotHeader) + header->n_nodes * sizeof (SnapshotNode) +
+           header->strings_size - 1] != '\0')
+    return invalid_snapshot (error, "unterminated string table");
+
+  return TRUE;
+}
+
+/**
+ * atspi_snapshot_load:
+ * @fd: a file descriptor open for reading, positioned anywhere.
+ *
+ * Memory-maps a snapshot written by atspi_accessible_snapshot_save(). The
+ * file is not parsed up front; the query functions read straight from the
+ * mapping, so even very large trees load almost instantly. @fd may be
+ * closed once this returns.
+ *
+ * Returns: (transfer full): a new #AtspiSnapshot, or NULL on error.
+ **/
+AtspiSnapshot *
+atspi_snapshot_load (gint fd, GError **error)
+{
+  AtspiSnapshot *snapshot;
+  GMappedFile *file;
+  const gchar *data;
+  const SnapshotHeader *header;
+
+  g_return_val_if_fail (fd >= 0, NULL);
+
+  file = g_mapped_file_new_from_fd (fd, FALSE, error);
+  if (!file)
+    return NULL;
+
+  data = g_mapped_file_get_contents (file);
+  if (!data || !validate (data, g_mapped_file_get_length (file), error))
+  {
+    if (!data)
+      invalid_snapshot (error, "empty file");
+    g_mapped_file_unref (file);
+    return NULL;
+  }
+
+  header = (const SnapshotHeader *) data;
+  snapshot = g_object_new (ATSPI_TYPE_SNAPSHOT, NULL);
+  snapshot->file = file;
+  snapshot->n_nodes = header->n_nodes;
+  snapshot->nodes = data + sizeof (SnapshotHeader);
+  snapshot->strings = data + sizeof (SnapshotHeader) +
+                      header->n_nodes * sizeof (SnapshotNode);
+  snapshot->strings_size = header->strings_size;
+  return snapshot;
+}
+
+static const SnapshotNode *
+get_node (AtspiSnapshot *snapshot, guint node)
+{
+  g_return_val_if_fail (ATSPI_IS_SNAPSHOT (snapshot), NULL);
+  g_return_val_if_fail (node < snapshot->n_nodes, NULL);
+
+  return (const SnapshotNode *) snapshot->nodes + node;
+}
+
+static const gchar *
+get_string (AtspiSnapshot *snapshot, guint32 offset)
+{
+  /* The string table is known to end with a NUL */
+  if (offset >= snapshot->strings_size)
+    return NULL;
+  return snapshot->strings + offset;
+}
+
+/**
+ * atspi_snapshot_get_n_nodes:
+ * @snapshot: an #AtspiSnapshot.
+ *
+ * Nodes are numbered from 0, which is the root of the saved subtree.
+ *
+ * Returns: the number of nodes in @snapshot.
+ **/
+guint
+atspi_snapshot_get_n_nodes (AtspiSnapshot *snapshot)
+{
+  g_return_val_if_fail (ATSPI_IS_SNAPSHOT (snapshot), 0);
+
+  return snapshot->n_nodes;
+}
+
+/**
+ * atspi_snapshot_get_parent:
+ * @snapshot: an #AtspiSnapshot.
+ * @node: the index of a node.
+ *
+ * Returns: the index of the parent of @node, or -1 for the root.
+ **/
+gint
+atspi_snapshot_get_parent (AtspiSnapshot *snapshot, guint node)
+{
+  const SnapshotNode *n = get_node (snapshot, node);
+
+  if (!n || n->parent < 0 || n->parent >= snapshot->n_nodes)
+    return -1;
+  return n->parent;
+}
+
+/**
+ * atspi_snapshot_get_n_children:
+ * @snapshot: an #AtspiSnapshot.
+ * @node: the index of a node.
+ *
+ * Returns: the number of children saved for @node. This is 0 if its
+ * children were not cached.
+ **/
+guint
+atspi_snapshot_get_n_children (AtspiSnapshot *snapshot, guint node)
+{
+  const SnapshotNode *n = get_node (snapshot, node);
+
+  return (n ? n->n_children : 0);
+}
+
+/**
+ * atspi_snapshot_get_child:
+ * @snapshot: an #AtspiSnapshot.
+ * @node: the index of a node.
+ * @index: the position of the child.
+ *
+ * Returns: the index of the child of @node at position @index, or -1 if
+ * there is no such child.
+ **/
+gint
+atspi_snapshot_get_child (AtspiSnapshot *snapshot, guint node, guint index)
+{
+  const SnapshotNode *n = get_node (snapshot, node);
+  guint64 child;
+
+  if (!n || index >= n->n_children)
+    return -1;
+  child = (guint64) n->first_child + index;
+  return (child < snapshot->n_nodes ? (gint) child : -1);
+}
+
+/**
+ * atspi_snapshot_get_cached:
+ * @snapshot: an #AtspiSnapshot.
+ * @node: the index of a node.
+ *
+ * Returns: an #AtspiCache mask of the properties that were saved for @node.
+ **/
+AtspiCache
+atspi_snapshot_get_cached (AtspiSnapshot *snapshot, guint node)
+{
+  const SnapshotNode *n = get_node (snapshot, node);
+
+  return (n ? n->cached & SNAPSHOT_FIELDS : ATSPI_CACHE_NONE);
+}
+
+/**
+ * atspi_snapshot_get_bus_name:
+ * @snapshot: an #AtspiSnapshot.
+ * @node: the index of a node.
+ *
+ * Returns: (transfer none): the bus name of the application owning @node.
+ **/
+const gchar *
+atspi_snapshot_get_bus_name (AtspiSnapshot *snapshot, guint node)
+{
+  const SnapshotNode *n = get_node (snapshot, node);
+
+  return (n ? get_string (snapshot, n->bus_name) : NULL);
+}
+
+/**
+ * atspi_snapshot_get_path:
+ * @snapshot: an #AtspiSnapshot.
+ * @node: the index of a node.
+ *
+ * Returns: (transfer none): the D-Bus object path of @node.
+ **/
+const gchar *
+atspi_snapshot_get_path (AtspiSnapshot *snapshot, guint node)
+{
+  const SnapshotNode *n = get_node (snapshot, node);
+
+  return (n ? get_string (snapshot, n->path) : NULL);
+}
+
+/**
+ * atspi_snapshot_get_name:
+ * @snapshot: an #AtspiSnapshot.
+ * @node: the index of a node.
+ *
+ * Returns: (transfer none): the name of @node, or NULL if it was not saved.
+ **/
+const gchar *
+atspi_snapshot_get_name (AtspiSnapshot *snapshot, guint node)
+{
+  const SnapshotNode *n = get_node (snapshot, node);
+
+  return (n ? get_string (snapshot, n->name) : NULL);
+}
+
+/**
+ * atspi_snapshot_get_description:
+ * @snapshot: an #AtspiSnapshot.
+ * @node: the index of a node.
+ *
+ * Returns: (transfer none): the description of @node, or NULL if it was
+ * not saved.
+ **/
+const gchar *
+atspi_snapshot_get_description (AtspiSnapshot *snapshot, guint node)
+{
+  const SnapshotNode *n = get_node (snapshot, node);
+
+  return (n ? get_string (snapshot, n->description) : NULL);
+}
+
+/**
+ * atspi_snapshot_get_role:
+ * @snapshot: an #AtspiSnapshot.
+ * @node: the index of a node.
+ *
+ * Returns: the #AtspiRole of @node, or ATSPI_ROLE_INVALID if it was not
+ * saved.
+ **/
+AtspiRole
+atspi_snapshot_get_role (AtspiSnapshot *snapshot, guint node)
+{
+  const SnapshotNode *n = get_node (snapshot, node);
+
+  if (!n || !(n->cached & ATSPI_CACHE_ROLE))
+    return ATSPI_ROLE_INVALID;
+  return n->role;
+}
+
+/**
+ * atspi_snapshot_get_state_set:
+ * @snapshot: an #AtspiSnapshot.
+ * @node: the index of a node.
+ *
+ * Returns: (transfer full): a new #AtspiStateSet holding the states of
+ * @node, or NULL if they were not saved.
+ **/
+AtspiStateSet *
+atspi_snapshot_get_state_set (AtspiSnapshot *snapshot, guint node)
+{
+  const SnapshotNode *n = get_node (snapshot, node);
+
+  if (!n || !(n->cached & ATSPI_CACHE_STATES))
+    return NULL;
+  return _atspi_state_set_new_internal (NULL, n->states);
+}
+
+/**
+ * atspi_snapshot_get_extents:
+ * @snapshot: an #AtspiSnapshot.
+ * @node: the index of a node.
+ * @extents: (out): return location for the screen extents of @node.
+ *
+ * Returns: #TRUE if the extents of @node were saved, #FALSE otherwise.
+ **/
+gboolean
+atspi_snapshot_get_extents (AtspiSnapshot *snapshot, guint node,
+                            AtspiRect *extents)
+{
+  const SnapshotNode *n = get_node (snapshot, node);
+
+  g_return_val_if_fail (extents != NULL, FALSE);
+
+  if (!n || !(n->cached & ATSPI_CACHE_EXTENTS))
+    return FALSE;
+  extents->x = n->extents[0];
+  extents->y = n->extents[1];
+  extents->width = n->extents[2];
+  extents->height = n->extents[3];
+  return TRUE;
+}
+
+typedef struct
+{
+  const gchar *bus_name;
+  const gchar *path;
+} NodeKey;
+
+static guint
+node_key_hash (gconstpointer data)
+{
+  const NodeKey *key = data;
+
+  return (key->bus_name ? g_str_hash (key->bus_name) * 31 : 0) +
+         (key->path ? g_str_hash (key->path) : 0);
+}
+
+static gboolean
+node_key_equal (gconstpointer a, gconstpointer b)
+{
+  const NodeKey *ka = a, *kb = b;
+
+  return (g_strcmp0 (ka->path, kb->path) == 0 &&
+          g_strcmp0 (ka->bus_name, kb->bus_name) == 0);
+}
+
+static void
+match_nodes (AtspiSnapshot *old_snapshot, gint *old_to_new,
+             AtspiSnapshot *new_snapshot, gint *new_to_old)
+{
+  NodeKey *keys;
+  GHashTable *index;
+  guint i;
+
+  /* Objects keep their path for their whole life, so that is tried first */
+  keys = g_new (NodeKey, new_snapshot->n_nodes);
+  index = g_hash_table_new (node_key_hash, node_key_equal);
+  for (i = 0; i < new_snapshot->n_nodes; i++)
+  {
+    keys[i].bus_name = atspi_snapshot_get_bus_name (new_snapshot, i);
+    keys[i].path = atspi_snapshot_get_path (new_snapshot, i);
+    g_hash_table_insert (index, &keys[i], GUINT_TO_POINTER (i + 1));
+  }
+
+  for (i = 0; i < old_snapshot->n_nodes; i++)
+  {
+    NodeKey key;
+    guint j;
+
+    key.bus_name = atspi_snapshot_get_bus_name (old_snapshot, i);
+    key.path = atspi_snapshot_get_path (old_snapshot, i);
+    j = GPOINTER_TO_UINT (g_hash_table_lookup (index, &key));
+    if (j > 0 && new_to_old[j - 1] < 0)
+    {
+      old_to_new[i] = j - 1;
+      new_to_old[j - 1] = i;
+    }
+  }
+
+  g_hash_table_unref (index);
+  g_free (keys);
+
+  /* Toolkits that recreate objects give them new paths, so fall back to
+   * the position below an already matched parent, provided that the role
+   * agrees. Nodes are in breadth-first order, so parents come first. */
+  if (old_to_new[0] < 0 && new_to_old[0] < 0)
+  {
+    old_to_new[0] = 0;
+    new_to_old[0] = 0;
+  }
+
+  for (i = 1; i < old_snapshot->n_nodes; i++)
+  {
+    const SnapshotNode *old_node, *old_parent, *new_parent;
+    gint parent, new_index;
+    guint position;
+
+    if (old_to_new[i] >= 0)
+      continue;
+    parent = atspi_snapshot_get_parent (old_snapshot, i);
+    if (parent < 0 || old_to_new[parent] < 0)
+      continue;
+
+    old_node = get_node (old_snapshot, i);
+    old_parent = get_node (old_snapshot, parent);
+    new_parent = get_node (new_snapshot, old_to_new[parent]);
+    position = i - old_parent->first_child;
+    new_index = atspi_snapshot_get_child (new_snapshot, old_to_new[parent],
+                                          position);
+    if (new_index < 0 || new_to_old[new_index] >= 0 ||
+        !(new_parent->cached & ATSPI_CACHE_CHILDREN))
+      continue;
+
+    if (((old_node->cached & ATSPI_CACHE_ROLE) != 0) !=
+        ((get_node (new_snapshot, new_index)->cached & ATSPI_CACHE_ROLE) != 0) ||
+        old_node->role != get_node (new_snapshot, new_index)->role)
+      continue;
+
+    old_to_new[i] = new_index;
+    new_to_old[new_index] = i;
+  }
+}
+
+static AtspiCache
+compare_properties (AtspiSnapshot *old_snapshot, guint old_index,
+                    AtspiSnapshot *new_snapshot, guint new_index)
+{
+  const SnapshotNode *a = get_node (old_snapshot, old_index);
+  const SnapshotNode *b = get_node (new_snapshot, new_index);
+  AtspiCache both = a->cached & b->cached;
+  AtspiCache changed = 0;
+
+  if ((both & ATSPI_CACHE_NAME) &&
+      g_strcmp0 (get_string (old_snapshot, a->name),
+                 get_string (new_snapshot, b->name)) != 0)
+    changed |= ATSPI_CACHE_NAME;
+  if ((both & ATSPI_CACHE_DESCRIPTION) &&
+      g_strcmp0 (get_string (old_snapshot, a->description),
+                 get_string (new_snapshot, b->description)) != 0)
+    changed |= ATSPI_CACHE_DESCRIPTION;
+  if ((both & ATSPI_CACHE_ROLE) && a->role != b->role)
+    changed |= ATSPI_CACHE_ROLE;
+  if ((both & ATSPI_CACHE_STATES) && a->states != b->states)
+    changed |= ATSPI_CACHE_STATES;
+  if ((both & ATSPI_CACHE_EXTENTS) &&
+      memcmp (a->extents, b->extents, sizeof (a->extents)) != 0)
+    changed |= ATSPI_CACHE_EXTENTS;
+
+  return changed;
+}
+
+static void
+add_change (GArray *changes, AtspiSnapshotChangeType type,
+            gint old_node, gint new_node, AtspiCache changed)
+{
+  AtspiSnapshotChange change;
+
+  change.type = type;
+  change.old_node = old_node;
+  change.new_node = new_node;
+  change.changed = changed;
+  g_array_append_val (changes, change);
+}
+
+/*
+ * Marks the children of each new node that kept their relative order: of the
+ * children that stayed with their parent, the longest run whose old indices
+ * increase. The other ones are the fewest that must have moved to explain
+ * the new order. Each run is handled in O(n log n).
+ */
+static void
+mark_in_order (AtspiSnapshot *old_snapshot, const gint *old_to_new,
+               AtspiSnapshot *new_snapshot, const gint *new_to_old,
+               gboolean *in_order)
+{
+  gint *run, *tails, *prev;
+  guint parent;
+
+  run = g_new (gint, new_snapshot->n_nodes);
+  tails = g_new (gint, new_snapshot->n_nodes);
+  prev = g_new (gint, new_snapshot->n_nodes);
+
+  for (parent = 0; parent < new_snapshot->n_nodes; parent++)
+  {
+    gint n_children = atspi_snapshot_get_n_children (new_snapshot, parent);
+    gint i, n_run = 0, length = 0, k;
+
+    for (i = 0; i < n_children; i++)
+    {
+      gint child = atspi_snapshot_get_child (new_snapshot, parent, i);
+      gint old_parent;
+
+      if (child < 0 || new_to_old[child] < 0)
+        continue;
+      old_parent = atspi_snapshot_get_parent (old_snapshot, new_to_old[child]);
+      if (old_parent >= 0 && old_to_new[old_parent] == (gint) parent)
+        run[n_run++] = child;
+    }
+
+    for (k = 0; k < n_run; k++)
+    {
+      gint old_index = new_to_old[run[k]];
+      gint low = 0, high = length;
+
+      /* tails[j] ends the increasing run of length j + 1 with the smallest
+       * old index seen so far */
+      while (low < high)
+      {
+        gint middle = (low + high) / 2;
+        if (new_to_old[run[tails[middle]]] < old_index)
+          low = middle + 1;
+        else
+          high = middle;
+      }
+      prev[k] = (low > 0 ? tails[low - 1] : -1);
+      tails[low] = k;
+      if (low == length)
+        length++;
+    }
+
+    for (k = (length > 0 ? tails[length - 1] : -1); k >= 0; k = prev[k])
+      in_order[run[k]] = TRUE;
+  }
+
+  g_free (run);
+  g_free (tails);
+  g_free (prev);
+}
+
+/**
+ * atspi_snapshot_diff:
+ * @old_snapshot: the earlier #AtspiSnapshot.
+ * @new_snapshot: the later #AtspiSnapshot.
+ * @minimal: whether to only report the roots of inserted and removed
+ *           subtrees.
+ *
+ * Compares two snapshots, such as ones saved before and after a UI update
+ * with atspi_accessible_snapshot_save(). Nodes are matched by bus name and
+ * path, and otherwise by their position below a matched parent, and each
+ * node is then reported at most once. Removed nodes come first, in the order
+ * of @old_snapshot, followed by the other changes in the order of
+ * @new_snapshot.
+ *
+ * A matched node is reported as moved when its parent changed or when it is
+ * not part of the longest sequence of its siblings that kept their relative
+ * order, so that moving one node ahead of the others only reports that node.
+ * Property changes are only detected for properties saved in both snapshots.
+ * The comparison runs in O(n log n) time in the number of nodes.
+ *
+ * Returns: (element-type AtspiSnapshotChange) (transfer full): a #GArray of
+ * #AtspiSnapshotChange, empty if the snapshots are equivalent.
+ **/
+GArray *
+atspi_snapshot_diff (AtspiSnapshot *old_snapshot, AtspiSnapshot *new_snapshot,
+                     gboolean minimal)
+{
+  GArray *changes;
+  gint *old_to_new, *new_to_old;
+  gboolean *in_order;
+  guint i;
+
+  g_return_val_if_fail (ATSPI_IS_SNAPSHOT (old_snapshot), NULL);
+  g_return_val_if_fail (ATSPI_IS_SNAPSHOT (new_snapshot), NULL);
+
+  changes = g_array_new (FALSE, FALSE, sizeof (AtspiSnapshotChange));
+  if (old_snapshot->n_nodes == 0 || new_snapshot->n_nodes == 0)
+  {
+    for (i = 0; i < old_snapshot->n_nodes && (!minimal || i == 0); i++)
+      add_change (changes, ATSPI_SNAPSHOT_CHANGE_REMOVED, i, -1, 0);
+    for (i = 0; i < new_snapshot->n_nodes && (!minimal || i == 0); i++)
+      add_change (changes, ATSPI_SNAPSHOT_CHANGE_INSERTED, -1, i, 0);
+    return changes;
+  }
+
+  old_to_new = g_new (gint, old_snapshot->n_nodes);
+  new_to_old = g_new (gint, new_snapshot->n_nodes);
+  memset (old_to_new, 0xff, old_snapshot->n_nodes * sizeof (gint));
+  memset (new_to_old, 0xff, new_snapshot->n_nodes * sizeof (gint));
+
+  match_nodes (old_snapshot, old_to_new, new_snapshot, new_to_old);
+
+  in_order = g_new0 (gboolean, new_snapshot->n_nodes);
+  mark_in_order (old_snapshot, old_to_new, new_snapshot, new_to_old,
+                 in_order);
+
+  for (i = 0; i < old_snapshot->n_nodes; i++)
+  {
+    gint parent;
+
+    if (old_to_new[i] >= 0)
+      continue;
+    parent = atspi_snapshot_get_parent (old_snapshot, i);
+    if (minimal && parent >= 0 && old_to_new[parent] < 0)
+      continue;
+    add_change (changes, ATSPI_SNAPSHOT_CHANGE_REMOVED, i, -1, 0);
+  }
+
+  for (i = 0; i < new_snapshot->n_nodes; i++)
+  {
+    gint old_index = new_to_old[i];
+    gint parent = atspi_snapshot_get_parent (new_snapshot, i);
+    gint old_parent;
+    gboolean moved = FALSE;
+    AtspiCache changed;
+
+    if (old_index < 0)
+    {
+      if (!minimal || parent < 0 || new_to_old[parent] >= 0)
+        add_change (changes, ATSPI_SNAPSHOT_CHANGE_INSERTED, -1, i, 0);
+      continue;
+    }
+
+    old_parent = atspi_snapshot_get_parent (old_snapshot, old_index);
+    if ((old_parent < 0) != (parent < 0) ||
+        (parent >= 0 && old_to_new[old_parent] != parent))
+      moved = TRUE;
+    else if (parent >= 0 && !in_order[i])
+      moved = TRUE;
+
+    changed = compare_properties (old_snapshot, old_index, new_snapshot, i);
+    if (moved)
+      add_change (changes, ATSPI_SNAPSHOT_CHANGE_MOVED, old_index, i, changed);
+    else if (changed)
+      add_change (changes, ATSPI_SNAPSHOT_CHANGE_PROPERTIES, old_index, i,
+                  changed);
+  }
+
+  g_free (old_to_new);
+  g_free (new_to_old);
+  g_free (in_order);
+  return changes;
+}
@@ -0,0 +1,127 @@
+/*
+ * AT-SPI - Assistive Technology Service Provider Interface
+ * (Gnome Accessibility Project; http://developer.gnome.org/projects/gap)
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifndef _ATSPI_SNAPSHOT_H_
+#define _ATSPI_SNAPSHOT_H_
+
+#include "glib-object.h"
+
+#include "atspi-constants.h"
+#include "atspi-types.h"
+#include "atspi-component.h"
+#include "atspi-stateset.h"
+
+G_BEGIN_DECLS
+
+#define ATSPI_TYPE_SNAPSHOT                    (atspi_snapshot_get_type ())
+#define ATSPI_SNAPSHOT(obj)                    (G_TYPE_CHECK_INSTANCE_CAST ((obj), ATSPI_TYPE_SNAPSHOT, AtspiSnapshot))
+#define ATSPI_SNAPSHOT_CLASS(klass)            (G_TYPE_CHECK_CLASS_CAST ((klass), ATSPI_TYPE_SNAPSHOT, AtspiSnapshotClass))
+#define ATSPI_IS_SNAPSHOT(obj)                 (G_TYPE_CHECK_INSTANCE_TYPE ((obj), ATSPI_TYPE_SNAPSHOT))
+#define ATSPI_IS_SNAPSHOT_CLASS(klass)         (G_TYPE_CHECK_CLASS_TYPE ((klass), ATSPI_TYPE_SNAPSHOT))
+#define ATSPI_SNAPSHOT_GET_CLASS(obj)          (G_TYPE_INSTANCE_GET_CLASS ((obj), ATSPI_TYPE_SNAPSHOT, AtspiSnapshotClass))
+
+typedef struct _AtspiSnapshot AtspiSnapshot;
+struct _AtspiSnapshot
+{
+  GObject parent;
+  GMappedFile *file;
+  guint n_nodes;
+  gconstpointer nodes;
+  const gchar *strings;
+  guint strings_size;
+};
+
+typedef struct _AtspiSnapshotChange AtspiSnapshotChange;
+struct _AtspiSnapshotChange
+{
+  AtspiSnapshotChangeType type;
+  gint old_node;
+  gint new_node;
+  AtspiCache changed;
+};
+
+/**
+ * ATSPI_TYPE_SNAPSHOT_CHANGE:
+ *
+ * The #GType for a boxed type holding a change between two snapshots.
+ */
+#define ATSPI_TYPE_SNAPSHOT_CHANGE (atspi_snapshot_change_get_type ())
+
+GType atspi_snapshot_change_get_type (void);
+
+AtspiSnapshotChange *
+atspi_snapshot_change_copy (AtspiSnapshotChange *src);
+
+typedef struct _AtspiSnapshotClass AtspiSnapshotClass;
+struct _AtspiSnapshotClass
+{
+  GObjectClass parent_class;
+};
+
+GType atspi_snapshot_get_type (void);
+
+gboolean
+atspi_accessible_snapshot_save (AtspiAccessible *root, gint fd, AtspiCache mask, GError **error);
+
+AtspiSnapshot *
+atspi_snapshot_load (gint fd, GError **error);
+
+guint
+atspi_snapshot_get_n_nodes (AtspiSnapshot *snapshot);
+
+gint
+atspi_snapshot_get_parent (AtspiSnapshot *snapshot, guint node);
+
+guint
+atspi_snapshot_get_n_children (AtspiSnapshot *snapshot, guint node);
+
+gint
+atspi_snapshot_get_child (AtspiSnapshot *snapshot, guint node, guint index);
+
+AtspiCache
+atspi_snapshot_get_cached (AtspiSnapshot *snapshot, guint node);
+
+const gchar *
+atspi_snapshot_get_bus_name (AtspiSnapshot *snapshot, guint node);
+
+const gchar *
+atspi_snapshot_get_path (AtspiSnapshot *snapshot, guint node);
+
+const gchar *
+atspi_snapshot_get_name (AtspiSnapshot *snapshot, guint node);
+
+const gchar *
+atspi_snapshot_get_description (AtspiSnapshot *snapshot, guint node);
+
+AtspiRole
+atspi_snapshot_get_role (AtspiSnapshot *snapshot, guint node);
+
+AtspiStateSet *
+atspi_snapshot_get_state_set (AtspiSnapshot *snapshot, guint node);
+
+gboolean
+atspi_snapshot_get_extents (AtspiSnapshot *snapshot, guint node, AtspiRect *extents);
+
+GArray *
+atspi_snapshot_diff (AtspiSnapshot *old_snapshot, AtspiSnapshot *new_snapshot, gboolean minimal);
+
+G_END_DECLS
+
+#endif	/* _ATSPI_SNAPSHOT_H_ */
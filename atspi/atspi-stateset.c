@@ -87,28 +87,44 @@ _atspi_state_set_new_internal (AtspiAccessible *accessible, gint64 states)
 void
 atspi_state_set_set_by_name (AtspiStateSet *set, const gchar *name, gboolean enabled)
 {
-  GTypeClass *type_class;
-  GEnumValue *value;
+  gint state;
 
   if (set->accessible &&
       !(set->accessible->cached_properties & ATSPI_CACHE_STATES))
     return;
 
+  state = _atspi_state_type_from_name (name);
+  if (state < 0)
+    return;
+
+  if (enabled)
+    set->states |= ((gint64)1 << state);
+  else
+    set->states &= ~((gint64)1 << state);
+}
+
+/*
+ * Maps a state nick, as found in state-changed event names, to its
+ * #AtspiStateType, or returns -1 (with a warning) if it is unknown.
+ */
+gint
+_atspi_state_type_from_name (const gchar *name)
+{
+  GTypeClass *type_class;
+  GEnumValue *value;
+  gint state = -1;
+
   type_class = g_type_class_ref (ATSPI_TYPE_STATE_TYPE);
 
   value = g_enum_get_value_by_nick (G_ENUM_CLASS (type_class), name);
 
   if (!value)
-  {
     g_warning ("AT-SPI: Attempt to set unknown state '%s'", name);
-  }
   else
-    if (enabled)
-      set->states |= ((gint64)1 << value->value);
-    else
-      set->states &= ~((gint64)1 << value->value);
+    state = value->value;
 
   g_type_class_unref (type_class);
+  return state;
 }
 
 static void
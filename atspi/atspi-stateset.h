@@ -70,6 +70,8 @@ void atspi_state_set_remove (AtspiStateSet *set, AtspiStateType state);
 
 AtspiStateSet * _atspi_state_set_new_internal (struct _AtspiAccessible *accessible, gint64 states);
 
+gint _atspi_state_type_from_name (const gchar *name);
+
 G_END_DECLS
 
 #endif	/* _ATSPI_STATE_SET_H_ */
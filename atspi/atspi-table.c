@@ -25,6 +25,281 @@
 #include <stdlib.h> /* for malloc */
 #include "atspi-private.h"
 
+/* Parts of an AtspiTableCache that currently hold valid values */
+#define TABLE_CACHE_N_ROWS    (1 << 0)
+#define TABLE_CACHE_N_COLUMNS (1 << 1)
+#define TABLE_CACHE_CAPTION   (1 << 2)
+#define TABLE_CACHE_SUMMARY   (1 << 3)
+#define TABLE_CACHE_ALL       0xf
+
+struct _AtspiTableCache
+{
+  guint valid;
+  /* Bumped whenever anything is dropped from the cache */
+  guint generation;
+  gint n_rows;
+  gint n_columns;
+  AtspiAccessible *caption;
+  AtspiAccessible *summary;
+  /* Indexed by GINT_TO_POINTER (row or column); a header may be NULL */
+  GHashTable *row_descriptions;
+  GHashTable *column_descriptions;
+  GHashTable *row_headers;
+  GHashTable *column_headers;
+};
+
+static void
+unref_if_set (gpointer data)
+{
+  if (data)
+    g_object_unref (data);
+}
+
+static void
+table_cache_clear_rows (AtspiTableCache *cache)
+{
+  cache->valid &= ~TABLE_CACHE_N_ROWS;
+  cache->generation++;
+  g_hash_table_remove_all (cache->row_descriptions);
+  g_hash_table_remove_all (cache->row_headers);
+}
+
+static void
+table_cache_clear_columns (AtspiTableCache *cache)
+{
+  cache->valid &= ~TABLE_CACHE_N_COLUMNS;
+  cache->generation++;
+  g_hash_table_remove_all (cache->column_descriptions);
+  g_hash_table_remove_all (cache->column_headers);
+}
+
+static void
+table_cache_clear (AtspiTableCache *cache)
+{
+  table_cache_clear_rows (cache);
+  table_cache_clear_columns (cache);
+  g_clear_object (&cache->caption);
+  g_clear_object (&cache->summary);
+  cache->valid = 0;
+}
+
+void
+_atspi_table_cache_free (AtspiTableCache *cache)
+{
+  table_cache_clear (cache);
+  g_hash_table_destroy (cache->row_descriptions);
+  g_hash_table_destroy (cache->column_descriptions);
+  g_hash_table_destroy (cache->row_headers);
+  g_hash_table_destroy (cache->column_headers);
+  g_free (cache);
+}
+
+/*
+ * Returns the table cache of @obj, emptying it first if its contents
+ * can no longer be trusted, for instance because events are not being
+ * processed. Whatever is then stored in it stays valid until
+ * _atspi_table_cache_invalidate is called for a matching event.
+ */
+static AtspiTableCache *
+get_table_cache (AtspiTable *obj)
+{
+  AtspiAccessible *accessible = ATSPI_ACCESSIBLE (obj);
+  AtspiAccessibleExtras *extras = _atspi_accessible_get_extras (accessible);
+  AtspiTableCache *cache = extras->table_cache;
+
+  if (!cache)
+  {
+    cache = g_new0 (AtspiTableCache, 1);
+    cache->row_descriptions = g_hash_table_new_full (g_direct_hash,
+                                                     g_direct_equal,
+                                                     NULL, g_free);
+    cache->column_descriptions = g_hash_table_new_full (g_direct_hash,
+                                                        g_direct_equal,
+                                                        NULL, g_free);
+    cache->row_headers = g_hash_table_new_full (g_direct_hash,
+                                                g_direct_equal,
+                                                NULL, unref_if_set);
+    cache->column_headers = g_hash_table_new_full (g_direct_hash,
+                                                   g_direct_equal,
+                                                   NULL, unref_if_set);
+    extras->table_cache = cache;
+  }
+  else if (!_atspi_accessible_test_cache (accessible, ATSPI_CACHE_TABLE))
+    table_cache_clear (cache);
+
+  _atspi_accessible_add_cache (accessible, ATSPI_CACHE_TABLE);
+  return cache;
+}
+
+/*
+ * Drops the parts of the table cache of @accessible that are made stale
+ * by an event of type @event_type.
+ */
+void
+_atspi_table_cache_invalidate (AtspiAccessible *accessible,
+                               const gchar *event_type)
+{
+  AtspiTableCache *cache = (accessible->priv->extras ?
+                            accessible->priv->extras->table_cache : NULL);
+  const gchar *property;
+
+  if (!cache)
+    return;
+
+  cache->generation++;
+  if (!strncmp (event_type, "object:row-", 11))
+    table_cache_clear_rows (cache);
+  else if (!strncmp (event_type, "object:column-", 14))
+    table_cache_clear_columns (cache);
+  else if (!strncmp (event_type, "object:model-changed", 20))
+    table_cache_clear (cache);
+  else if (!strncmp (event_type, "object:property-change:accessible-table-", 40))
+  {
+    property = event_type + 40;
+    if (!strncmp (property, "caption", 7))
+    {
+      cache->valid &= ~TABLE_CACHE_CAPTION;
+      g_clear_object (&cache->caption);
+    }
+    else if (!strcmp (property, "summary"))
+    {
+      cache->valid &= ~TABLE_CACHE_SUMMARY;
+      g_clear_object (&cache->summary);
+    }
+    else if (!strcmp (property, "row-description"))
+      g_hash_table_remove_all (cache->row_descriptions);
+    else if (!strcmp (property, "column-description"))
+      g_hash_table_remove_all (cache->column_descriptions);
+    else if (!strcmp (property, "row-header"))
+      g_hash_table_remove_all (cache->row_headers);
+    else if (!strcmp (property, "column-header"))
+      g_hash_table_remove_all (cache->column_headers);
+  }
+}
+
+/*
+ * Checks, after a call that may have re-entered the main loop, that the
+ * table cache of @obj is still @cache and that nothing was dropped from
+ * it since @generation was read. Events handled meanwhile may have made
+ * the result of the call stale, and disposing of @obj frees the cache,
+ * so the result must only be stored if this returns TRUE.
+ */
+static gboolean
+table_cache_unchanged (AtspiTable *obj, AtspiTableCache *cache,
+                       guint generation)
+{
+  /* A disposed accessible has lost its application */
+  if (!ATSPI_OBJECT (obj)->app)
+    return FALSE;
+
+  return (get_table_cache (obj) == cache && cache->generation == generation);
+}
+
+static AtspiAccessible *
+get_cached_accessible (AtspiTable *obj, guint part, const char *name,
+                       GError **error)
+{
+  AtspiTableCache *cache = get_table_cache (obj);
+  guint generation = cache->generation;
+  AtspiAccessible **field = (part == TABLE_CACHE_CAPTION ? &cache->caption :
+                             &cache->summary);
+  AtspiAccessible *retval = NULL;
+
+  if (!(cache->valid & part))
+  {
+    if (!_atspi_dbus_get_property (obj, atspi_interface_table, name, error,
+                                   "(so)", &retval))
+      return NULL;
+    if (!table_cache_unchanged (obj, cache, generation))
+      return retval;
+    g_clear_object (field);
+    *field = retval;
+    cache->valid |= part;
+  }
+
+  return (*field ? g_object_ref (*field) : NULL);
+}
+
+static gint
+get_cached_count (AtspiTable *obj, guint part, const char *name,
+                  GError **error)
+{
+  AtspiTableCache *cache = get_table_cache (obj);
+  guint generation = cache->generation;
+  gint *field = (part == TABLE_CACHE_N_ROWS ? &cache->n_rows :
+                 &cache->n_columns);
+  dbus_int32_t retval = -1;
+
+  if (!(cache->valid & part))
+  {
+    if (!_atspi_dbus_get_property (obj, atspi_interface_table, name, error,
+                                   "i", &retval))
+      return -1;
+    if (!table_cache_unchanged (obj, cache, generation))
+      return retval;
+    *field = retval;
+    cache->valid |= part;
+  }
+}
+
+static gchar *
+get_cached_description (AtspiTable *obj, gboolean rows, const char *method,
+                        gint index, GError **error)
+{
+  AtspiTableCache *cache = get_table_cache (obj);
+  guint generation = cache->generation;
+  dbus_int32_t d_index = index;
+  gchar *retval = NULL;
+  gpointer value;
+
+  if (!g_hash_table_lookup_extended (rows ? cache->row_descriptions :
+                                     cache->column_descriptions,
+                                     GINT_TO_POINTER (index), NULL, &value))
+  {
+    if (!_atspi_dbus_call (obj, atspi_interface_table, method, error, "i=>s",
+                           d_index, &retval))
+      return NULL;
+    if (!table_cache_unchanged (obj, cache, generation))
+      return retval;
+    g_hash_table_insert (rows ? cache->row_descriptions :
+                         cache->column_descriptions,
+                         GINT_TO_POINTER (index), retval);
+    value = retval;
+  }
+
+  return g_strdup (value);
+}
+
+static AtspiAccessible *
+get_cached_header (AtspiTable *obj, gboolean rows, const char *method,
+                   gint index, GError **error)
+{
+  AtspiTableCache *cache = get_table_cache (obj);
+  guint generation = cache->generation;
+  dbus_int32_t d_index = index;
+  DBusMessage *reply;
+  AtspiAccessible *header;
+  gpointer value;
+
+  if (!g_hash_table_lookup_extended (rows ? cache->row_headers :
+                                     cache->column_headers,
+                                     GINT_TO_POINTER (index), NULL, &value))
+  {
+    reply = _atspi_dbus_call_partial (obj, atspi_interface_table, method,
+                                      error, "i", d_index);
+    if (!reply)
+      return NULL;
+    header = _atspi_dbus_return_accessible_from_message (reply);
+    if (!table_cache_unchanged (obj, cache, generation))
+      return header;
+    g_hash_table_insert (rows ? cache->row_headers : cache->column_headers,
+                         GINT_TO_POINTER (index), header);
+    value = header;
+  }
+
+  return (value ? g_object_ref (value) : NULL);
+}
+
 /**
  * atspi_table_get_caption:
  * @obj: a pointer to the #AtspiTable implementor on which to operate.
@@ -38,12 +313,9 @@
 AtspiAccessible *
 atspi_table_get_caption (AtspiTable *obj, GError **error)
 {
-  AtspiAccessible *retval = NULL;
-
   g_return_val_if_fail (obj != NULL, NULL);
 
-  _atspi_dbus_get_property (obj, atspi_interface_table, "Caption", error, "(so)", &retval);
-  return retval;
+  return get_cached_accessible (obj, TABLE_CACHE_CAPTION, "Caption", error);
 }
 
 /**
@@ -58,13 +330,9 @@ atspi_table_get_caption (AtspiTable *obj, GError **error)
 AtspiAccessible *
 atspi_table_get_summary (AtspiTable *obj, GError **error)
 {
-  AtspiAccessible *retval;
-
   g_return_val_if_fail (obj != NULL, NULL);
 
-  _atspi_dbus_get_property (obj, atspi_interface_table, "Summary", error, "(so)", &retval);
-
- return retval;
+  return get_cached_accessible (obj, TABLE_CACHE_SUMMARY, "Summary", error);
 }
 
 /**
@@ -80,13 +348,9 @@ atspi_table_get_summary (AtspiTable *obj, GError **error)
 gint
 atspi_table_get_n_rows (AtspiTable *obj, GError **error)
 {
-  dbus_int32_t retval = -1;
-
   g_return_val_if_fail (obj != NULL, -1);
 
-  _atspi_dbus_get_property (obj, atspi_interface_table, "NRows", error, "i", &retval);
-	  
-  return retval;
+  return get_cached_count (obj, TABLE_CACHE_N_ROWS, "NRows", error);
 }
 
 /**
@@ -102,13 +366,9 @@ atspi_table_get_n_rows (AtspiTable *obj, GError **error)
 gint
 atspi_table_get_n_columns (AtspiTable *obj, GError **error)
 {
-  dbus_int32_t retval = -1;
-
   g_return_val_if_fail (obj != NULL, -1);
 
-  _atspi_dbus_get_property (obj, atspi_interface_table, "NColumns", error, "i", &retval);
-	  
-  return retval;
+  return get_cached_count (obj, TABLE_CACHE_N_COLUMNS, "NColumns", error);
 }
 
 /**
@@ -242,14 +502,9 @@ atspi_table_get_row_description (AtspiTable *obj,
 				   gint  row,
 				   GError **error)
 {
-  dbus_int32_t d_row = row;
-  char *retval = NULL;
-
   g_return_val_if_fail (obj != NULL, NULL);
 
-  _atspi_dbus_call (obj, atspi_interface_table, "GetRowDescription", error, "i=>s", d_row, &retval);
-	  
-  return retval;
+  return get_cached_description (obj, TRUE, "GetRowDescription", row, error);
 }
 
 /**
@@ -266,14 +521,10 @@ gchar *
 atspi_table_get_column_description (AtspiTable *obj,
 				      gint         column, GError **error)
 {
-  dbus_int32_t d_column = column;
-  char *retval = NULL;
-
   g_return_val_if_fail (obj != NULL, NULL);
 
-  _atspi_dbus_call (obj, atspi_interface_table, "GetColumnDescription", error, "i=>s", d_column, &retval);
-
-  return retval;
+  return get_cached_description (obj, FALSE, "GetColumnDescription", column,
+                                 error);
 }
 
 /**
@@ -348,14 +599,9 @@ atspi_table_get_row_header (AtspiTable *obj,
 			      gint         row,
 			      GError **error)
 {
-  dbus_int32_t d_row = row;
-  DBusMessage *reply;
-
   g_return_val_if_fail (obj != NULL, NULL);
 
-  reply = _atspi_dbus_call_partial (obj, atspi_interface_table, "GetRowHeader", error, "i", d_row);
-
-  return _atspi_dbus_return_accessible_from_message (reply);
+  return get_cached_header (obj, TRUE, "GetRowHeader", row, error);
 }
 
 /**
@@ -375,14 +621,362 @@ atspi_table_get_column_header (AtspiTable *obj,
 				 gint column,
 				 GError **error)
 {
-  dbus_int32_t d_column = column;
-  DBusMessage *reply;
+  g_return_val_if_fail (obj != NULL, NULL);
+
+  return get_cached_header (obj, FALSE, "GetColumnHeader", column, error);
+}
+
+static AtspiTableGrid *
+atspi_table_grid_copy (AtspiTableGrid *src)
+{
+  AtspiTableGrid *dst = g_new (AtspiTableGrid, 1);
+  guint i;
+
+  *dst = *src;
+  dst->cells = g_array_sized_new (FALSE, FALSE, sizeof (AtspiTableGridCell),
+                                  src->cells->len);
+  g_array_append_vals (dst->cells, src->cells->data, src->cells->len);
+  for (i = 0; i < dst->cells->len; i++)
+  {
+    AtspiTableGridCell *cell = &g_array_index (dst->cells, AtspiTableGridCell, i);
+    if (cell->accessible)
+      g_object_ref (cell->accessible);
+    cell->name = g_strdup (cell->name);
+    cell->description = g_strdup (cell->description);
+    if (cell->states)
+      g_object_ref (cell->states);
+  }
+  dst->row_headers = g_ptr_array_ref (src->row_headers);
+  dst->column_headers = g_ptr_array_ref (src->column_headers);
+  return dst;
+}
+
+/**
+ * atspi_table_grid_free:
+ * @grid: the #AtspiTableGrid to free.
+ *
+ * Frees an #AtspiTableGrid returned by #atspi_table_get_cells_in_range.
+ **/
+void
+atspi_table_grid_free (AtspiTableGrid *grid)
+{
+  guint i;
+
+  if (!grid)
+    return;
+
+  for (i = 0; i < grid->cells->len; i++)
+  {
+    AtspiTableGridCell *cell = &g_array_index (grid->cells, AtspiTableGridCell, i);
+    if (cell->accessible)
+      g_object_unref (cell->accessible);
+    g_free (cell->name);
+    g_free (cell->description);
+    if (cell->states)
+      g_object_unref (cell->states);
+  }
+  g_array_free (grid->cells, TRUE);
+  g_ptr_array_unref (grid->row_headers);
+  g_ptr_array_unref (grid->column_headers);
+  g_free (grid);
+}
+
+G_DEFINE_BOXED_TYPE (AtspiTableGrid, atspi_table_grid, atspi_table_grid_copy,
+                     atspi_table_grid_free)
+
+static gint
+get_int_from_reply (DBusMessage *reply, gint fallback)
+{
+  dbus_int32_t d_retval;
+
+  if (reply && dbus_message_get_args (reply, NULL, DBUS_TYPE_INT32, &d_retval,
+                                      DBUS_TYPE_INVALID))
+    fallback = d_retval;
+  if (reply)
+    dbus_message_unref (reply);
+  return fallback;
+}
+
+/* The cell properties that atspi_table_get_cells_in_range can fetch */
+#define GRID_CELL_CACHE (ATSPI_CACHE_NAME | ATSPI_CACHE_DESCRIPTION | \
+                         ATSPI_CACHE_ROLE | ATSPI_CACHE_STATES)
+
+/*
+ * Fetches the properties in @mask that are not cached yet for each
+ * accessible in @accessibles, in one pipelined batch, and stores them
+ * on the accessibles. The accessibles whose states were fetched are
+ * added to @fetched_states, since the cache mask of the application may
+ * not let them be marked as cached.
+ */
+static void
+fetch_cell_properties (AtspiApplication *app, GPtrArray *accessibles,
+                       AtspiCache mask, GHashTable *fetched_states)
+{
+  GPtrArray *messages = g_ptr_array_new ();
+  GArray *requests = g_array_new (FALSE, FALSE, sizeof (AtspiCache));
+  GPtrArray *targets = g_ptr_array_new ();
+  DBusMessage **replies;
+  guint i;
+
+  for (i = 0; i < accessibles->len; i++)
+  {
+    AtspiAccessible *accessible = g_ptr_array_index (accessibles, i);
+    AtspiCache flag;
+
+    for (flag = ATSPI_CACHE_NAME; flag <= ATSPI_CACHE_ROLE; flag <<= 1)
+    {
+      DBusMessage *message;
+
+      if (!(mask & flag & GRID_CELL_CACHE) ||
+          _atspi_accessible_test_cache (accessible, flag))
+        continue;
+      if (flag == ATSPI_CACHE_NAME)
+        message = _atspi_dbus_new_get_property (accessible,
+                                                atspi_interface_accessible,
+                                                "Name");
+      else if (flag == ATSPI_CACHE_DESCRIPTION)
+        message = _atspi_dbus_new_get_property (accessible,
+                                                atspi_interface_accessible,
+                                                "Description");
+      else if (flag == ATSPI_CACHE_STATES)
+        message = _atspi_dbus_new_method_call (accessible,
+                                               atspi_interface_accessible,
+                                               "GetState", "");
+      else
+        message = _atspi_dbus_new_method_call (accessible,
+                                               atspi_interface_accessible,
+                                               "GetRole", "");
+      if (!message)
+        continue;
+      g_ptr_array_add (messages, message);
+      g_array_append_val (requests, flag);
+      g_ptr_array_add (targets, accessible);
+    }
+  }
+
+  replies = g_new0 (DBusMessage *, messages->len + 1);
+  if (messages->len > 0)
+    _atspi_dbus_send_batch (app, (DBusMessage **) messages->pdata, replies,
+                            messages->len, NULL);
+
+  for (i = 0; i < messages->len; i++)
+  {
+    AtspiAccessible *accessible = g_ptr_array_index (targets, i);
+    AtspiCache flag = g_array_index (requests, AtspiCache, i);
+    DBusMessageIter iter;
+    dbus_uint32_t d_role;
+    gchar *str;
+
+    if (!replies[i])
+      continue;
+    switch (flag)
+    {
+    case ATSPI_CACHE_NAME:
+    case ATSPI_CACHE_DESCRIPTION:
+      if (_atspi_dbus_get_property_from_reply (replies[i],
+                                               atspi_interface_accessible,
+                                               (flag == ATSPI_CACHE_NAME ? "Name" : "Description"),
+                                               "s", &str))
+      {
+        gchar **field = (flag == ATSPI_CACHE_NAME ? &accessible->name :
+                         &accessible->description);
+        g_free (*field);
+        *field = str;
+        _atspi_accessible_add_cache (accessible, flag);
+      }
+      break;
+    case ATSPI_CACHE_STATES:
+      if (!strcmp (dbus_message_get_signature (replies[i]), "au"))
+      {
+        dbus_message_iter_init (replies[i], &iter);
+        _atspi_dbus_set_state (accessible, &iter);
+        _atspi_accessible_add_cache (accessible, ATSPI_CACHE_STATES);
+        g_hash_table_add (fetched_states, accessible);
+      }
+      break;
+    default:
+      if (dbus_message_get_args (replies[i], NULL, DBUS_TYPE_UINT32, &d_role,
+                                 DBUS_TYPE_INVALID))
+      {
+        accessible->role = d_role;
+        _atspi_accessible_add_cache (accessible, ATSPI_CACHE_ROLE);
+      }
+      break;
+    }
+    dbus_message_unref (replies[i]);
+  }
+
+  g_free (replies);
+  g_ptr_array_free (messages, TRUE);
+  g_array_free (requests, TRUE);
+  g_ptr_array_free (targets, TRUE);
+}
+
+/**
+ * atspi_table_get_cells_in_range:
+ * @obj: a pointer to the #AtspiTable implementor on which to operate.
+ * @row: the first row of the range, zero-indexed.
+ * @column: the first column of the range, zero-indexed.
+ * @n_rows: the number of rows in the range.
+ * @n_columns: the number of columns in the range.
+ * @mask: an #AtspiCache mask of the cell properties to fetch. Only
+ *        #ATSPI_CACHE_NAME, #ATSPI_CACHE_DESCRIPTION, #ATSPI_CACHE_ROLE
+ *        and #ATSPI_CACHE_STATES are considered.
+ *
+ * Gets a snapshot of a rectangular range of table cells: the cell at
+ * each position along with its row and column spans and the requested
+ * properties, and the headers of the rows and columns of the range.
+ * All the underlying requests are pipelined, in two batches, instead of
+ * costing one round trip each. The fetched properties are also stored
+ * in the cache of the cell accessibles.
+ *
+ * Returns: (transfer full): an #AtspiTableGrid whose @cells holds
+ *          @n_rows rows of @n_columns #AtspiTableGridCell, or %NULL on
+ *          error.
+ **/
+AtspiTableGrid *
+atspi_table_get_cells_in_range (AtspiTable *obj,
+                                gint row,
+                                gint column,
+                                gint n_rows,
+                                gint n_columns,
+                                AtspiCache mask,
+                                GError **error)
+{
+  AtspiApplication *app;
+  AtspiTableGrid *grid;
+  DBusMessage **messages, **replies;
+  GPtrArray *accessibles;
+  GHashTable *seen, *fetched_states;
+  GError *local_error = NULL;
+  gint n_cells, n_messages, i, j;
 
   g_return_val_if_fail (obj != NULL, NULL);
+  g_return_val_if_fail (n_rows >= 0 && n_columns >= 0, NULL);
+  /* Keeps the number of messages, three per cell plus the headers, in
+   * range */
+  g_return_val_if_fail (n_rows <= G_MAXINT / 8 && n_columns <= G_MAXINT / 8 &&
+                        (n_rows == 0 || n_columns <= G_MAXINT / 8 / n_rows),
+                        NULL);
+
+  app = ATSPI_OBJECT (obj)->app;
+  n_cells = n_rows * n_columns;
+  n_messages = 3 * n_cells + n_rows + n_columns;
+  messages = g_new0 (DBusMessage *, n_messages + 1);
+  replies = g_new0 (DBusMessage *, n_messages + 1);
+
+  for (i = 0; i < n_cells; i++)
+  {
+    dbus_int32_t d_row = row + i / n_columns;
+    dbus_int32_t d_column = column + i % n_columns;
+
+    messages[3 * i] = _atspi_dbus_new_method_call (obj, atspi_interface_table,
+                                                   "GetAccessibleAt", "ii",
+                                                   d_row, d_column);
+    messages[3 * i + 1] = _atspi_dbus_new_method_call (obj, atspi_interface_table,
+                                                       "GetRowExtentAt", "ii",
+                                                       d_row, d_column);
+    messages[3 * i + 2] = _atspi_dbus_new_method_call (obj, atspi_interface_table,
+                                                       "GetColumnExtentAt", "ii",
+                                                       d_row, d_column);
+  }
+  for (i = 0; i < n_rows; i++)
+  {
+    dbus_int32_t d_row = row + i;
+    messages[3 * n_cells + i] = _atspi_dbus_new_method_call (obj, atspi_interface_table,
+                                                             "GetRowHeader", "i",
+                                                             d_row);
+  }
+  for (i = 0; i < n_columns; i++)
+  {
+    dbus_int32_t d_column = column + i;
+    messages[3 * n_cells + n_rows + i] = _atspi_dbus_new_method_call (obj, atspi_interface_table,
+                                                                      "GetColumnHeader", "i",
+                                                                      d_column);
+  }
 
-  reply = _atspi_dbus_call_partial (obj, atspi_interface_table, "GetColumnHeader", error, "i", d_column);
+  /* Calls that failed individually leave their cell empty; only a batch
+   * that could not be sent at all is an error */
+  if (n_messages > 0 &&
+      !_atspi_dbus_send_batch (app, messages, replies, n_messages, &local_error))
+  {
+    g_propagate_error (error, local_error);
+    g_free (messages);
+    g_free (replies);
+    return NULL;
+  }
+  g_clear_error (&local_error);
+  g_free (messages);
+
+  grid = g_new (AtspiTableGrid, 1);
+  grid->row = row;
+  grid->column = column;
+  grid->n_rows = n_rows;
+  grid->n_columns = n_columns;
+  grid->cells = g_array_sized_new (FALSE, TRUE, sizeof (AtspiTableGridCell),
+                                   n_cells);
+  g_array_set_size (grid->cells, n_cells);
+  grid->row_headers = g_ptr_array_new_full (n_rows, unref_if_set);
+  grid->column_headers = g_ptr_array_new_full (n_columns, unref_if_set);
+
+  accessibles = g_ptr_array_new ();
+  seen = g_hash_table_new (g_direct_hash, g_direct_equal);
+  for (i = 0; i < n_cells; i++)
+  {
+    AtspiTableGridCell *cell = &g_array_index (grid->cells, AtspiTableGridCell, i);
+
+    cell->accessible = (replies[3 * i] ?
+                        _atspi_dbus_return_accessible_from_message (replies[3 * i]) :
+                        NULL);
+    cell->row_span = get_int_from_reply (replies[3 * i + 1], 1);
+    cell->column_span = get_int_from_reply (replies[3 * i + 2], 1);
+    cell->role = ATSPI_ROLE_INVALID;
+    if (cell->accessible && !g_hash_table_contains (seen, cell->accessible))
+    {
+      g_hash_table_add (seen, cell->accessible);
+      g_ptr_array_add (accessibles, cell->accessible);
+    }
+  }
+  for (i = 0; i < n_rows + n_columns; i++)
+  {
+    DBusMessage *reply = replies[3 * n_cells + i];
+    AtspiAccessible *header = (reply ?
+                               _atspi_dbus_return_accessible_from_message (reply) :
+                               NULL);
+    g_ptr_array_add (i < n_rows ? grid->row_headers : grid->column_headers,
+                     header);
+  }
+  g_free (replies);
+
+  fetched_states = g_hash_table_new (g_direct_hash, g_direct_equal);
+  fetch_cell_properties (app, accessibles, mask, fetched_states);
+
+  for (j = 0; j < n_cells; j++)
+  {
+    AtspiTableGridCell *cell = &g_array_index (grid->cells, AtspiTableGridCell, j);
+    AtspiAccessible *accessible = cell->accessible;
+
+    if (!accessible)
+      continue;
+    if (mask & ATSPI_CACHE_NAME)
+      cell->name = g_strdup (accessible->name);
+    if (mask & ATSPI_CACHE_DESCRIPTION)
+      cell->description = g_strdup (accessible->description);
+    if (mask & ATSPI_CACHE_ROLE)
+      cell->role = accessible->role;
+    if ((mask & ATSPI_CACHE_STATES) &&
+        (g_hash_table_contains (fetched_states, accessible) ||
+         _atspi_accessible_test_cache (accessible, ATSPI_CACHE_STATES)))
+      cell->states = _atspi_state_set_new_internal (NULL,
+                                                    accessible->states ?
+                                                    accessible->states->states :
+                                                    accessible->priv->states);
+  }
 
-  return _atspi_dbus_return_accessible_from_message (reply);
+  g_hash_table_unref (seen);
+  g_hash_table_unref (fetched_states);
+  g_ptr_array_free (accessibles, TRUE);
+  return grid;
 }
 
 /**
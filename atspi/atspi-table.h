@@ -34,6 +34,41 @@
 
 G_BEGIN_DECLS
 
+typedef struct _AtspiTableGridCell AtspiTableGridCell;
+struct _AtspiTableGridCell
+{
+  AtspiAccessible *accessible;
+  gint row_span;
+  gint column_span;
+  gchar *name;
+  gchar *description;
+  AtspiRole role;
+  struct _AtspiStateSet *states;
+};
+
+typedef struct _AtspiTableGrid AtspiTableGrid;
+struct _AtspiTableGrid
+{
+  gint row;
+  gint column;
+  gint n_rows;
+  gint n_columns;
+  GArray *cells;
+  GPtrArray *row_headers;
+  GPtrArray *column_headers;
+};
+
+/**
+ * ATSPI_TYPE_TABLE_GRID:
+ * 
+ * The #GType for a boxed type holding a snapshot of a range of table cells.
+ */
+#define	ATSPI_TYPE_TABLE_GRID atspi_table_grid_get_type ()
+
+GType atspi_table_grid_get_type ();
+
+void atspi_table_grid_free (AtspiTableGrid *grid);
+
 #define ATSPI_TYPE_TABLE                    (atspi_table_get_type ())
 #define ATSPI_IS_TABLE(obj)                 G_TYPE_CHECK_INSTANCE_TYPE ((obj), ATSPI_TYPE_TABLE)
 #define ATSPI_TABLE(obj)                    G_TYPE_CHECK_INSTANCE_CAST ((obj), ATSPI_TYPE_TABLE, AtspiTable)
@@ -76,6 +111,8 @@ AtspiAccessible * atspi_table_get_row_header (AtspiTable *obj, gint row, GError
 
 AtspiAccessible * atspi_table_get_column_header (AtspiTable *obj, gint column, GError **error);
 
+AtspiTableGrid * atspi_table_get_cells_in_range (AtspiTable *obj, gint row, gint column, gint n_rows, gint n_columns, AtspiCache mask, GError **error);
+
 gint atspi_table_get_n_selected_rows (AtspiTable *obj, GError **error);
 
 GArray *atspi_table_get_selected_rows (AtspiTable *obj, GError **error);
@@ -0,0 +1,201 @@
+/*
+ * AT-SPI - Assistive Technology Service Provider Interface
+ * (Gnome Accessibility Project; http://developer.gnome.org/projects/gap)
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include "atspi-private.h"
+
+/* Number of characters fetched per chunk when none is specified */
+#define DEFAULT_CHUNK_SIZE 4096
+
+G_DEFINE_TYPE (AtspiTextReader, atspi_text_reader, G_TYPE_OBJECT)
+
+static void
+atspi_text_reader_init (AtspiTextReader *reader)
+{
+}
+
+static void
+atspi_text_reader_finalize (GObject *object)
+{
+  AtspiTextReader *reader = ATSPI_TEXT_READER (object);
+
+  if (reader->pending)
+  {
+    dbus_pending_call_cancel (reader->pending);
+    dbus_pending_call_unref (reader->pending);
+  }
+  if (reader->chunk)
+    dbus_message_unref (reader->chunk);
+  g_object_unref (reader->text);
+
+  G_OBJECT_CLASS (atspi_text_reader_parent_class)->finalize (object);
+}
+
+static void
+atspi_text_reader_class_init (AtspiTextReaderClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+  object_class->finalize = atspi_text_reader_finalize;
+}
+
+/**
+ * atspi_text_reader_new:
+ * @text: the #AtspiText object to read.
+ * @start_offset: a #gint indicating the offset of the first character
+ *        to read.
+ * @end_offset: a #gint indicating the offset past the last character
+ *        to read, or -1 to read up to the end of the text.
+ * @chunk_size: the number of characters to fetch per chunk, or 0 for
+ *        a default.
+ *
+ * Creates a reader that retrieves the text of @text in chunks, so that
+ * a large text can be processed as it arrives, with bounded memory.
+ * While the caller processes a chunk, the next one is already being
+ * fetched.
+ *
+ * Returns: (transfer full): a new #AtspiTextReader.
+ **/
+AtspiTextReader *
+atspi_text_reader_new (AtspiText *text,
+                       gint start_offset,
+                       gint end_offset,
+                       gint chunk_size)
+{
+  AtspiTextReader *reader;
+
+  g_return_val_if_fail (text != NULL, NULL);
+
+  reader = g_object_new (ATSPI_TYPE_TEXT_READER, NULL);
+  reader->text = g_object_ref (text);
+  reader->offset = MAX (start_offset, 0);
+  reader->end_offset = end_offset;
+  reader->chunk_size = (chunk_size > 0 ? chunk_size : DEFAULT_CHUNK_SIZE);
+  return reader;
+}
+
+static DBusMessage *
+new_get_text_call (AtspiTextReader *reader, gint offset)
+{
+  dbus_int32_t d_start_offset = offset;
+  dbus_int32_t d_end_offset = MIN (offset + reader->chunk_size,
+                                   reader->end_offset);
+
+  return _atspi_dbus_new_method_call (reader->text, atspi_interface_text,
+                                      "GetText", "ii", d_start_offset,
+                                      d_end_offset);
+}
+
+/**
+ * atspi_text_reader_read:
+ * @reader: the #AtspiTextReader to read from.
+ * @start_offset: (out) (optional): the offset of the first character
+ *        of the returned chunk.
+ * @end_offset: (out) (optional): the offset past the last character
+ *        of the returned chunk.
+ *
+ * Gets the next chunk of text. The string is not copied out of the
+ * underlying message; it remains valid until the next call to
+ * #atspi_text_reader_read or until @reader is finalized.
+ *
+ * Returns: (transfer none) (nullable): the text of the next chunk, or
+ *          %NULL when the end has been reached or on error.
+ **/
+const gchar *
+atspi_text_reader_read (AtspiTextReader *reader,
+                        gint *start_offset,
+                        gint *end_offset,
+                        GError **error)
+{
+  AtspiApplication *app;
+  const char *str = NULL;
+  gint chunk_end;
+
+  g_return_val_if_fail (ATSPI_IS_TEXT_READER (reader), NULL);
+
+  if (reader->chunk)
+  {
+    dbus_message_unref (reader->chunk);
+    reader->chunk = NULL;
+  }
+
+  if (reader->end_offset < 0)
+  {
+    GError *tmp_error = NULL;
+
+    reader->end_offset = atspi_text_get_character_count (reader->text,
+                                                         &tmp_error);
+    if (tmp_error)
+    {
+      reader->end_offset = -1;
+      g_propagate_error (error, tmp_error);
+      return NULL;
+    }
+  }
+
+  if (reader->offset >= reader->end_offset)
+    return NULL;
+
+  app = ATSPI_OBJECT (reader->text)->app;
+  if (reader->pending)
+  {
+    reader->chunk = _atspi_dbus_pending_call_finish (app, reader->pending,
+                                                     error);
+    reader->pending = NULL;
+  }
+  else
+  {
+    dbus_int32_t d_start_offset = reader->offset;
+    dbus_int32_t d_end_offset = MIN (reader->offset + reader->chunk_size,
+                                     reader->end_offset);
+
+    reader->chunk = _atspi_dbus_call_partial (reader->text,
+                                              atspi_interface_text,
+                                              "GetText", error, "ii",
+                                              d_start_offset, d_end_offset);
+  }
+
+  if (!reader->chunk)
+    return NULL;
+
+  if (!dbus_message_get_args (reader->chunk, NULL, DBUS_TYPE_STRING, &str,
+                              DBUS_TYPE_INVALID))
+  {
+    g_warning ("at-spi: Expected message signature s but got %s at %s line %d", dbus_message_get_signature (reader->chunk), __FILE__, __LINE__);
+    dbus_message_unref (reader->chunk);
+    reader->chunk = NULL;
+    return NULL;
+  }
+
+  chunk_end = MIN (reader->offset + reader->chunk_size, reader->end_offset);
+  if (start_offset)
+    *start_offset = reader->offset;
+  if (end_offset)
+    *end_offset = chunk_end;
+  reader->offset = chunk_end;
+
+  /* Have the next chunk on its way while the caller handles this one */
+  if (reader->offset < reader->end_offset)
+  {
+    DBusMessage *message = new_get_text_call (reader, reader->offset);
+    reader->pending = _atspi_dbus_send_with_reply (app, message);
+  }
+
+  return str;
+}
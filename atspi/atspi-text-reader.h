@@ -0,0 +1,67 @@
+/*
+ * AT-SPI - Assistive Technology Service Provider Interface
+ * (Gnome Accessibility Project; http://developer.gnome.org/projects/gap)
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifndef _ATSPI_TEXT_READER_H_
+#define _ATSPI_TEXT_READER_H_
+
+#include "glib-object.h"
+
+#include <dbus/dbus.h>
+
+#include "atspi-types.h"
+
+G_BEGIN_DECLS
+
+#define ATSPI_TYPE_TEXT_READER                    (atspi_text_reader_get_type ())
+#define ATSPI_TEXT_READER(obj)                    (G_TYPE_CHECK_INSTANCE_CAST ((obj), ATSPI_TYPE_TEXT_READER, AtspiTextReader))
+#define ATSPI_TEXT_READER_CLASS(klass)            (G_TYPE_CHECK_CLASS_CAST ((klass), ATSPI_TYPE_TEXT_READER, AtspiTextReaderClass))
+#define ATSPI_IS_TEXT_READER(obj)                 (G_TYPE_CHECK_INSTANCE_TYPE ((obj), ATSPI_TYPE_TEXT_READER))
+#define ATSPI_IS_TEXT_READER_CLASS(klass)         (G_TYPE_CHECK_CLASS_TYPE ((klass), ATSPI_TYPE_TEXT_READER))
+#define ATSPI_TEXT_READER_GET_CLASS(obj)          (G_TYPE_INSTANCE_GET_CLASS ((obj), ATSPI_TYPE_TEXT_READER, AtspiTextReaderClass))
+
+typedef struct _AtspiTextReader AtspiTextReader;
+struct _AtspiTextReader
+{
+  GObject parent;
+  AtspiText *text;
+  gint chunk_size;
+  gint offset;
+  gint end_offset;
+  DBusPendingCall *pending;
+  DBusMessage *chunk;
+};
+
+typedef struct _AtspiTextReaderClass AtspiTextReaderClass;
+struct _AtspiTextReaderClass
+{
+  GObjectClass parent_class;
+};
+
+GType atspi_text_reader_get_type (void);
+
+AtspiTextReader *
+atspi_text_reader_new (AtspiText *text, gint start_offset, gint end_offset, gint chunk_size);
+
+const gchar *
+atspi_text_reader_read (AtspiTextReader *reader, gint *start_offset, gint *end_offset, GError **error);
+
+G_END_DECLS
+
+#endif	/* _ATSPI_TEXT_READER_H_ */
@@ -64,6 +64,37 @@ atspi_text_range_free (AtspiTextRange *range)
 G_DEFINE_BOXED_TYPE (AtspiTextRange, atspi_text_range, atspi_text_range_copy,
                      atspi_text_range_free)
 
+static AtspiTextAttributeRuns *
+atspi_text_attribute_runs_copy (AtspiTextAttributeRuns *src)
+{
+  AtspiTextAttributeRuns *dst = g_new (AtspiTextAttributeRuns, 1);
+
+  dst->runs = g_array_ref (src->runs);
+  dst->attribute_sets = g_ptr_array_ref (src->attribute_sets);
+  return dst;
+}
+
+/**
+ * atspi_text_attribute_runs_free:
+ * @runs: the #AtspiTextAttributeRuns to free.
+ *
+ * Frees an #AtspiTextAttributeRuns returned by
+ * #atspi_text_get_attribute_runs.
+ **/
+void
+atspi_text_attribute_runs_free (AtspiTextAttributeRuns *runs)
+{
+  if (!runs)
+    return;
+  g_array_unref (runs->runs);
+  g_ptr_array_unref (runs->attribute_sets);
+  g_free (runs);
+}
+
+G_DEFINE_BOXED_TYPE (AtspiTextAttributeRuns, atspi_text_attribute_runs,
+                     atspi_text_attribute_runs_copy,
+                     atspi_text_attribute_runs_free)
+
 /**
  * atspi_text_get_character_count:
  * @obj: a pointer to the #AtspiText object to query.
@@ -278,6 +309,301 @@ atspi_text_get_attribute_run (AtspiText *obj,
   return ret;
 }
 
+/* Number of GetAttributeRun calls pipelined per round */
+#define ATTRIBUTE_RUN_PROBES 32
+
+typedef struct
+{
+  GHashTable *index;
+  GPtrArray *sets;
+  GString *key;
+  GArray *pairs;
+} AttributeSetInterner;
+
+static gint
+compare_attribute_pairs (gconstpointer a, gconstpointer b)
+{
+  return strcmp (*(const char **) a, *(const char **) b);
+}
+
+/*
+ * Returns the index in interner->sets of the attribute set held in
+ * @iter (an a{ss}). The set is reduced to a canonical, length-prefixed
+ * key first, so a hash table is only built the first time a given set
+ * is seen.
+ */
+static guint
+intern_attribute_set (AttributeSetInterner *interner, DBusMessageIter *iter)
+{
+  DBusMessageIter iter_array, iter_dict;
+  GHashTable *set;
+  gpointer index;
+  guint i;
+
+  g_array_set_size (interner->pairs, 0);
+  dbus_message_iter_recurse (iter, &iter_array);
+  while (dbus_message_iter_get_arg_type (&iter_array) != DBUS_TYPE_INVALID)
+  {
+    const char *pair[2];
+
+    dbus_message_iter_recurse (&iter_array, &iter_dict);
+    dbus_message_iter_get_basic (&iter_dict, &pair[0]);
+    dbus_message_iter_next (&iter_dict);
+    dbus_message_iter_get_basic (&iter_dict, &pair[1]);
+    g_array_append_vals (interner->pairs, pair, 1);
+    dbus_message_iter_next (&iter_array);
+  }
+  g_array_sort (interner->pairs, compare_attribute_pairs);
+
+  g_string_truncate (interner->key, 0);
+  for (i = 0; i < interner->pairs->len * 2; i++)
+  {
+    const char *str = ((const char **) interner->pairs->data) [i];
+    g_string_append_printf (interner->key, "%" G_GSIZE_FORMAT ":%s",
+                            strlen (str), str);
+  }
+
+  index = g_hash_table_lookup (interner->index, interner->key->str);
+  if (index)
+    return GPOINTER_TO_UINT (index) - 1;
+
+  set = g_hash_table_new_full (g_str_hash, g_str_equal,
+                               _atspi_string_pool_release,
+                               _atspi_string_pool_release);
+  for (i = 0; i < interner->pairs->len; i++)
+  {
+    const char **pair = &((const char **) interner->pairs->data) [i * 2];
+    g_hash_table_insert (set, _atspi_string_pool_intern (pair[0]),
+                         _atspi_string_pool_intern (pair[1]));
+  }
+  g_ptr_array_add (interner->sets, set);
+  g_hash_table_insert (interner->index, g_strdup (interner->key->str),
+                       GUINT_TO_POINTER (interner->sets->len));
+  return interner->sets->len - 1;
+}
+
+/*
+ * Picks up to ATTRIBUTE_RUN_PROBES offsets not yet covered by @runs.
+ * Every gap is probed at its start, which guarantees progress; the
+ * remaining probes are spread over the gaps in proportion to their
+ * length, so that a long text is split up in a few rounds.
+ */
+static gint
+get_attribute_run_probes (GArray *runs, gint start_offset, gint end_offset,
+                          gint *probes)
+{
+  AtspiRange gaps[ATTRIBUTE_RUN_PROBES];
+  gint n_gaps = 0, n_probes = 0, extra;
+  gint64 total = 0;
+  gint cursor = start_offset;
+  guint i;
+
+  for (i = 0; i <= runs->len && n_gaps < ATTRIBUTE_RUN_PROBES; i++)
+  {
+    gint next = (i < runs->len ?
+                 g_array_index (runs, AtspiTextAttributeRun, i).start_offset :
+                 end_offset);
+    if (next > cursor)
+    {
+      gaps[n_gaps].start_offset = cursor;
+      gaps[n_gaps].end_offset = next;
+      total += next - cursor;
+      n_gaps++;
+    }
+    if (i < runs->len)
+      cursor = g_array_index (runs, AtspiTextAttributeRun, i).end_offset;
+  }
+
+  extra = ATTRIBUTE_RUN_PROBES - n_gaps;
+  for (i = 0; i < n_gaps; i++)
+  {
+    gint length = gaps[i].end_offset - gaps[i].start_offset;
+    gint k = 1 + (gint) (extra * (gint64) length / total);
+    gint j;
+
+    k = MIN (k, length);
+    for (j = 0; j < k; j++)
+      probes[n_probes++] = gaps[i].start_offset +
+                           (gint) ((gint64) j * length / k);
+  }
+  return n_probes;
+}
+
+/*
+ * Adds the run [@start, @end) reported for @offset, clipped to the gap
+ * that contains @offset so that runs never overlap, even if the
+ * application reports inconsistent boundaries.
+ */
+static void
+add_attribute_run (GArray *runs, gint range_start, gint range_end,
+                   gint offset, gint start, gint end, guint set)
+{
+  AtspiTextAttributeRun run;
+  guint lo = 0, hi = runs->len;
+
+  while (lo < hi)
+  {
+    guint mid = (lo + hi) / 2;
+    if (g_array_index (runs, AtspiTextAttributeRun, mid).start_offset <= offset)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+
+  if (lo > 0)
+  {
+    AtspiTextAttributeRun *prev = &g_array_index (runs, AtspiTextAttributeRun, lo - 1);
+    if (prev->end_offset > offset)
+      return;	/* already found by another probe */
+    range_start = prev->end_offset;
+  }
+  if (lo < runs->len)
+    range_end = g_array_index (runs, AtspiTextAttributeRun, lo).start_offset;
+
+  if (end <= offset)
+    end = offset + 1;
+  run.start_offset = CLAMP (start, range_start, offset);
+  run.end_offset = CLAMP (end, offset + 1, range_end);
+  run.attribute_set = set;
+  g_array_insert_vals (runs, lo, &run, 1);
+}
+
+/**
+ * atspi_text_get_attribute_runs:
+ * @obj: a pointer to the #AtspiText object to query.
+ * @start_offset: a #gint indicating the start of the range to enumerate.
+ * @end_offset: a #gint indicating the first character past the range,
+ *              or -1 for the end of the text.
+ * @include_defaults: a #bool that, when set as #FALSE, indicates that
+ *              only attributes explicitly set on each run should be
+ *              returned, omitting those inherited from the default values.
+ *
+ * Gets all attribute runs over a range of text of an #AtspiText object.
+ * The underlying requests are pipelined, so that the whole range costs
+ * a handful of round trips rather than one per run. Identical attribute
+ * sets are only returned once; each run refers to its set by index.
+ * Adjacent runs with identical attributes are merged. The attribute sets
+ * share their strings and must not be modified.
+ *
+ * Returns: (transfer full): an #AtspiTextAttributeRuns whose @runs
+ *          covers the range in order, or %NULL on error.
+ **/
+AtspiTextAttributeRuns *
+atspi_text_get_attribute_runs (AtspiText *obj,
+                               gint start_offset,
+                               gint end_offset,
+                               gboolean include_defaults,
+                               GError **error)
+{
+  AtspiTextAttributeRuns *ret;
+  AttributeSetInterner interner;
+  DBusMessage *messages[ATTRIBUTE_RUN_PROBES];
+  DBusMessage *replies[ATTRIBUTE_RUN_PROBES];
+  gint probes[ATTRIBUTE_RUN_PROBES];
+  gint n_probes, i;
+  guint j;
+  gboolean failed = FALSE;
+
+  g_return_val_if_fail (obj != NULL, NULL);
+
+  if (end_offset < 0)
+  {
+    GError *tmp_error = NULL;
+
+    end_offset = atspi_text_get_character_count (obj, &tmp_error);
+    if (tmp_error)
+    {
+      g_propagate_error (error, tmp_error);
+      return NULL;
+    }
+  }
+  start_offset = MAX (start_offset, 0);
+
+  ret = g_new (AtspiTextAttributeRuns, 1);
+  ret->runs = g_array_new (FALSE, FALSE, sizeof (AtspiTextAttributeRun));
+  ret->attribute_sets = g_ptr_array_new_with_free_func ((GDestroyNotify) g_hash_table_unref);
+  interner.index = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                          (GDestroyNotify) g_free, NULL);
+  interner.sets = ret->attribute_sets;
+  interner.key = g_string_new (NULL);
+  interner.pairs = g_array_new (FALSE, FALSE, 2 * sizeof (const char *));
+
+  while (!failed &&
+         (n_probes = get_attribute_run_probes (ret->runs, start_offset,
+                                               end_offset, probes)) > 0)
+  {
+    for (i = 0; i < n_probes; i++)
+    {
+      dbus_int32_t d_offset = probes[i];
+      messages[i] = _atspi_dbus_new_method_call (obj, atspi_interface_text,
+                                                 "GetAttributeRun", "ib",
+                                                 d_offset, include_defaults);
+    }
+    if (!_atspi_dbus_send_batch (ATSPI_OBJECT (obj)->app, messages, replies,
+                                 n_probes, error))
+    {
+      failed = TRUE;
+      break;
+    }
+
+    for (i = 0; i < n_probes; i++)
+    {
+      DBusMessageIter iter;
+      dbus_int32_t d_start_offset, d_end_offset;
+      guint set;
+
+      if (!replies[i])
+      {
+        failed = TRUE;
+        continue;
+      }
+      if (strcmp (dbus_message_get_signature (replies[i]), "a{ss}ii") != 0)
+      {
+        g_warning ("at-spi: Expected message signature a{ss}ii but got %s at %s line %d", dbus_message_get_signature (replies[i]), __FILE__, __LINE__);
+        dbus_message_unref (replies[i]);
+        failed = TRUE;
+        continue;
+      }
+
+      dbus_message_iter_init (replies[i], &iter);
+      set = intern_attribute_set (&interner, &iter);
+      dbus_message_iter_next (&iter);
+      dbus_message_iter_get_basic (&iter, &d_start_offset);
+      dbus_message_iter_next (&iter);
+      dbus_message_iter_get_basic (&iter, &d_end_offset);
+      add_attribute_run (ret->runs, start_offset, end_offset, probes[i],
+                         d_start_offset, d_end_offset, set);
+      dbus_message_unref (replies[i]);
+    }
+  }
+
+  g_hash_table_unref (interner.index);
+  g_string_free (interner.key, TRUE);
+  g_array_free (interner.pairs, TRUE);
+
+  if (failed)
+  {
+    atspi_text_attribute_runs_free (ret);
+    return NULL;
+  }
+
+  for (i = 0, j = 1; j < ret->runs->len; j++)
+  {
+    AtspiTextAttributeRun *last = &g_array_index (ret->runs, AtspiTextAttributeRun, i);
+    AtspiTextAttributeRun *run = &g_array_index (ret->runs, AtspiTextAttributeRun, j);
+
+    if (run->attribute_set == last->attribute_set &&
+        run->start_offset == last->end_offset)
+      last->end_offset = run->end_offset;
+    else
+      g_array_index (ret->runs, AtspiTextAttributeRun, ++i) = *run;
+  }
+  if (ret->runs->len > 0)
+    g_array_set_size (ret->runs, i + 1);
+
+  return ret;
+}
+
 /**
  * atspi_text_get_attribute_value: (rename-to atspi_text_get_text_attribute_value)
  * @obj: a pointer to the #AtspiText object to query.
@@ -647,6 +973,309 @@ atspi_text_get_character_extents (AtspiText *obj,
   return atspi_rect_copy (&ret);
 }
 
+/* Upper bound on the number of character extents cached per accessible */
+#define MAX_CACHED_CHARACTER_EXTENTS 4096
+
+static GQuark quark_no_extents_for_range = 0;
+
+static AtspiCharacterExtentsCache *
+get_character_extents_cache (AtspiAccessible *accessible, AtspiCoordType type)
+{
+  AtspiAccessibleExtras *extras;
+  AtspiCharacterExtentsCache *cache;
+
+  if (type >= ATSPI_COORD_TYPE_COUNT)
+    return NULL;
+
+  extras = _atspi_accessible_get_extras (accessible);
+  cache = &extras->character_extents[type];
+  if (cache->extents && cache->layout_version != extras->layout_version)
+  {
+    g_array_free (cache->extents, TRUE);
+    cache->extents = NULL;
+  }
+  return cache;
+}
+
+/*
+ * Stores extents fetched while the layout was at @layout_version. They
+ * are dropped if the text or its layout changed in the meantime, since
+ * events are dispatched while waiting for the replies.
+ */
+static void
+cache_character_extents (AtspiAccessible *accessible,
+                         AtspiCoordType type,
+                         guint layout_version,
+                         gint start_offset,
+                         const AtspiRect *rects,
+                         gint n_rects)
+{
+  AtspiCharacterExtentsCache *cache;
+  gint end_offset = start_offset + n_rects;
+
+  if (n_rects <= 0 || n_rects > MAX_CACHED_CHARACTER_EXTENTS ||
+      layout_version != _atspi_accessible_get_extras (accessible)->layout_version)
+    return;
+
+  cache = get_character_extents_cache (accessible, type);
+  if (!cache)
+    return;
+
+  if (cache->extents)
+  {
+    gint cached_start = cache->start_offset;
+    gint cached_end = cached_start + cache->extents->len;
+
+    /* Extend the cached span if the new one touches it */
+    if (start_offset <= cached_end && end_offset >= cached_start &&
+        MAX (end_offset, cached_end) - MIN (start_offset, cached_start) <=
+        MAX_CACHED_CHARACTER_EXTENTS)
+    {
+      if (start_offset < cached_start)
+      {
+        g_array_prepend_vals (cache->extents, rects,
+                              cached_start - start_offset);
+        cache->start_offset = start_offset;
+      }
+      if (end_offset > cached_end)
+        g_array_append_vals (cache->extents, rects + (cached_end - start_offset),
+                             end_offset - cached_end);
+      return;
+    }
+    g_array_free (cache->extents, TRUE);
+  }
+
+  cache->extents = g_array_sized_new (FALSE, FALSE, sizeof (AtspiRect), n_rects);
+  g_array_append_vals (cache->extents, rects, n_rects);
+  cache->start_offset = start_offset;
+  cache->layout_version = layout_version;
+}
+
+static gboolean
+demarshal_extents_array (DBusMessage *reply, AtspiRect *rects, gint n_rects)
+{
+  DBusMessageIter iter, iter_array, iter_struct;
+  gint i = 0;
+
+  dbus_message_iter_init (reply, &iter);
+  dbus_message_iter_recurse (&iter, &iter_array);
+  while (dbus_message_iter_get_arg_type (&iter_array) != DBUS_TYPE_INVALID)
+  {
+    dbus_int32_t d_x, d_y, d_width, d_height;
+
+    if (i == n_rects)
+      return FALSE;
+    dbus_message_iter_recurse (&iter_array, &iter_struct);
+    dbus_message_iter_get_basic (&iter_struct, &d_x);
+    dbus_message_iter_next (&iter_struct);
+    dbus_message_iter_get_basic (&iter_struct, &d_y);
+    dbus_message_iter_next (&iter_struct);
+    dbus_message_iter_get_basic (&iter_struct, &d_width);
+    dbus_message_iter_next (&iter_struct);
+    dbus_message_iter_get_basic (&iter_struct, &d_height);
+    rects[i].x = d_x;
+    rects[i].y = d_y;
+    rects[i].width = d_width;
+    rects[i].height = d_height;
+    i++;
+    dbus_message_iter_next (&iter_array);
+  }
+  return (i == n_rects);
+}
+
+/*
+ * Fetches the extents of the characters in [@start_offset, @end_offset)
+ * into @rects. Applications implementing GetCharacterExtentsForRange
+ * answer in one call; for the others, GetCharacterExtents is pipelined
+ * over every offset. Applications that do not know the former are
+ * remembered so that it is not tried again.
+ */
+static gboolean
+fetch_character_extents (AtspiText *obj,
+                         gint start_offset,
+                         gint end_offset,
+                         AtspiCoordType type,
+                         AtspiRect *rects,
+                         GError **error)
+{
+  AtspiApplication *app = ATSPI_OBJECT (obj)->app;
+  gint n_rects = end_offset - start_offset;
+  dbus_uint32_t d_type = type;
+  DBusMessage **messages, **replies;
+  gboolean ret = TRUE;
+  gint i;
+
+  if (n_rects <= 0)
+    return TRUE;
+
+  if (!quark_no_extents_for_range)
+    quark_no_extents_for_range = g_quark_from_static_string ("atspi-no-extents-for-range");
+
+  if (app && !g_object_get_qdata (G_OBJECT (app), quark_no_extents_for_range))
+  {
+    dbus_int32_t d_start_offset = start_offset, d_end_offset = end_offset;
+    DBusMessage *reply;
+    GError *local_error = NULL;
+    gchar *error_name;
+
+    reply = _atspi_dbus_call_partial_with_error_name (obj, atspi_interface_text,
+                                                      "GetCharacterExtentsForRange",
+                                                      &error_name, &local_error,
+                                                      "iiu", d_start_offset,
+                                                      d_end_offset, d_type);
+    if (reply)
+    {
+      ret = (strcmp (dbus_message_get_signature (reply), "a(iiii)") == 0 &&
+             demarshal_extents_array (reply, rects, n_rects));
+      dbus_message_unref (reply);
+      if (ret)
+        return TRUE;
+    }
+    else if (!g_strcmp0 (error_name, DBUS_ERROR_UNKNOWN_METHOD))
+    {
+      /* Only a missing method is remembered; timeouts and defunct
+       * objects say nothing about the application */
+      g_object_set_qdata (G_OBJECT (app), quark_no_extents_for_range,
+                          GINT_TO_POINTER (TRUE));
+    }
+    else if (local_error)
+    {
+      /* The per-character calls would fail the same way */
+      g_propagate_error (error, local_error);
+      g_free (error_name);
+      return FALSE;
+    }
+    g_clear_error (&local_error);
+    g_free (error_name);
+  }
+
+  messages = g_new (DBusMessage *, n_rects);
+  replies = g_new (DBusMessage *, n_rects);
+  for (i = 0; i < n_rects; i++)
+  {
+    dbus_int32_t d_offset = start_offset + i;
+    messages[i] = _atspi_dbus_new_method_call (obj, atspi_interface_text,
+                                               "GetCharacterExtents", "iu",
+                                               d_offset, d_type);
+  }
+
+  ret = _atspi_dbus_send_batch (app, messages, replies, n_rects, error);
+  for (i = 0; i < n_rects; i++)
+  {
+    dbus_int32_t d_x, d_y, d_width, d_height;
+
+    if (!replies[i])
+    {
+      ret = FALSE;
+      continue;
+    }
+    if (ret && dbus_message_get_args (replies[i], NULL,
+                                      DBUS_TYPE_INT32, &d_x,
+                                      DBUS_TYPE_INT32, &d_y,
+                                      DBUS_TYPE_INT32, &d_width,
+                                      DBUS_TYPE_INT32, &d_height,
+                                      DBUS_TYPE_INVALID))
+    {
+      rects[i].x = d_x;
+      rects[i].y = d_y;
+      rects[i].width = d_width;
+      rects[i].height = d_height;
+    }
+    else
+      ret = FALSE;
+    dbus_message_unref (replies[i]);
+  }
+
+  g_free (messages);
+  g_free (replies);
+  return ret;
+}
+
+/**
+ * atspi_text_get_character_extents_for_range:
+ * @obj: a pointer to the #AtspiText object on which to operate.
+ * @start_offset: a #gint indicating the offset of the first character
+ *        whose extents are requested.
+ * @end_offset: a #gint indicating the offset past the last character
+ *        whose extents are requested, or -1 for the end of the text.
+ * @type: an #AccessibleCoordType indicating the coordinate system to use
+ *        for the returned values.
+ *
+ * Gets the bounding box of the glyph of every character in a range, in
+ * one call. The results are cached until the text or its bounds change,
+ * so that subsequent requests for nearby offsets only fetch the
+ * characters that are not known yet.
+ *
+ * Returns: (element-type AtspiRect) (transfer full): a #GArray holding
+ *          one #AtspiRect per character, or %NULL on error.
+ **/
+GArray *
+atspi_text_get_character_extents_for_range (AtspiText *obj,
+                                            gint start_offset,
+                                            gint end_offset,
+                                            AtspiCoordType type,
+                                            GError **error)
+{
+  AtspiAccessible *accessible;
+  AtspiCharacterExtentsCache *cache;
+  AtspiRect *rects;
+  GArray *ret;
+  guint layout_version;
+  gint n_rects;
+  gint lo, hi;
+
+  g_return_val_if_fail (obj != NULL, NULL);
+
+  if (end_offset < 0)
+  {
+    GError *tmp_error = NULL;
+
+    end_offset = atspi_text_get_character_count (obj, &tmp_error);
+    if (tmp_error)
+    {
+      g_propagate_error (error, tmp_error);
+      return NULL;
+    }
+  }
+  start_offset = MAX (start_offset, 0);
+  n_rects = MAX (end_offset - start_offset, 0);
+  end_offset = start_offset + n_rects;
+
+  ret = g_array_sized_new (FALSE, FALSE, sizeof (AtspiRect), n_rects);
+  g_array_set_size (ret, n_rects);
+  rects = (AtspiRect *) ret->data;
+
+  accessible = ATSPI_ACCESSIBLE (obj);
+  /* Allocated before reading the version, so that layout changes during
+   * the fetch are seen */
+  layout_version = _atspi_accessible_get_extras (accessible)->layout_version;
+  cache = get_character_extents_cache (accessible, type);
+  lo = hi = end_offset;
+  if (cache && cache->extents)
+  {
+    lo = MAX (start_offset, cache->start_offset);
+    hi = MIN (end_offset, cache->start_offset + (gint) cache->extents->len);
+    if (lo < hi)
+      memcpy (rects + (lo - start_offset),
+              &g_array_index (cache->extents, AtspiRect, lo - cache->start_offset),
+              (hi - lo) * sizeof (AtspiRect));
+    else
+      lo = hi = end_offset;
+  }
+
+  if (!fetch_character_extents (obj, start_offset, lo, type, rects, error) ||
+      !fetch_character_extents (obj, hi, end_offset, type,
+                                rects + (hi - start_offset), error))
+  {
+    g_array_free (ret, TRUE);
+    return NULL;
+  }
+
+  cache_character_extents (accessible, type, layout_version, start_offset,
+                           rects, n_rects);
+  return ret;
+}
+
 /**
  * atspi_text_get_offset_at_point:
  * @obj: a pointer to the #AtspiText object on which to operate.
@@ -892,6 +1521,312 @@ atspi_text_set_selection (AtspiText *obj,
   return retval;
 }
 
+/* Maximum size, in bytes, of a block of the text mirror index */
+#define TEXT_MIRROR_BLOCK_SIZE 4096
+/* Reads that overlap a text change are retried this many times */
+#define TEXT_MIRROR_MAX_ATTEMPTS 3
+
+typedef struct
+{
+  gint byte_offset;
+  gint char_offset;
+} TextMirrorBlock;
+
+/*
+ * A client-side copy of the contents of a text object, used for
+ * searching. The blocks index the text at every line start (or every
+ * TEXT_MIRROR_BLOCK_SIZE bytes for long lines), mapping byte offsets to
+ * character offsets. The index is only built as far as a search needs
+ * it, and is kept until the text changes. The last compiled pattern is
+ * kept as well.
+ */
+struct _AtspiTextMirror
+{
+  guint text_version;
+  GString *text;
+  GArray *blocks;
+  gboolean indexed;
+  GRegex *regex;
+  gchar *pattern;
+  AtspiTextSearchFlags pattern_flags;
+};
+
+void
+_atspi_text_mirror_free (AtspiTextMirror *mirror)
+{
+  g_string_free (mirror->text, TRUE);
+  g_array_free (mirror->blocks, TRUE);
+  if (mirror->regex)
+    g_regex_unref (mirror->regex);
+  g_free (mirror->pattern);
+  g_free (mirror);
+}
+
+static AtspiTextMirror *
+get_text_mirror (AtspiText *obj, GError **error)
+{
+  AtspiAccessibleExtras *extras = _atspi_accessible_get_extras (ATSPI_ACCESSIBLE (obj));
+  AtspiTextMirror *mirror;
+  AtspiTextReader *reader;
+  TextMirrorBlock block = { 0, 0 };
+  const gchar *chunk;
+  GError *tmp_error = NULL;
+  guint text_version;
+  gint attempt;
+
+  for (attempt = 0; ; attempt++)
+  {
+    text_version = extras->text_version;
+    if (extras->text_mirror && extras->text_mirror->text_version == text_version)
+      return extras->text_mirror;
+
+    mirror = g_new0 (AtspiTextMirror, 1);
+    mirror->text_version = text_version;
+    mirror->text = g_string_new (NULL);
+    mirror->blocks = g_array_new (FALSE, FALSE, sizeof (TextMirrorBlock));
+    g_array_append_val (mirror->blocks, block);
+
+    reader = atspi_text_reader_new (obj, 0, -1, 0);
+    while ((chunk = atspi_text_reader_read (reader, NULL, NULL, &tmp_error)))
+      g_string_append (mirror->text, chunk);
+    g_object_unref (reader);
+
+    if (tmp_error)
+    {
+      g_propagate_error (error, tmp_error);
+      _atspi_text_mirror_free (mirror);
+      return NULL;
+    }
+
+    /* The chunks straddle a change that arrived while reading */
+    if (extras->text_version == text_version)
+      break;
+    _atspi_text_mirror_free (mirror);
+    if (attempt + 1 == TEXT_MIRROR_MAX_ATTEMPTS)
+    {
+      g_set_error_literal (error, ATSPI_ERROR, ATSPI_ERROR_IPC,
+                           "The text kept changing while it was read");
+      return NULL;
+    }
+  }
+
+  /* Events dispatched while reading may have replaced the mirror */
+  if (extras->text_mirror)
+    _atspi_text_mirror_free (extras->text_mirror);
+  extras->text_mirror = mirror;
+  return mirror;
+}
+
+/*
+ * Extends the index of @mirror until it covers @byte_offset or
+ * @char_offset (pass -1 for the one not used).
+ */
+static void
+index_text_mirror (AtspiTextMirror *mirror, gint byte_offset, gint char_offset)
+{
+  TextMirrorBlock block;
+  const gchar *start = mirror->text->str;
+  const gchar *end = start + mirror->text->len;
+  const gchar *block_start, *p;
+
+  if (mirror->indexed)
+    return;
+
+  block = g_array_index (mirror->blocks, TextMirrorBlock,
+                         mirror->blocks->len - 1);
+  p = block_start = start + block.byte_offset;
+  while (block.byte_offset <= byte_offset || block.char_offset <= char_offset)
+  {
+    if (p >= end)
+    {
+      mirror->indexed = TRUE;
+      return;
+    }
+    p = g_utf8_next_char (p);
+    block.char_offset++;
+    if (p[-1] == '\n' || p - block_start >= TEXT_MIRROR_BLOCK_SIZE)
+    {
+      block.byte_offset = p - start;
+      g_array_append_val (mirror->blocks, block);
+      block_start = p;
+    }
+  }
+}
+
+/* Returns the index of the last block starting at or before the offset */
+static guint
+find_text_mirror_block (AtspiTextMirror *mirror, gboolean by_char, gint offset)
+{
+  guint lo = 0, hi = mirror->blocks->len;
+
+  while (hi - lo > 1)
+  {
+    guint mid = (lo + hi) / 2;
+    TextMirrorBlock *block = &g_array_index (mirror->blocks, TextMirrorBlock, mid);
+    if ((by_char ? block->char_offset : block->byte_offset) <= offset)
+      lo = mid;
+    else
+      hi = mid;
+  }
+  return lo;
+}
+
+static gint
+text_mirror_byte_offset (AtspiTextMirror *mirror, gint char_offset)
+{
+  TextMirrorBlock *block;
+  const gchar *p, *end = mirror->text->str + mirror->text->len;
+  gint n;
+
+  index_text_mirror (mirror, -1, char_offset);
+  block = &g_array_index (mirror->blocks, TextMirrorBlock,
+                          find_text_mirror_block (mirror, TRUE, char_offset));
+  p = mirror->text->str + block->byte_offset;
+  for (n = char_offset - block->char_offset; n > 0 && p < end; n--)
+    p = g_utf8_next_char (p);
+  return p - mirror->text->str;
+}
+
+static gint
+text_mirror_char_offset (AtspiTextMirror *mirror, gint byte_offset)
+{
+  TextMirrorBlock *block;
+
+  index_text_mirror (mirror, byte_offset, -1);
+  block = &g_array_index (mirror->blocks, TextMirrorBlock,
+                          find_text_mirror_block (mirror, FALSE, byte_offset));
+  return block->char_offset +
+         g_utf8_pointer_to_offset (mirror->text->str + block->byte_offset,
+                                   mirror->text->str + byte_offset);
+}
+
+static GRegex *
+get_text_mirror_regex (AtspiTextMirror *mirror,
+                       const gchar *pattern,
+                       AtspiTextSearchFlags flags,
+                       GError **error)
+{
+  GRegexCompileFlags compile_flags = G_REGEX_OPTIMIZE | G_REGEX_MULTILINE;
+  AtspiTextSearchFlags pattern_flags = flags & ~ATSPI_TEXT_SEARCH_BACKWARD;
+  gchar *escaped = NULL;
+
+  if (mirror->regex && mirror->pattern_flags == pattern_flags &&
+      !strcmp (mirror->pattern, pattern))
+    return mirror->regex;
+
+  if (flags & ATSPI_TEXT_SEARCH_CASE_INSENSITIVE)
+    compile_flags |= G_REGEX_CASELESS;
+  if (!(flags & ATSPI_TEXT_SEARCH_REGEX))
+    escaped = g_regex_escape_string (pattern, -1);
+
+  if (mirror->regex)
+    g_regex_unref (mirror->regex);
+  g_free (mirror->pattern);
+  mirror->pattern = g_strdup (pattern);
+  mirror->pattern_flags = pattern_flags;
+  mirror->regex = g_regex_new (escaped ? escaped : pattern, compile_flags,
+                               0, error);
+  g_free (escaped);
+  return mirror->regex;
+}
+
+/**
+ * atspi_text_find:
+ * @obj: a pointer to the #AtspiText object to search.
+ * @pattern: the text or regular expression to look for.
+ * @offset: a #gint indicating where to start the search. A forward
+ *        search finds the first match starting at or after @offset; a
+ *        backward search the last match starting before it. -1 stands
+ *        for the end of the text.
+ * @flags: #AtspiTextSearchFlags controlling the search.
+ *
+ * Searches the text of an #AtspiText object. The text is fetched once,
+ * in chunks, and kept on the client along with an index of its lines
+ * until the text changes, so that repeated searches on the same object
+ * neither fetch nor rescan the text.
+ *
+ * Returns: (nullable): an #AtspiRange holding the character offsets of
+ *          the match, or %NULL if there is none or on error.
+ **/
+AtspiRange *
+atspi_text_find (AtspiText *obj,
+                 const gchar *pattern,
+                 gint offset,
+                 AtspiTextSearchFlags flags,
+                 GError **error)
+{
+  AtspiTextMirror *mirror;
+  GRegex *regex;
+  GMatchInfo *match_info = NULL;
+  gint limit, match_start = -1, match_end = -1;
+  AtspiRange *ret;
+
+  g_return_val_if_fail (obj != NULL, NULL);
+  g_return_val_if_fail (pattern != NULL, NULL);
+
+  mirror = get_text_mirror (obj, error);
+  if (!mirror)
+    return NULL;
+
+  regex = get_text_mirror_regex (mirror, pattern, flags, error);
+  if (!regex)
+    return NULL;
+
+  limit = (offset < 0 ? mirror->text->len :
+           text_mirror_byte_offset (mirror, offset));
+
+  if (!(flags & ATSPI_TEXT_SEARCH_BACKWARD))
+  {
+    if (g_regex_match_full (regex, mirror->text->str, mirror->text->len,
+                            limit, 0, &match_info, NULL))
+      g_match_info_fetch_pos (match_info, 0, &match_start, &match_end);
+    g_match_info_free (match_info);
+  }
+  else
+  {
+    guint i;
+
+    /* Look for the last match within each block, going back from the
+     * one holding the limit; matches may extend past the block. */
+    index_text_mirror (mirror, limit, -1);
+    i = find_text_mirror_block (mirror, FALSE, MAX (limit - 1, 0));
+    while (match_start < 0 && limit > 0)
+    {
+      gint block_start = g_array_index (mirror->blocks, TextMirrorBlock, i).byte_offset;
+      gint block_end = (i + 1 < mirror->blocks->len ?
+                        g_array_index (mirror->blocks, TextMirrorBlock, i + 1).byte_offset :
+                        mirror->text->len);
+
+      block_end = MIN (block_end, limit);
+      g_regex_match_full (regex, mirror->text->str, mirror->text->len,
+                          block_start, 0, &match_info, NULL);
+      while (g_match_info_matches (match_info))
+      {
+        gint start, end;
+
+        g_match_info_fetch_pos (match_info, 0, &start, &end);
+        if (start >= block_end)
+          break;
+        match_start = start;
+        match_end = end;
+        g_match_info_next (match_info, NULL);
+      }
+      g_match_info_free (match_info);
+
+      if (i-- == 0)
+        break;
+    }
+  }
+
+  if (match_start < 0)
+    return NULL;
+
+  ret = g_new (AtspiRange, 1);
+  ret->start_offset = text_mirror_char_offset (mirror, match_start);
+  ret->end_offset = text_mirror_char_offset (mirror, match_end);
+  return ret;
+}
+
 static void
 atspi_text_base_init (AtspiText *klass)
 {
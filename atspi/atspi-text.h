@@ -68,6 +68,28 @@ struct _AtspiTextRange
  */
 #define	ATSPI_TYPE_TEXT_RANGE atspi_text_range_get_type ()
 
+typedef struct _AtspiTextAttributeRun AtspiTextAttributeRun;
+struct _AtspiTextAttributeRun
+{
+  gint start_offset;
+  gint end_offset;
+  guint attribute_set;
+};
+
+typedef struct _AtspiTextAttributeRuns AtspiTextAttributeRuns;
+struct _AtspiTextAttributeRuns
+{
+  GArray *runs;
+  GPtrArray *attribute_sets;
+};
+
+/**
+ * ATSPI_TYPE_TEXT_ATTRIBUTE_RUNS:
+ * 
+ * The #GType for a boxed type holding the attribute runs of a text block.
+ */
+#define	ATSPI_TYPE_TEXT_ATTRIBUTE_RUNS atspi_text_attribute_runs_get_type ()
+
 #define ATSPI_TYPE_TEXT                    (atspi_text_get_type ())
 #define ATSPI_IS_TEXT(obj)                 G_TYPE_CHECK_INSTANCE_TYPE ((obj), ATSPI_TYPE_TEXT)
 #define ATSPI_TEXT(obj)                    G_TYPE_CHECK_INSTANCE_CAST ((obj), ATSPI_TYPE_TEXT, AtspiText)
@@ -83,6 +105,10 @@ struct _AtspiText
 
 GType atspi_text_range_get_type ();
 
+GType atspi_text_attribute_runs_get_type ();
+
+void atspi_text_attribute_runs_free (AtspiTextAttributeRuns *runs);
+
 gint atspi_text_get_character_count (AtspiText *obj, GError **error);
 
 gchar * atspi_text_get_text (AtspiText *obj, gint start_offset, gint end_offset, GError **error);
@@ -97,6 +123,8 @@ GHashTable *atspi_text_get_text_attributes (AtspiText *obj, gint offset, gint *s
 
 GHashTable *atspi_text_get_attribute_run (AtspiText *obj, gint offset, gboolean include_defaults, gint *start_offset, gint *end_offset, GError **error);
 
+AtspiTextAttributeRuns *atspi_text_get_attribute_runs (AtspiText *obj, gint start_offset, gint end_offset, gboolean include_defaults, GError **error);
+
 #ifndef ATSPI_DISABLE_DEPRECATED
 gchar * atspi_text_get_attribute_value (AtspiText *obj, gint offset, gchar *attribute_name, GError **error);
 #endif
@@ -121,6 +149,8 @@ guint atspi_text_get_character_at_offset (AtspiText *obj, gint offset, GError **
 
 AtspiRect * atspi_text_get_character_extents (AtspiText *obj, gint offset, AtspiCoordType type, GError **error);
 
+GArray * atspi_text_get_character_extents_for_range (AtspiText *obj, gint start_offset, gint end_offset, AtspiCoordType type, GError **error);
+
 gint atspi_text_get_offset_at_point (AtspiText *obj, gint x, gint y, AtspiCoordType type, GError **error);
 
 AtspiRect * atspi_text_get_range_extents (AtspiText *obj, gint start_offset, gint end_offset, AtspiCoordType type, GError **error);
@@ -137,6 +167,8 @@ gboolean atspi_text_remove_selection (AtspiText *obj, gint selection_num, GError
 
 gboolean atspi_text_set_selection (AtspiText *obj, gint selection_num, gint start_offset, gint end_offset, GError **error);
 
+AtspiRange * atspi_text_find (AtspiText *obj, const gchar *pattern, gint offset, AtspiTextSearchFlags flags, GError **error);
+
 G_END_DECLS
 
 #endif	/* _ATSPI_TEXT_H_ */
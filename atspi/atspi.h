@@ -44,10 +44,12 @@
 #include "atspi-registry.h"
 #include "atspi-relation.h"
 #include "atspi-selection.h"
+#include "atspi-snapshot.h"
 #include "atspi-stateset.h"
 #include "atspi-table.h"
 #include "atspi-table-cell.h"
 #include "atspi-text.h"
+#include "atspi-text-reader.h"
 #include "atspi-value.h"
 
 #include "atspi-gmain.h"
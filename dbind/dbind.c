@@ -28,6 +28,7 @@
 #include "atspi/atspi-gmain.h"
 
 static int dbind_timeout = -1;
+static DBindTraceFunc dbind_trace_func = NULL;
 
 /*
  * FIXME: compare types - to ensure they match &
@@ -59,28 +60,42 @@ time_elapsed (struct timeval *origin)
   return (tv.tv_sec - origin->tv_sec) * 1000 + (tv.tv_usec - origin->tv_usec) / 1000;
 }
 
-DBusMessage *
-dbind_send_and_allow_reentry (DBusConnection * bus, DBusMessage * message, DBusError *error)
+/* Returns whether any message was dispatched */
+static dbus_bool_t
+dispatch_if_idle (DBusConnection *bus)
+{
+  static gboolean in_dispatch = FALSE;
+  dbus_bool_t dispatched = FALSE;
+
+  if (g_main_depth () == 0 && !in_dispatch &&
+      dbus_connection_get_dispatch_status (bus) == DBUS_DISPATCH_DATA_REMAINS)
+  {
+    in_dispatch = TRUE;
+    while (dbus_connection_dispatch (bus) == DBUS_DISPATCH_DATA_REMAINS);
+    in_dispatch = FALSE;
+    dispatched = TRUE;
+  }
+  return dispatched;
+}
+
+static DBusMessage *
+send_and_allow_reentry (DBusConnection *bus, DBusMessage *message,
+                        DBusError *error, dbus_bool_t *reentered)
 {
   DBusPendingCall *pending;
   SpiReentrantCallClosure *closure;
   const char *unique_name = dbus_bus_get_unique_name (bus);
   const char *destination = dbus_message_get_destination (message);
   struct timeval tv;
+  dbus_uint32_t serial;
   DBusMessage *ret;
-  static gboolean in_dispatch = FALSE;
 
   if (unique_name && destination &&
       strcmp (destination, unique_name) != 0)
     {
       ret = dbus_connection_send_with_reply_and_block (bus, message,
                                                        dbind_timeout, error);
-      if (g_main_depth () == 0 && !in_dispatch)
-      {
-        in_dispatch = TRUE;
-        while (dbus_connection_dispatch (bus) == DBUS_DISPATCH_DATA_REMAINS);
-        in_dispatch = FALSE;
-      }
+      *reentered = dispatch_if_idle (bus);
       return ret;
     }
 
@@ -95,11 +110,35 @@ dbind_send_and_allow_reentry (DBusConnection * bus, DBusMessage * message, DBusE
   dbus_pending_call_set_notify (pending, set_reply, (void *) closure, g_free);
 
   closure->reply = NULL;
+  serial = dbus_message_get_serial (message);
   gettimeofday (&tv, NULL);
   dbus_pending_call_ref (pending);
+  /* Other messages are dispatched while we wait for our own reply. Each
+   * queued message is looked at before it is dispatched, so that only
+   * those other than the call itself and its reply count as re-entry. */
   while (!closure->reply)
     {
-      if (!dbus_connection_read_write_dispatch (bus, dbind_timeout))
+      dbus_bool_t connected = TRUE;
+
+      if (dbus_connection_get_dispatch_status (bus) == DBUS_DISPATCH_DATA_REMAINS)
+        {
+          DBusMessage *next = dbus_connection_borrow_message (bus);
+
+          if (next)
+            {
+              const char *sender = dbus_message_get_sender (next);
+
+              if (dbus_message_get_reply_serial (next) != serial &&
+                  !(dbus_message_get_serial (next) == serial && sender &&
+                    unique_name && !strcmp (sender, unique_name)))
+                *reentered = TRUE;
+              dbus_connection_return_message (bus, next);
+            }
+          dbus_connection_dispatch (bus);
+        }
+      else
+        connected = dbus_connection_read_write (bus, dbind_timeout);
+      if (!connected)
         {
           //dbus_pending_call_set_notify (pending, NULL, NULL, NULL);
           dbus_pending_call_cancel (pending);
@@ -122,6 +161,127 @@ dbind_send_and_allow_reentry (DBusConnection * bus, DBusMessage * message, DBusE
   return ret;
 }
 
+DBusMessage *
+dbind_send_and_allow_reentry (DBusConnection * bus, DBusMessage * message, DBusError *error)
+{
+  dbus_bool_t reentered = FALSE;
+  gint64 start;
+  DBusMessage *reply;
+
+  if (!dbind_trace_func)
+    return send_and_allow_reentry (bus, message, error, &reentered);
+
+  start = g_get_monotonic_time ();
+  reply = send_and_allow_reentry (bus, message, error, &reentered);
+  dbind_trace_func (message, reply, start, g_get_monotonic_time () - start,
+                    reentered);
+  return reply;
+}
+
+/**
+ * dbind_send_batch_and_allow_reentry:
+ *
+ * @bus:        A D-Bus Connection used to send the messages.
+ * @messages:   An array of @n_messages method calls.
+ * @replies:    An array of @n_messages slots that receive the replies.
+ * @n_messages: The number of messages to send.
+ * @error:      D-Bus error; set from the first failed call, if any.
+ *
+ * Sends a batch of method calls without waiting for each reply before
+ * sending the next one, so that a batch costs roughly one round trip
+ * instead of @n_messages. At most DBIND_MAX_PENDING calls are kept in
+ * flight at a time. Replies are stored in the order of @messages; a
+ * slot is left %NULL if its call could not be sent. Error replies are
+ * stored as-is.
+ *
+ * Calls addressed to our own connection cannot be answered while we
+ * block, so they are sent one at a time through
+ * dbind_send_and_allow_reentry.
+ *
+ * Returns: the number of replies received.
+ **/
+int
+dbind_send_batch_and_allow_reentry (DBusConnection *bus,
+                                    DBusMessage   **messages,
+                                    DBusMessage   **replies,
+                                    int             n_messages,
+                                    DBusError      *error)
+{
+  DBusPendingCall **pending;
+  gint64 *start_times;
+  const char *unique_name;
+  const char *destination;
+  int sent = 0, received = 0, n_replies = 0;
+
+  if (n_messages <= 0)
+    return 0;
+
+  unique_name = dbus_bus_get_unique_name (bus);
+  destination = dbus_message_get_destination (messages[0]);
+  if (!unique_name || !destination || strcmp (destination, unique_name) == 0)
+  {
+    int i;
+    for (i = 0; i < n_messages; i++)
+    {
+      DBusError err;
+
+      dbus_error_init (&err);
+      replies[i] = dbind_send_and_allow_reentry (bus, messages[i], &err);
+      if (replies[i])
+        n_replies++;
+      if (dbus_error_is_set (&err))
+      {
+        if (error && !dbus_error_is_set (error))
+          dbus_move_error (&err, error);
+        else
+          dbus_error_free (&err);
+      }
+    }
+    return n_replies;
+  }
+
+  pending = g_new0 (DBusPendingCall *, n_messages);
+  start_times = g_new (gint64, n_messages);
+  while (received < n_messages)
+  {
+    while (sent < n_messages && sent - received < DBIND_MAX_PENDING)
+    {
+      start_times[sent] = g_get_monotonic_time ();
+      if (!dbus_connection_send_with_reply (bus, messages[sent],
+                                            &pending[sent], dbind_timeout))
+        pending[sent] = NULL;
+      sent++;
+    }
+
+    replies[received] = NULL;
+    if (pending[received])
+    {
+      dbus_pending_call_block (pending[received]);
+      replies[received] = dbus_pending_call_steal_reply (pending[received]);
+      dbus_pending_call_unref (pending[received]);
+      /* The durations overlap, since the calls are in flight together */
+      if (dbind_trace_func)
+        dbind_trace_func (messages[received], replies[received],
+                          start_times[received],
+                          g_get_monotonic_time () - start_times[received],
+                          FALSE);
+    }
+    if (replies[received])
+    {
+      n_replies++;
+      if (dbus_message_get_type (replies[received]) == DBUS_MESSAGE_TYPE_ERROR &&
+          error && !dbus_error_is_set (error))
+        dbus_set_error_from_message (error, replies[received]);
+    }
+    received++;
+  }
+  g_free (pending);
+  g_free (start_times);
+
+  dispatch_if_idle (bus);
+  return n_replies;
+}
+
 dbus_bool_t
 dbind_method_call_reentrant_va (DBusConnection *cnx,
                                 const char     *bus_name,
@@ -317,5 +477,22 @@ dbind_set_timeout (int timeout)
   dbind_timeout = timeout;
 }
 
+/**
+ * dbind_set_trace_func:
+ *
+ * @func: Function called after each call made by
+ *        dbind_send_and_allow_reentry or
+ *        dbind_send_batch_and_allow_reentry, or NULL.
+ *
+ * The function receives the call, its reply (NULL on failure), the
+ * monotonic time at which it was sent and its duration in microseconds,
+ * and whether other messages were dispatched while it was in progress.
+ **/
+void
+dbind_set_trace_func (DBindTraceFunc func)
+{
+  dbind_trace_func = func;
+}
+
 
 /*END------------------------------------------------------------------------*/
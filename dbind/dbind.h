@@ -24,9 +24,25 @@
 #include <dbus/dbus.h>
 #include <dbind/dbind-any.h>
 
+/* Maximum number of calls kept in flight by dbind_send_batch_and_allow_reentry */
+#define DBIND_MAX_PENDING 64
+
+typedef void (*DBindTraceFunc) (DBusMessage  *message,
+                                DBusMessage  *reply,
+                                dbus_int64_t  start_time,
+                                dbus_int64_t  duration,
+                                dbus_bool_t   reentered);
+
 DBusMessage *
 dbind_send_and_allow_reentry (DBusConnection *bus, DBusMessage *message, DBusError *error);
 
+int
+dbind_send_batch_and_allow_reentry (DBusConnection *bus,
+                                    DBusMessage   **messages,
+                                    DBusMessage   **replies,
+                                    int             n_messages,
+                                    DBusError      *error);
+
 dbus_bool_t
 dbind_method_call_reentrant_va (DBusConnection *cnx,
                                 const char     *bus_name,
@@ -66,4 +82,6 @@ dbind_emit_signal (DBusConnection *cnx,
                    ...);
 
 void dbind_set_timeout (int timeout);
+
+void dbind_set_trace_func (DBindTraceFunc func);
 #endif /* _DBIND_H_ */
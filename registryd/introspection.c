@@ -580,6 +580,13 @@ const char *spi_org_a11y_atspi_Text =
 "    <arg direction=\"in\" name=\"coordType\" type=\"u\" />"
 "  </method>"
 ""
+"  <method name=\"GetCharacterExtentsForRange\">"
+"    <arg direction=\"in\" name=\"startOffset\" type=\"i\" />"
+"    <arg direction=\"in\" name=\"endOffset\" type=\"i\" />"
+"    <arg direction=\"in\" name=\"coordType\" type=\"u\" />"
+"    <arg direction=\"out\" type=\"a(iiii)\" />"
+"  </method>"
+""
 "  <method name=\"GetOffsetAtPoint\">"
 "    <arg direction=\"in\" name=\"x\" type=\"i\" />"
 "    <arg direction=\"in\" name=\"y\" type=\"i\" />"
@@ -0,0 +1,119 @@
+/*
+ * Checks that with a focus prefetch policy set, the properties it names
+ * are cached by the time a "focus:" listener runs, so that reading them
+ * costs no calls to the application.
+ */
+
+#include "synthetic-helper.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#define DEPTH 2
+#define FANOUT 4
+#define TIMEOUT_US (30 * G_USEC_PER_SEC)
+
+static gboolean received;
+static guint n_calls;
+
+static gboolean
+wait_for_discovery (void)
+{
+  AtspiAccessible *last = synthetic_ref_node (synthetic_get_n_nodes () - 1);
+  gint64 deadline = g_get_monotonic_time () + TIMEOUT_US;
+  gboolean ret = TRUE;
+
+  while (!(last->cached_properties & ATSPI_CACHE_ROLE))
+  {
+    if (g_get_monotonic_time () > deadline)
+    {
+      ret = FALSE;
+      break;
+    }
+    g_main_context_iteration (NULL, TRUE);
+  }
+  g_object_unref (last);
+  return ret;
+}
+
+static void
+on_event (AtspiEvent *event, void *data)
+{
+  AtspiAccessible *parent;
+  gchar *name;
+
+  /* Drops the calls made by the prefetch itself */
+  synthetic_take_call_count ();
+
+  name = atspi_accessible_get_name (event->source, NULL);
+  atspi_accessible_get_role (event->source, NULL);
+  parent = atspi_accessible_get_parent (event->source, NULL);
+  n_calls = synthetic_take_call_count ();
+
+  g_assert (name != NULL);
+  g_assert (parent != NULL);
+  g_free (name);
+  g_object_unref (parent);
+
+  received = TRUE;
+  atspi_event_quit ();
+  g_boxed_free (ATSPI_TYPE_EVENT, event);
+}
+
+static gboolean
+on_timeout (void *data)
+{
+  atspi_event_quit ();
+  return FALSE;
+}
+
+int
+main (int argc, char *argv[])
+{
+  AtspiAccessible *root;
+  AtspiEventListener *listener;
+  GError *error = NULL;
+  guint timeout;
+
+  if (!synthetic_start (DEPTH, FANOUT, 16, &error))
+  {
+    fprintf (stderr, "Could not start the synthetic application: %s\n",
+             error->message);
+    return 1;
+  }
+  atspi_init ();
+
+  root = synthetic_get_root ();
+  atspi_accessible_set_cache_mask (root, ATSPI_CACHE_DEFAULT);
+  if (!wait_for_discovery ())
+  {
+    fprintf (stderr, "The application was not discovered\n");
+    return 1;
+  }
+
+  /* Leaves only the prefetch to fill the cache in */
+  atspi_accessible_clear_cache (root);
+  atspi_set_focus_prefetch (ATSPI_CACHE_NAME | ATSPI_CACHE_ROLE |
+                            ATSPI_CACHE_PARENT, 1);
+
+  listener = atspi_event_listener_new (on_event, NULL, NULL);
+  atspi_event_listener_register (listener, "focus:", NULL);
+
+  if (!synthetic_emit_storm ("focus", 1, &error))
+  {
+    fprintf (stderr, "Could not emit events: %s\n", error->message);
+    return 1;
+  }
+  timeout = g_timeout_add_seconds (10, on_timeout, NULL);
+  atspi_event_main ();
+  g_source_remove (timeout);
+
+  g_assert (received);
+  g_assert_cmpuint (n_calls, ==, 0);
+
+  atspi_set_focus_prefetch (ATSPI_CACHE_NONE, 0);
+  g_object_unref (listener);
+  g_object_unref (root);
+  atspi_exit ();
+  synthetic_stop ();
+  return 0;
+}
@@ -0,0 +1,114 @@
+/*
+ * Reports how much heap a cached AtspiAccessible costs, by building a
+ * synthetic tree the way the cache would and measuring malloc usage.
+ * Run with G_SLICE=always-malloc so that GObject allocations are counted,
+ * and under dbus-run-session, since the accessibles need a bus to live on.
+ *
+ * Only interfaces that predate the slimmer AtspiAccessiblePrivate are used,
+ * so the same program gives the figure on both sides of that change.
+ */
+
+#include <config.h>
+#include "atspi/atspi.h"
+#include "atspi/atspi-misc-private.h"
+#include <malloc.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define DEFAULT_N_NODES 100000
+#define FANOUT 8
+#define APP_NAME ":1.0"
+
+static size_t
+heap_in_use (void)
+{
+#ifdef HAVE_MALLINFO2
+  struct mallinfo2 info = mallinfo2 ();
+#else
+  struct mallinfo info = mallinfo ();
+#endif
+  return info.uordblks + info.hblkhd;
+}
+
+int
+main (int argc, char *argv[])
+{
+  AtspiAccessible *warmup;
+  GPtrArray *nodes;
+  DBusMessage *states_message;
+  DBusMessageIter iter, iter_array;
+  dbus_uint32_t states[2];
+  gint n_nodes = (argc > 1 ? atoi (argv[1]) : DEFAULT_N_NODES);
+  size_t before, after;
+  gint i;
+
+  if (n_nodes <= 0)
+    n_nodes = DEFAULT_N_NODES;
+
+  /* Use the session bus as the accessibility bus; nothing needs to answer */
+  if (!g_getenv ("AT_SPI_BUS_ADDRESS") && g_getenv ("DBUS_SESSION_BUS_ADDRESS"))
+    g_setenv ("AT_SPI_BUS_ADDRESS", g_getenv ("DBUS_SESSION_BUS_ADDRESS"), TRUE);
+
+  if (atspi_init () != 0)
+  {
+    fprintf (stderr, "node-footprint: no bus; run under dbus-run-session\n");
+    return 77;
+  }
+
+  /* States arrive as "au" on the wire; build one message to parse from */
+  states[0] = (1 << ATSPI_STATE_ENABLED) | (1 << ATSPI_STATE_SHOWING) |
+              (1 << ATSPI_STATE_VISIBLE);
+  states[1] = 0;
+  states_message = dbus_message_new_method_call (APP_NAME, "/", "a.b", "c");
+  dbus_message_iter_init_append (states_message, &iter);
+  dbus_message_iter_open_container (&iter, DBUS_TYPE_ARRAY, "u", &iter_array);
+  for (i = 0; i < 2; i++)
+    dbus_message_iter_append_basic (&iter_array, DBUS_TYPE_UINT32, &states[i]);
+  dbus_message_iter_close_container (&iter, &iter_array);
+
+  /* Creates the application so that it is not counted against the nodes */
+  warmup = _atspi_ref_accessible (APP_NAME, "/org/a11y/atspi/accessible/warmup");
+  nodes = g_ptr_array_sized_new (n_nodes);
+
+  before = heap_in_use ();
+
+  for (i = 0; i < n_nodes; i++)
+  {
+    AtspiAccessible *accessible;
+    gchar path[64];
+
+    g_snprintf (path, sizeof (path), "/org/a11y/atspi/accessible/%d", i);
+    accessible = _atspi_ref_accessible (APP_NAME, path);
+
+    accessible->name = g_strdup ("");
+    accessible->role = ATSPI_ROLE_PUSH_BUTTON;
+    dbus_message_iter_init (states_message, &iter);
+    _atspi_dbus_set_state (accessible, &iter);
+    accessible->cached_properties |= ATSPI_CACHE_NAME | ATSPI_CACHE_ROLE |
+                                     ATSPI_CACHE_STATES | ATSPI_CACHE_CHILDREN;
+
+    if (i > 0)
+    {
+      AtspiAccessible *parent = g_ptr_array_index (nodes, (i - 1) / FANOUT);
+      accessible->accessible_parent = g_object_ref (parent);
+      if (!parent->children)
+        parent->children = g_ptr_array_new_with_free_func (g_object_unref);
+      g_ptr_array_add (parent->children, g_object_ref (accessible));
+    }
+
+    g_ptr_array_add (nodes, accessible);
+  }
+
+  after = heap_in_use ();
+
+  printf ("%d nodes, %lu bytes, %.1f bytes per node\n", n_nodes,
+          (unsigned long) (after - before),
+          (double) (after - before) / n_nodes);
+
+  /* The nodes are owned by the application hash and each other; the
+   * process exits without tearing the tree down. */
+  g_ptr_array_free (nodes, TRUE);
+  g_object_unref (warmup);
+  dbus_message_unref (states_message);
+  return 0;
+}
@@ -0,0 +1,101 @@
+/*
+ * Checks that an event storm recorded with atspi_start_recording() reaches
+ * listeners unchanged when it is replayed with atspi_replay() after the
+ * application and its bus have gone away.
+ */
+
+#include "synthetic-helper.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define DEPTH 2
+#define FANOUT 4
+#define STORM_SIZE 100
+
+static GPtrArray *received;
+static gboolean replaying;
+
+static void
+on_event (AtspiEvent *event, void *data)
+{
+  g_ptr_array_add (received,
+                   g_strdup_printf ("%s %s %d %d", event->type,
+                                    event->source ? event->source->parent.path : "",
+                                    event->detail1, event->detail2));
+  if (received->len == STORM_SIZE && !replaying)
+    atspi_event_quit ();
+  g_boxed_free (ATSPI_TYPE_EVENT, event);
+}
+
+static gboolean
+on_timeout (void *data)
+{
+  atspi_event_quit ();
+  return FALSE;
+}
+
+int
+main (int argc, char *argv[])
+{
+  AtspiEventListener *listener;
+  GPtrArray *live;
+  GError *error = NULL;
+  gchar *filename;
+  gint fd;
+  guint timeout, i;
+
+  if (!synthetic_start (DEPTH, FANOUT, 16, &error))
+  {
+    fprintf (stderr, "Could not start the synthetic application: %s\n",
+             error->message);
+    return 1;
+  }
+  atspi_init ();
+
+  received = g_ptr_array_new_with_free_func (g_free);
+  listener = atspi_event_listener_new (on_event, NULL, NULL);
+  atspi_event_listener_register (listener, "object:state-changed", NULL);
+
+  fd = g_file_open_tmp ("atspi-recording-XXXXXX", &filename, &error);
+  g_assert_no_error (error);
+  g_assert (atspi_start_recording (fd, &error));
+  g_assert_no_error (error);
+
+  if (!synthetic_emit_storm ("state-changed", STORM_SIZE, &error))
+  {
+    fprintf (stderr, "Could not emit events: %s\n", error->message);
+    return 1;
+  }
+  timeout = g_timeout_add_seconds (10, on_timeout, NULL);
+  atspi_event_main ();
+  g_source_remove (timeout);
+  atspi_stop_recording ();
+  g_assert_cmpuint (received->len, ==, STORM_SIZE);
+
+  live = received;
+  received = g_ptr_array_new_with_free_func (g_free);
+
+  /* Nothing is left to answer calls made while handling the events */
+  synthetic_stop ();
+
+  g_assert (lseek (fd, 0, SEEK_SET) == 0);
+  replaying = TRUE;
+  g_assert (atspi_replay (fd, FALSE, &error));
+  g_assert_no_error (error);
+
+  g_assert_cmpuint (received->len, ==, live->len);
+  for (i = 0; i < live->len; i++)
+    g_assert_cmpstr (g_ptr_array_index (received, i), ==,
+                     g_ptr_array_index (live, i));
+
+  close (fd);
+  unlink (filename);
+  g_free (filename);
+  g_ptr_array_free (live, TRUE);
+  g_ptr_array_free (received, TRUE);
+  g_object_unref (listener);
+  atspi_exit ();
+  return 0;
+}
@@ -0,0 +1,179 @@
+/*
+ * Checks that snapshots of the cached tree round-trip through a file and
+ * that diffing them reports removed, moved, inserted and changed nodes.
+ * The cached tree of the synthetic application is edited in place between
+ * the two snapshots, as the event handlers would.
+ */
+
+#include "synthetic-helper.h"
+#include "atspi/atspi-accessible-private.h"
+#include "atspi/atspi-misc-private.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define DEPTH 2
+#define FANOUT 4
+#define TIMEOUT_US (30 * G_USEC_PER_SEC)
+#define INSERTED_PATH "/org/a11y/atspi/accessible/inserted"
+
+static gboolean
+wait_for_discovery (void)
+{
+  AtspiAccessible *last = synthetic_ref_node (synthetic_get_n_nodes () - 1);
+  gint64 deadline = g_get_monotonic_time () + TIMEOUT_US;
+  gboolean ret = TRUE;
+
+  while (!(last->cached_properties & ATSPI_CACHE_ROLE))
+  {
+    if (g_get_monotonic_time () > deadline)
+    {
+      ret = FALSE;
+      break;
+    }
+    g_main_context_iteration (NULL, TRUE);
+  }
+  g_object_unref (last);
+  return ret;
+}
+
+static AtspiSnapshot *
+save_and_load (AtspiAccessible *root)
+{
+  AtspiSnapshot *snapshot;
+  GError *error = NULL;
+  gchar *filename;
+  gint fd;
+
+  fd = g_file_open_tmp ("atspi-snapshot-XXXXXX", &filename, &error);
+  g_assert_no_error (error);
+  g_assert (atspi_accessible_snapshot_save (root, fd, ATSPI_CACHE_ALL, &error));
+  g_assert_no_error (error);
+  g_assert (lseek (fd, 0, SEEK_SET) == 0);
+
+  snapshot = atspi_snapshot_load (fd, &error);
+  g_assert_no_error (error);
+  g_assert (snapshot != NULL);
+
+  close (fd);
+  unlink (filename);
+  g_free (filename);
+  return snapshot;
+}
+
+static const gchar *
+node_path (guint index)
+{
+  static gchar path[64];
+
+  g_snprintf (path, sizeof (path), "/org/a11y/atspi/accessible/%u", index);
+  return path;
+}
+
+static void
+check_change (GArray *changes, guint i, AtspiSnapshotChangeType type,
+              AtspiSnapshot *snapshot, const gchar *path)
+{
+  AtspiSnapshotChange *change;
+  gint node;
+
+  g_assert_cmpuint (i, <, changes->len);
+  change = &g_array_index (changes, AtspiSnapshotChange, i);
+  g_assert_cmpint (change->type, ==, type);
+  node = (type == ATSPI_SNAPSHOT_CHANGE_REMOVED ? change->old_node
+                                                : change->new_node);
+  g_assert_cmpstr (atspi_snapshot_get_path (snapshot, node), ==, path);
+}
+
+int
+main (int argc, char *argv[])
+{
+  AtspiAccessible *root, *first, *removed, *third, *last, *renamed, *inserted;
+  AtspiSnapshot *old_snapshot, *new_snapshot;
+  GArray *changes;
+  GError *error = NULL;
+
+  if (!synthetic_start (DEPTH, FANOUT, 16, &error))
+  {
+    fprintf (stderr, "Could not start the synthetic application: %s\n",
+             error->message);
+    return 1;
+  }
+  atspi_init ();
+
+  root = synthetic_get_root ();
+  atspi_accessible_set_cache_mask (root, ATSPI_CACHE_DEFAULT);
+  if (!wait_for_discovery ())
+  {
+    fprintf (stderr, "The application was not discovered\n");
+    return 1;
+  }
+
+  old_snapshot = save_and_load (root);
+  g_assert_cmpuint (atspi_snapshot_get_n_nodes (old_snapshot), ==,
+                    synthetic_get_n_nodes ());
+  changes = atspi_snapshot_diff (old_snapshot, old_snapshot, FALSE);
+  g_assert_cmpuint (changes->len, ==, 0);
+  g_array_free (changes, TRUE);
+
+  /* [1, 2, 3, 4] becomes [4, 1, 3, inserted] below the root, and a
+   * grandchild is renamed */
+  g_assert_cmpuint (root->children->len, ==, FANOUT);
+  first = g_object_ref (g_ptr_array_index (root->children, 0));
+  removed = g_ptr_array_index (root->children, 1);
+  third = g_object_ref (g_ptr_array_index (root->children, 2));
+  last = g_object_ref (g_ptr_array_index (root->children, 3));
+  g_assert_cmpstr (first->parent.path, ==, node_path (1));
+  g_assert_cmpstr (removed->parent.path, ==, node_path (2));
+  g_assert_cmpstr (third->parent.path, ==, node_path (3));
+  g_assert_cmpstr (last->parent.path, ==, node_path (4));
+
+  inserted = _atspi_ref_accessible (synthetic_get_bus_name (), INSERTED_PATH);
+  inserted->role = ATSPI_ROLE_LABEL;
+  _atspi_accessible_add_cache (inserted, ATSPI_CACHE_ROLE);
+
+  /* The array owns its references, which are handed over */
+  g_ptr_array_set_size (root->children, 0);
+  g_ptr_array_add (root->children, last);
+  g_ptr_array_add (root->children, first);
+  g_ptr_array_add (root->children, third);
+  g_ptr_array_add (root->children, inserted);
+
+  renamed = synthetic_ref_node (FANOUT + 1);
+  g_free (renamed->name);
+  renamed->name = g_strdup ("renamed");
+  g_object_unref (renamed);
+
+  new_snapshot = save_and_load (root);
+  g_assert_cmpuint (atspi_snapshot_get_n_nodes (new_snapshot), ==,
+                    synthetic_get_n_nodes () - 1 - FANOUT + 1);
+
+  /* Only the node that was moved ahead of its siblings is reported as
+   * moved, and only the root of the removed subtree is reported */
+  changes = atspi_snapshot_diff (old_snapshot, new_snapshot, TRUE);
+  g_assert_cmpuint (changes->len, ==, 4);
+  check_change (changes, 0, ATSPI_SNAPSHOT_CHANGE_REMOVED, old_snapshot,
+                node_path (2));
+  check_change (changes, 1, ATSPI_SNAPSHOT_CHANGE_MOVED, new_snapshot,
+                node_path (4));
+  check_change (changes, 2, ATSPI_SNAPSHOT_CHANGE_INSERTED, new_snapshot,
+                INSERTED_PATH);
+  check_change (changes, 3, ATSPI_SNAPSHOT_CHANGE_PROPERTIES, new_snapshot,
+                node_path (FANOUT + 1));
+  g_assert_cmpuint (g_array_index (changes, AtspiSnapshotChange, 3).changed,
+                    ==, ATSPI_CACHE_NAME);
+  g_array_free (changes, TRUE);
+
+  /* Without @minimal, the children of the removed node are listed too */
+  changes = atspi_snapshot_diff (old_snapshot, new_snapshot, FALSE);
+  g_assert_cmpuint (changes->len, ==, 4 + FANOUT);
+  g_array_free (changes, TRUE);
+
+  g_object_unref (old_snapshot);
+  g_object_unref (new_snapshot);
+  g_object_unref (root);
+  atspi_exit ();
+  synthetic_stop ();
+  return 0;
+}
@@ -0,0 +1,1522 @@
+/*
+ * A synthetic accessible application for benchmarks and tests.
+ *
+ * It exposes a generated tree over the accessibility bus named by
+ * AT_SPI_BUS_ADDRESS: a complete tree of the given depth and fan-out,
+ * numbered breadth-first, where node 0 is the application root. Node 1 is
+ * a table whose children are its cells, and every other leaf is either a
+ * push button or a text object with generated content. Once it is ready,
+ * the unique bus name of the application is printed on stdout.
+ *
+ * Event storms are requested with the EmitStorm (su) method of the
+ * org.a11y.atspi.test.Synthetic interface on the root object, which emits
+ * the given number of events of one kind before replying. TakeCallCount
+ * returns the number of other method calls served since the last time it
+ * was called, so that benchmarks can count round trips.
+ */
+
+#include "atspi/atspi.h"
+#include <dbus/dbus.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define PATH_PREFIX "/org/a11y/atspi/accessible/"
+#define CACHE_PATH "/org/a11y/atspi/cache"
+#define SYNTHETIC_INTERFACE "org.a11y.atspi.test.Synthetic"
+#define PROPERTIES_INTERFACE "org.freedesktop.DBus.Properties"
+
+#define ROOT_WIDTH 1024
+#define ROOT_HEIGHT 768
+#define CHAR_WIDTH 8
+#define LINE_HEIGHT 16
+#define ATTRIBUTE_RUN_LENGTH 64
+
+static gint depth = 3;
+static gint fanout = 8;
+static gint text_size = 1024;
+
+static GOptionEntry entries[] =
+{
+  { "depth", 'd', 0, G_OPTION_ARG_INT, &depth, "Number of levels below the root", NULL },
+  { "fanout", 'f', 0, G_OPTION_ARG_INT, &fanout, "Number of children of each inner node", NULL },
+  { "text-size", 't', 0, G_OPTION_ARG_INT, &text_size, "Number of characters in each text object", NULL },
+  { NULL }
+};
+
+static DBusConnection *bus;
+static guint n_nodes;
+static gchar *text;
+static guint generation;
+static guint n_calls;
+
+/* Tree shape */
+
+static gint
+node_parent (guint node)
+{
+  return (node == 0 ? -1 : (gint) ((node - 1) / fanout));
+}
+
+static guint
+node_child_count (guint node)
+{
+  guint64 first = (guint64) node * fanout + 1;
+
+  return (first < n_nodes ? fanout : 0);
+}
+
+static guint
+node_child (guint node, guint index)
+{
+  return node * fanout + 1 + index;
+}
+
+static gint
+node_index_in_parent (guint node)
+{
+  return (node == 0 ? -1 : (gint) ((node - 1) % fanout));
+}
+
+static AtspiRole
+node_role (guint node)
+{
+  if (node == 0)
+    return ATSPI_ROLE_APPLICATION;
+  if (node == 1 && node_child_count (node) > 0)
+    return ATSPI_ROLE_TABLE;
+  if (node_parent (node) == 1)
+    return ATSPI_ROLE_TABLE_CELL;
+  if (node_child_count (node) > 0)
+    return ATSPI_ROLE_PANEL;
+  return (node % 2 ? ATSPI_ROLE_PUSH_BUTTON : ATSPI_ROLE_TEXT);
+}
+
+static gboolean
+node_is_text (guint node)
+{
+  return node_role (node) == ATSPI_ROLE_TEXT;
+}
+
+static gboolean
+node_is_table (guint node)
+{
+  return node_role (node) == ATSPI_ROLE_TABLE;
+}
+
+static gint
+node_depth (guint node)
+{
+  gint d = 0;
+
+  while (node > 0)
+  {
+    node = node_parent (node);
+    d++;
+  }
+  return d;
+}
+
+/* Children split their parent into strips, alternating direction by level */
+static void
+node_extents (guint node, gint *x, gint *y, gint *width, gint *height)
+{
+  gint index;
+
+  if (node == 0)
+  {
+    *x = 0;
+    *y = 0;
+    *width = ROOT_WIDTH;
+    *height = ROOT_HEIGHT;
+    return;
+  }
+
+  node_extents (node_parent (node), x, y, width, height);
+  index = node_index_in_parent (node);
+  if (node_depth (node) % 2)
+  {
+    *width /= fanout;
+    *x += index * *width;
+  }
+  else
+  {
+    *height /= fanout;
+    *y += index * *height;
+  }
+}
+
+static gint
+node_from_path (const char *path)
+{
+  gchar *end;
+  guint64 val;
+
+  if (!strcmp (path, ATSPI_DBUS_PATH_ROOT))
+    return 0;
+  if (strncmp (path, PATH_PREFIX, strlen (PATH_PREFIX)) != 0)
+    return -1;
+  val = g_ascii_strtoull (path + strlen (PATH_PREFIX), &end, 10);
+  if (*end || val == 0 || val >= n_nodes)
+    return -1;
+  return val;
+}
+
+static void
+node_path (guint node, gchar *buf, gsize len)
+{
+  if (node == 0)
+    g_strlcpy (buf, ATSPI_DBUS_PATH_ROOT, len);
+  else
+    g_snprintf (buf, len, PATH_PREFIX "%u", node);
+}
+
+static gchar *
+node_name (guint node)
+{
+  if (generation)
+    return g_strdup_printf ("node %u (%u)", node, generation);
+  return g_strdup_printf ("node %u", node);
+}
+
+static void
+node_states (guint node, dbus_uint32_t *states)
+{
+  gint64 set = ((gint64) 1 << ATSPI_STATE_ENABLED) |
+               ((gint64) 1 << ATSPI_STATE_SENSITIVE) |
+               ((gint64) 1 << ATSPI_STATE_SHOWING) |
+               ((gint64) 1 << ATSPI_STATE_VISIBLE);
+
+  switch (node_role (node))
+  {
+  case ATSPI_ROLE_TEXT:
+    set |= ((gint64) 1 << ATSPI_STATE_EDITABLE) |
+           ((gint64) 1 << ATSPI_STATE_FOCUSABLE) |
+           ((gint64) 1 << ATSPI_STATE_MULTI_LINE);
+    break;
+  case ATSPI_ROLE_PUSH_BUTTON:
+    set |= ((gint64) 1 << ATSPI_STATE_FOCUSABLE);
+    break;
+  default:
+    break;
+  }
+  states[0] = set & 0xffffffff;
+  states[1] = set >> 32;
+}
+
+/* The table is as close to square as its cell count allows */
+static guint
+table_columns (guint node)
+{
+  guint n = node_child_count (node);
+  guint columns = 1;
+
+  while (columns * columns < n)
+    columns++;
+  return columns;
+}
+
+/* Marshalling helpers */
+
+static void
+append_reference (DBusMessageIter *iter, gint node)
+{
+  DBusMessageIter iter_struct;
+  const char *name = dbus_bus_get_unique_name (bus);
+  gchar path[64];
+  const char *p = path;
+
+  if (node < 0)
+  {
+    name = "";
+    g_strlcpy (path, ATSPI_DBUS_PATH_NULL, sizeof (path));
+  }
+  else
+    node_path (node, path, sizeof (path));
+
+  dbus_message_iter_open_container (iter, DBUS_TYPE_STRUCT, NULL, &iter_struct);
+  dbus_message_iter_append_basic (&iter_struct, DBUS_TYPE_STRING, &name);
+  dbus_message_iter_append_basic (&iter_struct, DBUS_TYPE_OBJECT_PATH, &p);
+  dbus_message_iter_close_container (iter, &iter_struct);
+}
+
+static void
+append_states (DBusMessageIter *iter, guint node)
+{
+  DBusMessageIter iter_array;
+  dbus_uint32_t states[2];
+
+  node_states (node, states);
+  dbus_message_iter_open_container (iter, DBUS_TYPE_ARRAY, "u", &iter_array);
+  dbus_message_iter_append_basic (&iter_array, DBUS_TYPE_UINT32, &states[0]);
+  dbus_message_iter_append_basic (&iter_array, DBUS_TYPE_UINT32, &states[1]);
+  dbus_message_iter_close_container (iter, &iter_array);
+}
+
+static void
+append_interfaces (DBusMessageIter *iter, guint node)
+{
+  DBusMessageIter iter_array;
+  const char *names[6];
+  gint i, n = 0;
+
+  names[n++] = ATSPI_DBUS_INTERFACE_ACCESSIBLE;
+  names[n++] = ATSPI_DBUS_INTERFACE_COMPONENT;
+  names[n++] = ATSPI_DBUS_INTERFACE_COLLECTION;
+  if (node == 0)
+    names[n++] = ATSPI_DBUS_INTERFACE_APPLICATION;
+  if (node_is_text (node))
+    names[n++] = ATSPI_DBUS_INTERFACE_TEXT;
+  if (node_is_table (node))
+    names[n++] = ATSPI_DBUS_INTERFACE_TABLE;
+
+  dbus_message_iter_open_container (iter, DBUS_TYPE_ARRAY, "s", &iter_array);
+  for (i = 0; i < n; i++)
+    dbus_message_iter_append_basic (&iter_array, DBUS_TYPE_STRING, &names[i]);
+  dbus_message_iter_close_container (iter, &iter_array);
+}
+
+static void
+append_rect (DBusMessageIter *iter, gint x, gint y, gint width, gint height)
+{
+  DBusMessageIter iter_struct;
+  dbus_int32_t v[4] = { x, y, width, height };
+  gint i;
+
+  dbus_message_iter_open_container (iter, DBUS_TYPE_STRUCT, NULL, &iter_struct);
+  for (i = 0; i < 4; i++)
+    dbus_message_iter_append_basic (&iter_struct, DBUS_TYPE_INT32, &v[i]);
+  dbus_message_iter_close_container (iter, &iter_struct);
+}
+
+static void
+append_attributes (DBusMessageIter *iter, const char **pairs)
+{
+  DBusMessageIter iter_array, iter_entry;
+
+  dbus_message_iter_open_container (iter, DBUS_TYPE_ARRAY, "{ss}", &iter_array);
+  for (; pairs && pairs[0]; pairs += 2)
+  {
+    dbus_message_iter_open_container (&iter_array, DBUS_TYPE_DICT_ENTRY, NULL,
+                                      &iter_entry);
+    dbus_message_iter_append_basic (&iter_entry, DBUS_TYPE_STRING, &pairs[0]);
+    dbus_message_iter_append_basic (&iter_entry, DBUS_TYPE_STRING, &pairs[1]);
+    dbus_message_iter_close_container (&iter_array, &iter_entry);
+  }
+  dbus_message_iter_close_container (iter, &iter_array);
+}
+
+static DBusMessage *
+new_reply (DBusMessage *message, int first_type, ...)
+{
+  DBusMessage *reply = dbus_message_new_method_return (message);
+  va_list args;
+
+  va_start (args, first_type);
+  dbus_message_append_args_valist (reply, first_type, args);
+  va_end (args);
+  return reply;
+}
+
+static DBusMessage *
+new_reference_reply (DBusMessage *message, gint node)
+{
+  DBusMessage *reply = dbus_message_new_method_return (message);
+  DBusMessageIter iter;
+
+  dbus_message_iter_init_append (reply, &iter);
+  append_reference (&iter, node);
+  return reply;
+}
+
+/* Properties */
+
+static gboolean
+append_property (DBusMessageIter *iter, guint node, const char *iface,
+                 const char *name)
+{
+  DBusMessageIter iter_variant;
+  const char *s = NULL;
+  gchar *to_free = NULL;
+  dbus_int32_t i = 0;
+  gint ref = -2;
+
+  if (!strcmp (iface, ATSPI_DBUS_INTERFACE_ACCESSIBLE))
+  {
+    if (!strcmp (name, "Name"))
+      s = to_free = node_name (node);
+    else if (!strcmp (name, "Description"))
+      s = "";
+    else if (!strcmp (name, "Locale"))
+      s = "en_US";
+    else if (!strcmp (name, "AccessibleId"))
+      s = "";
+    else if (!strcmp (name, "Parent"))
+      ref = node_parent (node);
+    else if (!strcmp (name, "ChildCount"))
+      i = node_child_count (node);
+    else
+      return FALSE;
+  }
+  else if (!strcmp (iface, ATSPI_DBUS_INTERFACE_APPLICATION) && node == 0)
+  {
+    if (!strcmp (name, "ToolkitName"))
+      s = "synthetic";
+    else if (!strcmp (name, "Version"))
+      s = "1.0";
+    else if (!strcmp (name, "AtspiVersion"))
+      s = "2.1";
+    else if (!strcmp (name, "Id"))
+      i = 0;
+    else
+      return FALSE;
+  }
+  else if (!strcmp (iface, ATSPI_DBUS_INTERFACE_TEXT) && node_is_text (node))
+  {
+    if (!strcmp (name, "CharacterCount"))
+      i = text_size;
+    else if (!strcmp (name, "CaretOffset"))
+      i = 0;
+    else
+      return FALSE;
+  }
+  else if (!strcmp (iface, ATSPI_DBUS_INTERFACE_TABLE) && node_is_table (node))
+  {
+    guint n = node_child_count (node);
+    guint columns = table_columns (node);
+
+    if (!strcmp (name, "NRows"))
+      i = (n + columns - 1) / columns;
+    else if (!strcmp (name, "NColumns"))
+      i = columns;
+    else if (!strcmp (name, "Caption") || !strcmp (name, "Summary"))
+      ref = -1;
+    else if (!strcmp (name, "NSelectedRows") || !strcmp (name, "NSelectedColumns"))
+      i = 0;
+    else
+      return FALSE;
+  }
+  else
+    return FALSE;
+
+  if (ref != -2)
+  {
+    dbus_message_iter_open_container (iter, DBUS_TYPE_VARIANT, "(so)", &iter_variant);
+    append_reference (&iter_variant, ref);
+  }
+  else if (s)
+  {
+    dbus_message_iter_open_container (iter, DBUS_TYPE_VARIANT, "s", &iter_variant);
+    dbus_message_iter_append_basic (&iter_variant, DBUS_TYPE_STRING, &s);
+  }
+  else
+  {
+    dbus_message_iter_open_container (iter, DBUS_TYPE_VARIANT, "i", &iter_variant);
+    dbus_message_iter_append_basic (&iter_variant, DBUS_TYPE_INT32, &i);
+  }
+  dbus_message_iter_close_container (iter, &iter_variant);
+  g_free (to_free);
+  return TRUE;
+}
+
+static const char *property_names[] =
+{
+  "Name", "Description", "Locale", "AccessibleId", "Parent", "ChildCount",
+  "ToolkitName", "Version", "AtspiVersion", "Id",
+  "CharacterCount", "CaretOffset",
+  "NRows", "NColumns", "Caption", "Summary", "NSelectedRows",
+  "NSelectedColumns",
+  NULL
+};
+
+static DBusMessage *
+impl_Get (DBusMessage *message, guint node)
+{
+  DBusMessage *reply;
+  DBusMessageIter iter;
+  const char *iface, *name;
+
+  if (!dbus_message_get_args (message, NULL, DBUS_TYPE_STRING, &iface,
+                              DBUS_TYPE_STRING, &name, DBUS_TYPE_INVALID))
+    return dbus_message_new_error (message, DBUS_ERROR_INVALID_ARGS, "Invalid arguments");
+
+  reply = dbus_message_new_method_return (message);
+  dbus_message_iter_init_append (reply, &iter);
+  if (!append_property (&iter, node, iface, name))
+  {
+    dbus_message_unref (reply);
+    return dbus_message_new_error (message, DBUS_ERROR_UNKNOWN_PROPERTY, name);
+  }
+  return reply;
+}
+
+static DBusMessage *
+impl_GetAll (DBusMessage *message, guint node)
+{
+  DBusMessage *reply;
+  DBusMessageIter iter, iter_array, iter_entry;
+  const char *iface;
+  gint i;
+
+  if (!dbus_message_get_args (message, NULL, DBUS_TYPE_STRING, &iface,
+                              DBUS_TYPE_INVALID))
+    return dbus_message_new_error (message, DBUS_ERROR_INVALID_ARGS, "Invalid arguments");
+
+  reply = dbus_message_new_method_return (message);
+  dbus_message_iter_init_append (reply, &iter);
+  dbus_message_iter_open_container (&iter, DBUS_TYPE_ARRAY, "{sv}", &iter_array);
+  for (i = 0; property_names[i]; i++)
+  {
+    /* Probe first, since a dict entry cannot be abandoned half-written */
+    DBusMessage *probe = dbus_message_new_method_return (message);
+    DBusMessageIter probe_iter;
+    gboolean known;
+
+    dbus_message_iter_init_append (probe, &probe_iter);
+    known = append_property (&probe_iter, node, iface, property_names[i]);
+    dbus_message_unref (probe);
+    if (!known)
+      continue;
+
+    dbus_message_iter_open_container (&iter_array, DBUS_TYPE_DICT_ENTRY, NULL,
+                                      &iter_entry);
+    dbus_message_iter_append_basic (&iter_entry, DBUS_TYPE_STRING,
+                                    &property_names[i]);
+    append_property (&iter_entry, node, iface, property_names[i]);
+    dbus_message_iter_close_container (&iter_array, &iter_entry);
+  }
+  dbus_message_iter_close_container (&iter, &iter_array);
+  return reply;
+}
+
+/* Accessible */
+
+static DBusMessage *
+impl_GetChildAtIndex (DBusMessage *message, guint node)
+{
+  dbus_int32_t index;
+
+  if (!dbus_message_get_args (message, NULL, DBUS_TYPE_INT32, &index,
+                              DBUS_TYPE_INVALID))
+    return dbus_message_new_error (message, DBUS_ERROR_INVALID_ARGS, "Invalid arguments");
+  if (index < 0 || index >= node_child_count (node))
+    return new_reference_reply (message, -1);
+  return new_reference_reply (message, node_child (node, index));
+}
+
+static DBusMessage *
+impl_GetChildren (DBusMessage *message, guint node)
+{
+  DBusMessage *reply = dbus_message_new_method_return (message);
+  DBusMessageIter iter, iter_array;
+  guint i, n = node_child_count (node);
+
+  dbus_message_iter_init_append (reply, &iter);
+  dbus_message_iter_open_container (&iter, DBUS_TYPE_ARRAY, "(so)", &iter_array);
+  for (i = 0; i < n; i++)
+    append_reference (&iter_array, node_child (node, i));
+  dbus_message_iter_close_container (&iter, &iter_array);
+  return reply;
+}
+
+static DBusMessage *
+impl_GetRelationSet (DBusMessage *message, guint node)
+{
+  DBusMessage *reply = dbus_message_new_method_return (message);
+  DBusMessageIter iter, iter_array;
+
+  dbus_message_iter_init_append (reply, &iter);
+  dbus_message_iter_open_container (&iter, DBUS_TYPE_ARRAY, "(ua(so))", &iter_array);
+  dbus_message_iter_close_container (&iter, &iter_array);
+  return reply;
+}
+
+static DBusMessage *
+impl_GetRoleName (DBusMessage *message, guint node)
+{
+  gchar *name = atspi_role_get_name (node_role (node));
+  DBusMessage *reply = new_reply (message, DBUS_TYPE_STRING, &name,
+                                  DBUS_TYPE_INVALID);
+  g_free (name);
+  return reply;
+}
+
+static DBusMessage *
+impl_GetState (DBusMessage *message, guint node)
+{
+  DBusMessage *reply = dbus_message_new_method_return (message);
+  DBusMessageIter iter;
+
+  dbus_message_iter_init_append (reply, &iter);
+  append_states (&iter, node);
+  return reply;
+}
+
+static DBusMessage *
+impl_GetAttributes (DBusMessage *message, guint node)
+{
+  DBusMessage *reply = dbus_message_new_method_return (message);
+  DBusMessageIter iter;
+  const char *attributes[] = { "toolkit", "synthetic", NULL };
+
+  dbus_message_iter_init_append (reply, &iter);
+  append_attributes (&iter, attributes);
+  return reply;
+}
+
+static DBusMessage *
+impl_GetInterfaces (DBusMessage *message, guint node)
+{
+  DBusMessage *reply = dbus_message_new_method_return (message);
+  DBusMessageIter iter;
+
+  dbus_message_iter_init_append (reply, &iter);
+  append_interfaces (&iter, node);
+  return reply;
+}
+
+/* Component */
+
+static gboolean
+node_contains (guint node, gint px, gint py)
+{
+  gint x, y, width, height;
+
+  node_extents (node, &x, &y, &width, &height);
+  return (px >= x && px < x + width && py >= y && py < y + height);
+}
+
+static DBusMessage *
+impl_Contains (DBusMessage *message, guint node)
+{
+  dbus_int32_t x, y;
+  dbus_uint32_t coord_type;
+  dbus_bool_t ret;
+
+  if (!dbus_message_get_args (message, NULL, DBUS_TYPE_INT32, &x,
+                              DBUS_TYPE_INT32, &y, DBUS_TYPE_UINT32, &coord_type,
+                              DBUS_TYPE_INVALID))
+    return dbus_message_new_error (message, DBUS_ERROR_INVALID_ARGS, "Invalid arguments");
+  ret = node_contains (node, x, y);
+  return new_reply (message, DBUS_TYPE_BOOLEAN, &ret, DBUS_TYPE_INVALID);
+}
+
+static DBusMessage *
+impl_GetAccessibleAtPoint (DBusMessage *message, guint node)
+{
+  dbus_int32_t x, y;
+  dbus_uint32_t coord_type;
+  guint i, n;
+
+  if (!dbus_message_get_args (message, NULL, DBUS_TYPE_INT32, &x,
+                              DBUS_TYPE_INT32, &y, DBUS_TYPE_UINT32, &coord_type,
+                              DBUS_TYPE_INVALID))
+    return dbus_message_new_error (message, DBUS_ERROR_INVALID_ARGS, "Invalid arguments");
+
+  n = node_child_count (node);
+  for (i = 0; i < n; i++)
+    if (node_contains (node_child (node, i), x, y))
+      return new_reference_reply (message, node_child (node, i));
+  return new_reference_reply (message, -1);
+}
+
+static DBusMessage *
+impl_GetExtents (DBusMessage *message, guint node)
+{
+  DBusMessage *reply = dbus_message_new_method_return (message);
+  DBusMessageIter iter;
+  gint x, y, width, height;
+
+  node_extents (node, &x, &y, &width, &height);
+  dbus_message_iter_init_append (reply, &iter);
+  append_rect (&iter, x, y, width, height);
+  return reply;
+}
+
+static DBusMessage *
+impl_GetPosition (DBusMessage *message, guint node)
+{
+  gint x, y, width, height;
+  dbus_int32_t dx, dy;
+
+  node_extents (node, &x, &y, &width, &height);
+  dx = x;
+  dy = y;
+  return new_reply (message, DBUS_TYPE_INT32, &dx, DBUS_TYPE_INT32, &dy,
+                    DBUS_TYPE_INVALID);
+}
+
+static DBusMessage *
+impl_GetSize (DBusMessage *message, guint node)
+{
+  gint x, y, width, height;
+  dbus_int32_t dw, dh;
+
+  node_extents (node, &x, &y, &width, &height);
+  dw = width;
+  dh = height;
+  return new_reply (message, DBUS_TYPE_INT32, &dw, DBUS_TYPE_INT32, &dh,
+                    DBUS_TYPE_INVALID);
+}
+
+/* Text: characters are laid out in fixed-size cells, wrapping at the
+ * width of the object, and attributes alternate in fixed-length runs. */
+
+static void
+character_extents (guint node, gint offset, gint *cx, gint *cy)
+{
+  gint x, y, width, height, per_line;
+
+  node_extents (node, &x, &y, &width, &height);
+  per_line = MAX (width / CHAR_WIDTH, 1);
+  *cx = x + (offset % per_line) * CHAR_WIDTH;
+  *cy = y + (offset / per_line) * LINE_HEIGHT;
+}
+
+static gint
+clamp_offset (gint offset)
+{
+  return CLAMP (offset, 0, text_size);
+}
+
+static DBusMessage *
+impl_GetText (DBusMessage *message, guint node)
+{
+  dbus_int32_t start, end;
+  DBusMessage *reply;
+  gchar *str;
+
+  if (!dbus_message_get_args (message, NULL, DBUS_TYPE_INT32, &start,
+                              DBUS_TYPE_INT32, &end, DBUS_TYPE_INVALID))
+    return dbus_message_new_error (message, DBUS_ERROR_INVALID_ARGS, "Invalid arguments");
+  if (end < 0)
+    end = text_size;
+  start = clamp_offset (start);
+  end = MAX (clamp_offset (end), start);
+  str = g_strndup (text + start, end - start);
+  reply = new_reply (message, DBUS_TYPE_STRING, &str, DBUS_TYPE_INVALID);
+  g_free (str);
+  return reply;
+}
+
+static DBusMessage *
+impl_GetCharacterAtOffset (DBusMessage *message, guint node)
+{
+  dbus_int32_t offset, c = 0;
+
+  if (!dbus_message_get_args (message, NULL, DBUS_TYPE_INT32, &offset,
+                              DBUS_TYPE_INVALID))
+    return dbus_message_new_error (message, DBUS_ERROR_INVALID_ARGS, "Invalid arguments");
+  if (offset >= 0 && offset < text_size)
+    c = text[offset];
+  return new_reply (message, DBUS_TYPE_INT32, &c, DBUS_TYPE_INVALID);
+}
+
+static DBusMessage *
+impl_GetTextAtOffset (DBusMessage *message, guint node)
+{
+  dbus_int32_t offset, start, end;
+  dbus_uint32_t type;
+  DBusMessage *reply;
+  gchar *str;
+
+  if (!dbus_message_get_args (message, NULL, DBUS_TYPE_INT32, &offset,
+                              DBUS_TYPE_UINT32, &type, DBUS_TYPE_INVALID))
+    return dbus_message_new_error (message, DBUS_ERROR_INVALID_ARGS, "Invalid arguments");
+
+  offset = clamp_offset (offset);
+  if (!strcmp (dbus_message_get_member (message), "GetTextBeforeOffset"))
+    offset = MAX (offset - 1, 0);
+
+  switch (type)
+  {
+  case ATSPI_TEXT_BOUNDARY_CHAR:
+    start = offset;
+    end = MIN (offset + 1, text_size);
+    break;
+  case ATSPI_TEXT_BOUNDARY_WORD_START:
+  case ATSPI_TEXT_BOUNDARY_WORD_END:
+    start = offset;
+    while (start > 0 && text[start - 1] != ' ')
+      start--;
+    end = offset;
+    while (end < text_size && text[end] != ' ')
+      end++;
+    end = MIN (end + 1, text_size);
+    break;
+  default:
+    start = 0;
+    end = text_size;
+    break;
+  }
+
+  if (!strcmp (dbus_message_get_member (message), "GetTextAfterOffset") &&
+      end < text_size && type != ATSPI_TEXT_BOUNDARY_CHAR)
+  {
+    start = end;
+    while (end < text_size && text[end] != ' ')
+      end++;
+    end = MIN (end + 1, text_size);
+  }
+
+  str = g_strndup (text + start, end - start);
+  reply = new_reply (message, DBUS_TYPE_STRING, &str, DBUS_TYPE_INT32, &start,
+                     DBUS_TYPE_INT32, &end, DBUS_TYPE_INVALID);
+  g_free (str);
+  return reply;
+}
+
+static DBusMessage *
+impl_GetCharacterExtents (DBusMessage *message, guint node)
+{
+  DBusMessage *reply;
+  DBusMessageIter iter;
+  dbus_int32_t offset;
+  dbus_uint32_t coord_type;
+  gint x, y;
+
+  if (!dbus_message_get_args (message, NULL, DBUS_TYPE_INT32, &offset,
+                              DBUS_TYPE_UINT32, &coord_type, DBUS_TYPE_INVALID))
+    return dbus_message_new_error (message, DBUS_ERROR_INVALID_ARGS, "Invalid arguments");
+
+  reply = dbus_message_new_method_return (message);
+  dbus_message_iter_init_append (reply, &iter);
+  character_extents (node, clamp_offset (offset), &x, &y);
+  append_rect (&iter, x, y, CHAR_WIDTH, LINE_HEIGHT);
+  return reply;
+}
+
+static DBusMessage *
+impl_GetCharacterExtentsForRange (DBusMessage *message, guint node)
+{
+  DBusMessage *reply;
+  DBusMessageIter iter, iter_array;
+  dbus_int32_t start, end;
+  dbus_uint32_t coord_type;
+  gint offset;
+
+  if (!dbus_message_get_args (message, NULL, DBUS_TYPE_INT32, &start,
+                              DBUS_TYPE_INT32, &end,
+                              DBUS_TYPE_UINT32, &coord_type, DBUS_TYPE_INVALID))
+    return dbus_message_new_error (message, DBUS_ERROR_INVALID_ARGS, "Invalid arguments");
+
+  reply = dbus_message_new_method_return (message);
+  dbus_message_iter_init_append (reply, &iter);
+  dbus_message_iter_open_container (&iter, DBUS_TYPE_ARRAY, "(iiii)", &iter_array);
+  for (offset = clamp_offset (start); offset < clamp_offset (end); offset++)
+  {
+    gint x, y;
+    character_extents (node, offset, &x, &y);
+    append_rect (&iter_array, x, y, CHAR_WIDTH, LINE_HEIGHT);
+  }
+  dbus_message_iter_close_container (&iter, &iter_array);
+  return reply;
+}
+
+static DBusMessage *
+impl_GetRangeExtents (DBusMessage *message, guint node)
+{
+  DBusMessage *reply;
+  DBusMessageIter iter;
+  dbus_int32_t start, end;
+  dbus_uint32_t coord_type;
+  gint x, y, width, height, sx, sy, ex, ey;
+
+  if (!dbus_message_get_args (message, NULL, DBUS_TYPE_INT32, &start,
+                              DBUS_TYPE_INT32, &end,
+                              DBUS_TYPE_UINT32, &coord_type, DBUS_TYPE_INVALID))
+    return dbus_message_new_error (message, DBUS_ERROR_INVALID_ARGS, "Invalid arguments");
+
+  node_extents (node, &x, &y, &width, &height);
+  character_extents (node, clamp_offset (start), &sx, &sy);
+  character_extents (node, MAX (clamp_offset (end) - 1, 0), &ex, &ey);
+  reply = dbus_message_new_method_return (message);
+  dbus_message_iter_init_append (reply, &iter);
+  if (sy == ey)
+    append_rect (&iter, sx, sy, ex + CHAR_WIDTH - sx, LINE_HEIGHT);
+  else
+    append_rect (&iter, x, sy, width, ey + LINE_HEIGHT - sy);
+  return reply;
+}
+
+static DBusMessage *
+impl_GetAttributeRun (DBusMessage *message, guint node)
+{
+  DBusMessage *reply;
+  DBusMessageIter iter;
+  dbus_int32_t offset, start, end;
+  const char *bold[] = { "weight", "700", NULL };
+  const char *regular[] = { "weight", "400", NULL };
+
+  /* GetAttributeRun also carries include_defaults, which is ignored */
+  if (!dbus_message_get_args (message, NULL, DBUS_TYPE_INT32, &offset,
+                              DBUS_TYPE_INVALID))
+    return dbus_message_new_error (message, DBUS_ERROR_INVALID_ARGS, "Invalid arguments");
+
+  offset = clamp_offset (offset);
+  start = offset - offset % ATTRIBUTE_RUN_LENGTH;
+  end = MIN (start + ATTRIBUTE_RUN_LENGTH, text_size);
+
+  reply = dbus_message_new_method_return (message);
+  dbus_message_iter_init_append (reply, &iter);
+  append_attributes (&iter, (offset / ATTRIBUTE_RUN_LENGTH) % 2 ? bold : regular);
+  dbus_message_iter_append_basic (&iter, DBUS_TYPE_INT32, &start);
+  dbus_message_iter_append_basic (&iter, DBUS_TYPE_INT32, &end);
+  return reply;
+}
+
+static DBusMessage *
+impl_GetDefaultAttributes (DBusMessage *message, guint node)
+{
+  DBusMessage *reply = dbus_message_new_method_return (message);
+  DBusMessageIter iter;
+  const char *defaults[] = { "weight", "400", "family-name", "Monospace", NULL };
+
+  dbus_message_iter_init_append (reply, &iter);
+  append_attributes (&iter, defaults);
+  return reply;
+}
+
+static DBusMessage *
+impl_GetOffsetAtPoint (DBusMessage *message, guint node)
+{
+  dbus_int32_t px, py, offset = -1;
+  dbus_uint32_t coord_type;
+  gint x, y, width, height, per_line;
+
+  if (!dbus_message_get_args (message, NULL, DBUS_TYPE_INT32, &px,
+                              DBUS_TYPE_INT32, &py,
+                              DBUS_TYPE_UINT32, &coord_type, DBUS_TYPE_INVALID))
+    return dbus_message_new_error (message, DBUS_ERROR_INVALID_ARGS, "Invalid arguments");
+
+  node_extents (node, &x, &y, &width, &height);
+  per_line = MAX (width / CHAR_WIDTH, 1);
+  if (px >= x && px < x + per_line * CHAR_WIDTH && py >= y)
+  {
+    offset = ((py - y) / LINE_HEIGHT) * per_line + (px - x) / CHAR_WIDTH;
+    if (offset >= text_size)
+      offset = -1;
+  }
+  return new_reply (message, DBUS_TYPE_INT32, &offset, DBUS_TYPE_INVALID);
+}
+
+/* Table: the cells are the children of the table, laid out row by row */
+
+static DBusMessage *
+impl_GetAccessibleAt (DBusMessage *message, guint node)
+{
+  dbus_int32_t row, column;
+  guint columns = table_columns (node);
+  gint64 index;
+
+  if (!dbus_message_get_args (message, NULL, DBUS_TYPE_INT32, &row,
+                              DBUS_TYPE_INT32, &column, DBUS_TYPE_INVALID))
+    return dbus_message_new_error (message, DBUS_ERROR_INVALID_ARGS, "Invalid arguments");
+
+  index = (gint64) row * columns + column;
+  if (row < 0 || column < 0 || column >= columns ||
+      index >= node_child_count (node))
+    return new_reference_reply (message, -1);
+  return new_reference_reply (message, node_child (node, index));
+}
+
+static DBusMessage *
+impl_GetIndexAt (DBusMessage *message, guint node)
+{
+  dbus_int32_t row, column, index;
+
+  if (!dbus_message_get_args (message, NULL, DBUS_TYPE_INT32, &row,
+                              DBUS_TYPE_INT32, &column, DBUS_TYPE_INVALID))
+    return dbus_message_new_error (message, DBUS_ERROR_INVALID_ARGS, "Invalid arguments");
+  index = row * table_columns (node) + column;
+  if (index >= node_child_count (node))
+    index = -1;
+  return new_reply (message, DBUS_TYPE_INT32, &index, DBUS_TYPE_INVALID);
+}
+
+static DBusMessage *
+impl_GetRowColumnAtIndex (DBusMessage *message, guint node)
+{
+  dbus_int32_t index, ret;
+
+  if (!dbus_message_get_args (message, NULL, DBUS_TYPE_INT32, &index,
+                              DBUS_TYPE_INVALID))
+    return dbus_message_new_error (message, DBUS_ERROR_INVALID_ARGS, "Invalid arguments");
+  if (!strcmp (dbus_message_get_member (message), "GetRowAtIndex"))
+    ret = index / table_columns (node);
+  else
+    ret = index % table_columns (node);
+  return new_reply (message, DBUS_TYPE_INT32, &ret, DBUS_TYPE_INVALID);
+}
+
+static DBusMessage *
+impl_GetRowColumnDescription (DBusMessage *message, guint node)
+{
+  dbus_int32_t index;
+  DBusMessage *reply;
+  gchar *str;
+
+  if (!dbus_message_get_args (message, NULL, DBUS_TYPE_INT32, &index,
+                              DBUS_TYPE_INVALID))
+    return dbus_message_new_error (message, DBUS_ERROR_INVALID_ARGS, "Invalid arguments");
+  str = g_strdup_printf ("%s %d",
+                         strstr (dbus_message_get_member (message), "Row") ?
+                         "row" : "column", index);
+  reply = new_reply (message, DBUS_TYPE_STRING, &str, DBUS_TYPE_INVALID);
+  g_free (str);
+  return reply;
+}
+
+static DBusMessage *
+impl_GetRowColumnExtentsAtIndex (DBusMessage *message, guint node)
+{
+  dbus_int32_t index, row, column, extent = 1;
+  dbus_bool_t ret, selected = FALSE;
+
+  if (!dbus_message_get_args (message, NULL, DBUS_TYPE_INT32, &index,
+                              DBUS_TYPE_INVALID))
+    return dbus_message_new_error (message, DBUS_ERROR_INVALID_ARGS, "Invalid arguments");
+  ret = (index >= 0 && index < node_child_count (node));
+  row = index / table_columns (node);
+  column = index % table_columns (node);
+  return new_reply (message, DBUS_TYPE_BOOLEAN, &ret, DBUS_TYPE_INT32, &row,
+                    DBUS_TYPE_INT32, &column, DBUS_TYPE_INT32, &extent,
+                    DBUS_TYPE_INT32, &extent, DBUS_TYPE_BOOLEAN, &selected,
+                    DBUS_TYPE_INVALID);
+}
+
+static DBusMessage *
+impl_GetSelectedRowsColumns (DBusMessage *message, guint node)
+{
+  DBusMessage *reply = dbus_message_new_method_return (message);
+  DBusMessageIter iter, iter_array;
+
+  dbus_message_iter_init_append (reply, &iter);
+  dbus_message_iter_open_container (&iter, DBUS_TYPE_ARRAY, "i", &iter_array);
+  dbus_message_iter_close_container (&iter, &iter_array);
+  return reply;
+}
+
+/* Collection: only the role criterion of the match rule is honoured */
+
+static gboolean
+role_matches (guint node, dbus_int32_t *roles, dbus_int32_t match_type)
+{
+  AtspiRole role = node_role (node);
+  gboolean in_set = (role < 128 &&
+                     (roles[role / 32] & (1 << (role % 32))) != 0);
+
+  switch (match_type)
+  {
+  case ATSPI_Collection_MATCH_ALL:
+  case ATSPI_Collection_MATCH_ANY:
+    return in_set;
+  case ATSPI_Collection_MATCH_NONE:
+    return !in_set;
+  default:
+    return TRUE;
+  }
+}
+
+static void
+append_matches (DBusMessageIter *iter, guint node, dbus_int32_t *roles,
+                dbus_int32_t match_type, gboolean invert, dbus_int32_t *count)
+{
+  guint i, n = node_child_count (node);
+
+  for (i = 0; i < n && *count != 0; i++)
+  {
+    guint child = node_child (node, i);
+
+    if (role_matches (child, roles, match_type) != invert)
+    {
+      append_reference (iter, child);
+      if (*count > 0)
+        (*count)--;
+    }
+    append_matches (iter, child, roles, match_type, invert, count);
+  }
+}
+
+static DBusMessage *
+impl_GetMatches (DBusMessage *message, guint node)
+{
+  DBusMessage *reply;
+  DBusMessageIter iter, iter_rule, iter_array;
+  dbus_int32_t roles[4] = { 0 };
+  dbus_int32_t match_type = ATSPI_Collection_MATCH_EMPTY, count;
+  dbus_bool_t invert = FALSE;
+  gint field, n = 0;
+
+  if (strcmp (dbus_message_get_signature (message), "(aiia{ss}iaiiasib)uib"))
+    return dbus_message_new_error (message, DBUS_ERROR_INVALID_ARGS, "Invalid arguments");
+
+  dbus_message_iter_init (message, &iter);
+  dbus_message_iter_recurse (&iter, &iter_rule);
+  for (field = 0; field < 9; field++, dbus_message_iter_next (&iter_rule))
+  {
+    if (field == 4)
+    {
+      dbus_message_iter_recurse (&iter_rule, &iter_array);
+      while (n < 4 &&
+             dbus_message_iter_get_arg_type (&iter_array) == DBUS_TYPE_INT32)
+      {
+        dbus_message_iter_get_basic (&iter_array, &roles[n++]);
+        dbus_message_iter_next (&iter_array);
+      }
+    }
+    else if (field == 5)
+      dbus_message_iter_get_basic (&iter_rule, &match_type);
+    else if (field == 8)
+      dbus_message_iter_get_basic (&iter_rule, &invert);
+  }
+  dbus_message_iter_next (&iter);
+  dbus_message_iter_next (&iter);
+  dbus_message_iter_get_basic (&iter, &count);
+  if (count == 0)
+    count = -1;
+
+  reply = dbus_message_new_method_return (message);
+  dbus_message_iter_init_append (reply, &iter);
+  dbus_message_iter_open_container (&iter, DBUS_TYPE_ARRAY, "(so)", &iter_array);
+  append_matches (&iter_array, node, roles, match_type, invert, &count);
+  dbus_message_iter_close_container (&iter, &iter_array);
+  return reply;
+}
+
+/* Cache */
+
+static DBusMessage *
+impl_GetItems (DBusMessage *message)
+{
+  DBusMessage *reply = dbus_message_new_method_return (message);
+  DBusMessageIter iter, iter_array, iter_struct;
+  guint node;
+
+  dbus_message_iter_init_append (reply, &iter);
+  dbus_message_iter_open_container (&iter, DBUS_TYPE_ARRAY,
+                                    "((so)(so)(so)iiassusau)", &iter_array);
+  for (node = 0; node < n_nodes; node++)
+  {
+    dbus_int32_t index = node_index_in_parent (node);
+    dbus_int32_t count = node_child_count (node);
+    dbus_uint32_t role = node_role (node);
+    gchar *name = node_name (node);
+    const char *description = "";
+
+    dbus_message_iter_open_container (&iter_array, DBUS_TYPE_STRUCT, NULL,
+                                      &iter_struct);
+    append_reference (&iter_struct, node);
+    append_reference (&iter_struct, 0);
+    append_reference (&iter_struct, node_parent (node));
+    dbus_message_iter_append_basic (&iter_struct, DBUS_TYPE_INT32, &index);
+    dbus_message_iter_append_basic (&iter_struct, DBUS_TYPE_INT32, &count);
+    append_interfaces (&iter_struct, node);
+    dbus_message_iter_append_basic (&iter_struct, DBUS_TYPE_STRING, &name);
+    dbus_message_iter_append_basic (&iter_struct, DBUS_TYPE_UINT32, &role);
+    dbus_message_iter_append_basic (&iter_struct, DBUS_TYPE_STRING, &description);
+    append_states (&iter_struct, node);
+    dbus_message_iter_close_container (&iter_array, &iter_struct);
+    g_free (name);
+  }
+  dbus_message_iter_close_container (&iter, &iter_array);
+  return reply;
+}
+
+/* Event storms */
+
+static void
+emit_event (guint node, const char *klass, const char *member,
+            const char *detail, dbus_int32_t detail1, dbus_int32_t detail2,
+            const char *type, const void *value)
+{
+  DBusMessage *signal;
+  DBusMessageIter iter, iter_variant, iter_dict;
+  gchar path[64];
+  gchar *iface = g_strconcat ("org.a11y.atspi.Event.", klass, NULL);
+
+  node_path (node, path, sizeof (path));
+  signal = dbus_message_new_signal (path, iface, member);
+  dbus_message_iter_init_append (signal, &iter);
+  dbus_message_iter_append_basic (&iter, DBUS_TYPE_STRING, &detail);
+  dbus_message_iter_append_basic (&iter, DBUS_TYPE_INT32, &detail1);
+  dbus_message_iter_append_basic (&iter, DBUS_TYPE_INT32, &detail2);
+  dbus_message_iter_open_container (&iter, DBUS_TYPE_VARIANT, type, &iter_variant);
+  if (!strcmp (type, "(so)"))
+    append_reference (&iter_variant, *(const gint *) value);
+  else if (!strcmp (type, "(iiii)"))
+  {
+    const gint *r = value;
+    append_rect (&iter_variant, r[0], r[1], r[2], r[3]);
+  }
+  else
+    dbus_message_iter_append_basic (&iter_variant, type[0], value);
+  dbus_message_iter_close_container (&iter, &iter_variant);
+  dbus_message_iter_open_container (&iter, DBUS_TYPE_ARRAY, "{sv}", &iter_dict);
+  dbus_message_iter_close_container (&iter, &iter_dict);
+
+  dbus_connection_send (bus, signal, NULL);
+  dbus_message_unref (signal);
+  g_free (iface);
+}
+
+static gboolean
+emit_storm_event (const char *kind, guint k)
+{
+  guint node = (n_nodes > 1 ? 1 + k % (n_nodes - 1) : 0);
+  dbus_int32_t zero = 0;
+
+  if (!strcmp (kind, "property-change"))
+  {
+    gchar *name;
+    generation++;
+    name = node_name (node);
+    emit_event (node, "Object", "PropertyChange", "accessible-name", 0, 0,
+                "s", &name);
+    g_free (name);
+  }
+  else if (!strcmp (kind, "state-changed"))
+    emit_event (node, "Object", "StateChanged", "showing", 1, 0, "i", &zero);
+  else if (!strcmp (kind, "focus"))
+    emit_event (node, "Focus", "Focus", "", 0, 0, "i", &zero);
+  else if (!strcmp (kind, "children-changed"))
+  {
+    /* Re-announcing an existing child leaves the tree unchanged */
+    gint child = node;
+    emit_event (MAX (node_parent (node), 0), "Object", "ChildrenChanged",
+                "add", node_index_in_parent (node), 0, "(so)", &child);
+  }
+  else if (!strcmp (kind, "bounds-changed"))
+  {
+    gint r[4];
+    node_extents (node, &r[0], &r[1], &r[2], &r[3]);
+    emit_event (node, "Object", "BoundsChanged", "", 0, 0, "(iiii)", r);
+  }
+  else if (!strcmp (kind, "text-changed"))
+  {
+    const char *inserted = "x";
+    while (!node_is_text (node) && node + 1 < n_nodes)
+      node++;
+    emit_event (node, "Object", "TextChanged", "insert", 0, 1, "s", &inserted);
+  }
+  else
+    return FALSE;
+  return TRUE;
+}
+
+static DBusMessage *
+impl_EmitStorm (DBusMessage *message)
+{
+  const char *kind;
+  dbus_uint32_t count, k;
+
+  if (!dbus_message_get_args (message, NULL, DBUS_TYPE_STRING, &kind,
+                              DBUS_TYPE_UINT32, &count, DBUS_TYPE_INVALID))
+    return dbus_message_new_error (message, DBUS_ERROR_INVALID_ARGS, "Invalid arguments");
+
+  for (k = 0; k < count; k++)
+    if (!emit_storm_event (kind, k))
+      return dbus_message_new_error (message, DBUS_ERROR_INVALID_ARGS,
+                                     "Unknown event kind");
+
+  /* Signals sent before the reply are delivered before it */
+  return new_reply (message, DBUS_TYPE_UINT32, &count, DBUS_TYPE_INVALID);
+}
+
+/* Dispatch */
+
+static DBusHandlerResult
+handle_message (DBusConnection *connection, DBusMessage *message, void *user_data)
+{
+  const char *iface = dbus_message_get_interface (message);
+  const char *member = dbus_message_get_member (message);
+  DBusMessage *reply = NULL;
+  gint node;
+
+  if (dbus_message_get_type (message) != DBUS_MESSAGE_TYPE_METHOD_CALL ||
+      !iface || !member)
+    return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+
+  if (strcmp (iface, SYNTHETIC_INTERFACE) != 0)
+    n_calls++;
+
+  if (!strcmp (dbus_message_get_path (message), CACHE_PATH))
+  {
+    if (!strcmp (iface, ATSPI_DBUS_INTERFACE_CACHE) && !strcmp (member, "GetItems"))
+      reply = impl_GetItems (message);
+  }
+  else if ((node = node_from_path (dbus_message_get_path (message))) < 0)
+    reply = dbus_message_new_error (message, DBUS_ERROR_UNKNOWN_OBJECT,
+                                    "No such object");
+  else if (!strcmp (iface, PROPERTIES_INTERFACE))
+  {
+    if (!strcmp (member, "Get"))
+      reply = impl_Get (message, node);
+    else if (!strcmp (member, "GetAll"))
+      reply = impl_GetAll (message, node);
+    else if (!strcmp (member, "Set"))
+      reply = dbus_message_new_method_return (message);
+  }
+  else if (!strcmp (iface, ATSPI_DBUS_INTERFACE_ACCESSIBLE))
+  {
+    if (!strcmp (member, "GetChildAtIndex"))
+      reply = impl_GetChildAtIndex (message, node);
+    else if (!strcmp (member, "GetChildren"))
+      reply = impl_GetChildren (message, node);
+    else if (!strcmp (member, "GetIndexInParent"))
+    {
+      dbus_int32_t index = node_index_in_parent (node);
+      reply = new_reply (message, DBUS_TYPE_INT32, &index, DBUS_TYPE_INVALID);
+    }
+    else if (!strcmp (member, "GetRelationSet"))
+      reply = impl_GetRelationSet (message, node);
+    else if (!strcmp (member, "GetRole"))
+    {
+      dbus_uint32_t role = node_role (node);
+      reply = new_reply (message, DBUS_TYPE_UINT32, &role, DBUS_TYPE_INVALID);
+    }
+    else if (!strcmp (member, "GetRoleName") ||
+             !strcmp (member, "GetLocalizedRoleName"))
+      reply = impl_GetRoleName (message, node);
+    else if (!strcmp (member, "GetState"))
+      reply = impl_GetState (message, node);
+    else if (!strcmp (member, "GetAttributes"))
+      reply = impl_GetAttributes (message, node);
+    else if (!strcmp (member, "GetApplication"))
+      reply = new_reference_reply (message, 0);
+    else if (!strcmp (member, "GetInterfaces"))
+      reply = impl_GetInterfaces (message, node);
+  }
+  else if (!strcmp (iface, ATSPI_DBUS_INTERFACE_COMPONENT))
+  {
+    if (!strcmp (member, "Contains"))
+      reply = impl_Contains (message, node);
+    else if (!strcmp (member, "GetAccessibleAtPoint"))
+      reply = impl_GetAccessibleAtPoint (message, node);
+    else if (!strcmp (member, "GetExtents"))
+      reply = impl_GetExtents (message, node);
+    else if (!strcmp (member, "GetPosition"))
+      reply = impl_GetPosition (message, node);
+    else if (!strcmp (member, "GetSize"))
+      reply = impl_GetSize (message, node);
+    else if (!strcmp (member, "GetLayer"))
+    {
+      dbus_uint32_t layer = ATSPI_LAYER_WIDGET;
+      reply = new_reply (message, DBUS_TYPE_UINT32, &layer, DBUS_TYPE_INVALID);
+    }
+    else if (!strcmp (member, "GetMDIZOrder"))
+    {
+      dbus_int16_t order = 0;
+      reply = new_reply (message, DBUS_TYPE_INT16, &order, DBUS_TYPE_INVALID);
+    }
+    else if (!strcmp (member, "GrabFocus"))
+    {
+      dbus_bool_t ret = FALSE;
+      reply = new_reply (message, DBUS_TYPE_BOOLEAN, &ret, DBUS_TYPE_INVALID);
+    }
+    else if (!strcmp (member, "GetAlpha"))
+    {
+      double alpha = 1.0;
+      reply = new_reply (message, DBUS_TYPE_DOUBLE, &alpha, DBUS_TYPE_INVALID);
+    }
+  }
+  else if (!strcmp (iface, ATSPI_DBUS_INTERFACE_COLLECTION))
+  {
+    if (!strcmp (member, "GetMatches"))
+      reply = impl_GetMatches (message, node);
+  }
+  else if (!strcmp (iface, ATSPI_DBUS_INTERFACE_TEXT) && node_is_text (node))
+  {
+    if (!strcmp (member, "GetText"))
+      reply = impl_GetText (message, node);
+    else if (!strcmp (member, "GetCharacterAtOffset"))
+      reply = impl_GetCharacterAtOffset (message, node);
+    else if (!strcmp (member, "GetTextAtOffset") ||
+             !strcmp (member, "GetTextBeforeOffset") ||
+             !strcmp (member, "GetTextAfterOffset"))
+      reply = impl_GetTextAtOffset (message, node);
+    else if (!strcmp (member, "GetCharacterExtents"))
+      reply = impl_GetCharacterExtents (message, node);
+    else if (!strcmp (member, "GetCharacterExtentsForRange"))
+      reply = impl_GetCharacterExtentsForRange (message, node);
+    else if (!strcmp (member, "GetRangeExtents"))
+      reply = impl_GetRangeExtents (message, node);
+    else if (!strcmp (member, "GetAttributeRun") ||
+             !strcmp (member, "GetAttributes"))
+      reply = impl_GetAttributeRun (message, node);
+    else if (!strcmp (member, "GetDefaultAttributes") ||
+             !strcmp (member, "GetDefaultAttributeSet"))
+      reply = impl_GetDefaultAttributes (message, node);
+    else if (!strcmp (member, "GetOffsetAtPoint"))
+      reply = impl_GetOffsetAtPoint (message, node);
+    else if (!strcmp (member, "GetNSelections"))
+    {
+      dbus_int32_t n = 0;
+      reply = new_reply (message, DBUS_TYPE_INT32, &n, DBUS_TYPE_INVALID);
+    }
+  }
+  else if (!strcmp (iface, ATSPI_DBUS_INTERFACE_TABLE) && node_is_table (node))
+  {
+    if (!strcmp (member, "GetAccessibleAt"))
+      reply = impl_GetAccessibleAt (message, node);
+    else if (!strcmp (member, "GetIndexAt"))
+      reply = impl_GetIndexAt (message, node);
+    else if (!strcmp (member, "GetRowAtIndex") ||
+             !strcmp (member, "GetColumnAtIndex"))
+      reply = impl_GetRowColumnAtIndex (message, node);
+    else if (!strcmp (member, "GetRowDescription") ||
+             !strcmp (member, "GetColumnDescription"))
+      reply = impl_GetRowColumnDescription (message, node);
+    else if (!strcmp (member, "GetRowExtentAt") ||
+             !strcmp (member, "GetColumnExtentAt"))
+    {
+      dbus_int32_t extent = 1;
+      reply = new_reply (message, DBUS_TYPE_INT32, &extent, DBUS_TYPE_INVALID);
+    }
+    else if (!strcmp (member, "GetRowHeader") ||
+             !strcmp (member, "GetColumnHeader"))
+      reply = new_reference_reply (message, -1);
+    else if (!strcmp (member, "GetSelectedRows") ||
+             !strcmp (member, "GetSelectedColumns"))
+      reply = impl_GetSelectedRowsColumns (message, node);
+    else if (!strcmp (member, "IsRowSelected") ||
+             !strcmp (member, "IsColumnSelected") ||
+             !strcmp (member, "IsSelected"))
+    {
+      dbus_bool_t ret = FALSE;
+      reply = new_reply (message, DBUS_TYPE_BOOLEAN, &ret, DBUS_TYPE_INVALID);
+    }
+    else if (!strcmp (member, "GetRowColumnExtentsAtIndex"))
+      reply = impl_GetRowColumnExtentsAtIndex (message, node);
+  }
+  else if (!strcmp (iface, ATSPI_DBUS_INTERFACE_APPLICATION) && node == 0)
+  {
+    if (!strcmp (member, "GetApplicationBusAddress"))
+    {
+      /* No peer-to-peer connection; everything goes through the bus */
+      const char *address = "";
+      reply = new_reply (message, DBUS_TYPE_STRING, &address, DBUS_TYPE_INVALID);
+    }
+    else if (!strcmp (member, "GetLocale"))
+    {
+      const char *locale = "en_US";
+      reply = new_reply (message, DBUS_TYPE_STRING, &locale, DBUS_TYPE_INVALID);
+    }
+  }
+  else if (!strcmp (iface, SYNTHETIC_INTERFACE) && node == 0)
+  {
+    if (!strcmp (member, "EmitStorm"))
+      reply = impl_EmitStorm (message);
+    else if (!strcmp (member, "TakeCallCount"))
+    {
+      dbus_uint32_t count = n_calls;
+      n_calls = 0;
+      reply = new_reply (message, DBUS_TYPE_UINT32, &count, DBUS_TYPE_INVALID);
+    }
+  }
+
+  if (!reply)
+    reply = dbus_message_new_error (message, DBUS_ERROR_UNKNOWN_METHOD, member);
+
+  dbus_connection_send (connection, reply, NULL);
+  dbus_message_unref (reply);
+  return DBUS_HANDLER_RESULT_HANDLED;
+}
+
+static DBusObjectPathVTable vtable = { NULL, handle_message };
+
+static void
+embed (void)
+{
+  DBusMessage *message, *reply;
+  DBusMessageIter iter;
+  DBusError error;
+
+  message = dbus_message_new_method_call (ATSPI_DBUS_NAME_REGISTRY,
+                                          ATSPI_DBUS_PATH_ROOT,
+                                          ATSPI_DBUS_INTERFACE_SOCKET,
+                                          "Embed");
+  dbus_message_iter_init_append (message, &iter);
+  append_reference (&iter, 0);
+
+  dbus_error_init (&error);
+  reply = dbus_connection_send_with_reply_and_block (bus, message, -1, &error);
+  dbus_message_unref (message);
+  if (reply)
+    dbus_message_unref (reply);
+  else
+  {
+    /* Still reachable by bus name, just not listed on the desktop */
+    g_warning ("synthetic-app: could not embed in the registry: %s",
+               error.message);
+    dbus_error_free (&error);
+  }
+}
+
+static gchar *
+generate_text (gint size)
+{
+  static const char words[] = "the quick brown fox jumps over the lazy dog ";
+  gchar *str = g_malloc (size + 1);
+  gint i;
+
+  for (i = 0; i < size; i++)
+    str[i] = words[i % (sizeof (words) - 1)];
+  str[size] = '\0';
+  return str;
+}
+
+int
+main (int argc, char *argv[])
+{
+  GOptionContext *context;
+  GError *error = NULL;
+  GMainLoop *loop;
+  guint64 total = 0, level = 1;
+  gint d;
+
+  context = g_option_context_new ("- synthetic accessible application");
+  g_option_context_add_main_entries (context, entries, NULL);
+  if (!g_option_context_parse (context, &argc, &argv, &error))
+  {
+    fprintf (stderr, "%s\n", error->message);
+    return 1;
+  }
+  g_option_context_free (context);
+
+  if (depth < 0 || fanout < 1 || text_size < 0)
+  {
+    fprintf (stderr, "Invalid tree shape\n");
+    return 1;
+  }
+  for (d = 0; d <= depth && total <= G_MAXINT; d++, level *= fanout)
+    total += level;
+  if (total > G_MAXINT)
+  {
+    fprintf (stderr, "Tree too large\n");
+    return 1;
+  }
+  n_nodes = total;
+  text = generate_text (text_size);
+
+  bus = atspi_get_a11y_bus ();
+  if (!bus)
+  {
+    fprintf (stderr, "Could not connect to the accessibility bus\n");
+    return 1;
+  }
+  atspi_dbus_connection_setup_with_g_main (bus, NULL);
+  dbus_connection_register_fallback (bus, "/org/a11y/atspi/accessible",
+                                     &vtable, NULL);
+  dbus_connection_register_object_path (bus, CACHE_PATH, &vtable, NULL);
+
+  embed ();
+
+  printf ("%s\n", dbus_bus_get_unique_name (bus));
+  fflush (stdout);
+
+  loop = g_main_loop_new (NULL, FALSE);
+  g_main_loop_run (loop);
+  return 0;
+}
@@ -0,0 +1,310 @@
+/*
+ * End-to-end latency benchmarks against the synthetic application.
+ *
+ * Each run measures one operation, named on the command line, and prints
+ * a single JSON object with the median and 99th percentile latency in
+ * microseconds and the number of method calls the application served per
+ * operation, so that results can be compared from one release to the next.
+ */
+
+#include "synthetic-helper.h"
+#include "atspi/atspi-accessible-private.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define TIMEOUT_US (30 * G_USEC_PER_SEC)
+#define N_TOUCHED 10000
+#define EVENT_BATCH 1000
+
+typedef struct
+{
+  const gchar *name;
+  gint depth;
+  gint fanout;
+  gint iterations;
+  gboolean (*run) (GArray *samples, guint *operations);
+} Benchmark;
+
+static guint n_events;
+
+static gdouble
+elapsed_us (gint64 start)
+{
+  return g_get_monotonic_time () - start;
+}
+
+static gboolean
+node_discovered (gpointer data)
+{
+  return (ATSPI_ACCESSIBLE (data)->cached_properties & ATSPI_CACHE_ROLE) != 0;
+}
+
+static gboolean
+events_received (gpointer data)
+{
+  return n_events >= GPOINTER_TO_UINT (data);
+}
+
+static gboolean
+run_until (gboolean (*done) (gpointer), gpointer data)
+{
+  gint64 deadline = g_get_monotonic_time () + TIMEOUT_US;
+
+  while (!done (data))
+  {
+    if (g_get_monotonic_time () > deadline)
+      return FALSE;
+    g_main_context_iteration (NULL, TRUE);
+  }
+  return TRUE;
+}
+
+/* Waits for the GetItems reply that populates the cache for the app */
+static gboolean
+wait_for_discovery (void)
+{
+  AtspiAccessible *last = synthetic_ref_node (synthetic_get_n_nodes () - 1);
+  gboolean ret = run_until (node_discovered, last);
+
+  g_object_unref (last);
+  return ret;
+}
+
+static guint
+walk (AtspiAccessible *accessible)
+{
+  guint total = 1;
+  gint i, n;
+
+  n = atspi_accessible_get_child_count (accessible, NULL);
+  for (i = 0; i < n; i++)
+  {
+    AtspiAccessible *child = atspi_accessible_get_child_at_index (accessible, i, NULL);
+    if (!child)
+      continue;
+    total += walk (child);
+    g_object_unref (child);
+  }
+  return total;
+}
+
+static gboolean
+run_walk (GArray *samples, guint *operations)
+{
+  AtspiAccessible *root = synthetic_get_root ();
+  gint64 start;
+  gdouble sample;
+  guint n;
+
+  atspi_accessible_clear_cache (root);
+  start = g_get_monotonic_time ();
+  n = walk (root);
+  sample = elapsed_us (start);
+  g_array_append_val (samples, sample);
+  (*operations)++;
+  g_object_unref (root);
+  return (n == synthetic_get_n_nodes ());
+}
+
+static gboolean
+run_first_touch (GArray *samples, guint *operations)
+{
+  AtspiAccessible *root = synthetic_get_root ();
+  guint i;
+
+  atspi_accessible_clear_cache (root);
+  g_object_unref (root);
+
+  for (i = 1; i <= N_TOUCHED; i++)
+  {
+    gint64 start = g_get_monotonic_time ();
+    AtspiAccessible *node = synthetic_ref_node (i);
+    gchar *name = atspi_accessible_get_name (node, NULL);
+    gdouble sample;
+
+    atspi_accessible_get_role (node, NULL);
+    sample = elapsed_us (start);
+    g_array_append_val (samples, sample);
+    (*operations)++;
+    g_free (name);
+    g_object_unref (node);
+  }
+  return TRUE;
+}
+
+static gboolean
+run_collection (GArray *samples, guint *operations)
+{
+  AtspiAccessible *root = synthetic_get_root ();
+  AtspiMatchRule *rule;
+  GArray *roles, *matches;
+  AtspiRole role = ATSPI_ROLE_PUSH_BUTTON;
+  gint64 start;
+  gdouble sample;
+  gint i;
+
+  roles = g_array_new (FALSE, FALSE, sizeof (AtspiRole));
+  g_array_append_val (roles, role);
+  rule = atspi_match_rule_new (NULL, ATSPI_Collection_MATCH_ALL,
+                               NULL, ATSPI_Collection_MATCH_ALL,
+                               roles, ATSPI_Collection_MATCH_ANY,
+                               NULL, ATSPI_Collection_MATCH_ALL, FALSE);
+  g_array_free (roles, TRUE);
+
+  start = g_get_monotonic_time ();
+  matches = atspi_collection_get_matches (ATSPI_COLLECTION (root), rule,
+                                          ATSPI_Collection_SORT_ORDER_CANONICAL,
+                                          0, TRUE, NULL);
+  sample = elapsed_us (start);
+  g_array_append_val (samples, sample);
+  (*operations)++;
+
+  g_object_unref (rule);
+  g_object_unref (root);
+  if (!matches || matches->len == 0)
+    return FALSE;
+  for (i = 0; i < matches->len; i++)
+    g_object_unref (g_array_index (matches, AtspiAccessible *, i));
+  g_array_free (matches, TRUE);
+  return TRUE;
+}
+
+static void
+on_event (AtspiEvent *event, void *data)
+{
+  n_events++;
+  g_boxed_free (ATSPI_TYPE_EVENT, event);
+}
+
+static gboolean
+run_events (GArray *samples, guint *operations)
+{
+  gint64 start;
+  gdouble sample;
+
+  n_events = 0;
+  start = g_get_monotonic_time ();
+  if (!synthetic_emit_storm ("state-changed", EVENT_BATCH, NULL) ||
+      !run_until (events_received, GUINT_TO_POINTER (EVENT_BATCH)))
+    return FALSE;
+  sample = elapsed_us (start) / EVENT_BATCH;
+  g_array_append_val (samples, sample);
+  *operations += EVENT_BATCH;
+  return TRUE;
+}
+
+static gboolean
+run_startup (GArray *samples, guint *operations)
+{
+  AtspiAccessible *root;
+  gint64 start;
+  gdouble sample;
+  gboolean ret;
+
+  if (!synthetic_restart (NULL))
+    return FALSE;
+  synthetic_take_call_count ();
+
+  start = g_get_monotonic_time ();
+  root = synthetic_get_root ();
+  ret = wait_for_discovery ();
+  sample = elapsed_us (start);
+  g_array_append_val (samples, sample);
+  (*operations)++;
+  g_object_unref (root);
+  return ret;
+}
+
+static const Benchmark benchmarks[] =
+{
+  { "walk", 4, 8, 20, run_walk },
+  { "first-touch", 4, 10, 1, run_first_touch },
+  { "collection", 4, 8, 50, run_collection },
+  { "events", 2, 8, 20, run_events },
+  { "startup", 4, 8, 10, run_startup },
+};
+
+static gint
+compare_samples (gconstpointer a, gconstpointer b)
+{
+  gdouble x = *(const gdouble *) a, y = *(const gdouble *) b;
+
+  return (x > y) - (x < y);
+}
+
+static gdouble
+percentile (GArray *samples, gint p)
+{
+  guint index = (samples->len * p + 99) / 100;
+
+  return g_array_index (samples, gdouble, MAX (index, 1) - 1);
+}
+
+int
+main (int argc, char *argv[])
+{
+  const Benchmark *benchmark = NULL;
+  AtspiEventListener *listener;
+  AtspiAccessible *root;
+  GError *error = NULL;
+  GArray *samples;
+  guint operations = 0, calls = 0;
+  gint i;
+
+  for (i = 0; argc > 1 && i < G_N_ELEMENTS (benchmarks); i++)
+    if (!strcmp (argv[1], benchmarks[i].name))
+      benchmark = &benchmarks[i];
+  if (!benchmark)
+  {
+    fprintf (stderr, "Usage: %s walk|first-touch|collection|events|startup\n",
+             argv[0]);
+    return 1;
+  }
+
+  if (!synthetic_start (benchmark->depth, benchmark->fanout, 16, &error))
+  {
+    fprintf (stderr, "Could not start the synthetic application: %s\n",
+             error->message);
+    return 1;
+  }
+  atspi_init ();
+
+  listener = atspi_event_listener_new (on_event, NULL, NULL);
+  atspi_event_listener_register (listener, "object:state-changed", NULL);
+
+  /* Keep cached values live, as an AT running the event loop would */
+  root = synthetic_get_root ();
+  atspi_accessible_set_cache_mask (root, ATSPI_CACHE_DEFAULT);
+  g_object_unref (root);
+  if (!wait_for_discovery ())
+  {
+    fprintf (stderr, "%s: the application was not discovered\n", benchmark->name);
+    return 1;
+  }
+
+  samples = g_array_new (FALSE, FALSE, sizeof (gdouble));
+  for (i = 0; i < benchmark->iterations; i++)
+  {
+    synthetic_take_call_count ();
+    if (!benchmark->run (samples, &operations))
+    {
+      fprintf (stderr, "%s: iteration %d failed\n", benchmark->name, i);
+      return 1;
+    }
+    calls += synthetic_take_call_count ();
+  }
+
+  g_array_sort (samples, compare_samples);
+  printf ("{\"benchmark\": \"%s\", \"nodes\": %u, \"operations\": %u, "
+          "\"p50_us\": %.1f, \"p99_us\": %.1f, \"calls_per_operation\": %.2f}\n",
+          benchmark->name, synthetic_get_n_nodes (), operations,
+          percentile (samples, 50), percentile (samples, 99),
+          (gdouble) calls / operations);
+
+  g_array_free (samples, TRUE);
+  g_object_unref (listener);
+  atspi_exit ();
+  synthetic_stop ();
+  return 0;
+}
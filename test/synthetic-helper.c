@@ -0,0 +1,284 @@
+/*
+ * Runs the synthetic application on a private accessibility bus.
+ *
+ * synthetic_start() spawns a dbus-daemon, points AT_SPI_BUS_ADDRESS at it,
+ * starts the registry daemon named by ATSPI_REGISTRYD (if set) and then the
+ * synthetic application named by SYNTHETIC_APP. It must be called before
+ * atspi_init(), so that libatspi connects to the private bus.
+ */
+
+#include "synthetic-helper.h"
+#include "atspi/atspi-misc-private.h"
+#include <signal.h>
+#include <string.h>
+#include <unistd.h>
+
+#define STARTUP_TIMEOUT_MS 10000
+#define SYNTHETIC_INTERFACE "org.a11y.atspi.test.Synthetic"
+
+static GPid bus_pid;
+static GPid registry_pid;
+static GPid app_pid;
+static gchar *app_name;
+static guint n_nodes;
+static gint app_depth, app_fanout, app_text_size;
+
+static gchar *
+read_line (gint fd)
+{
+  GString *line = g_string_new (NULL);
+  gchar c;
+
+  while (read (fd, &c, 1) == 1 && c != '\n')
+    g_string_append_c (line, c);
+  close (fd);
+  if (line->len == 0)
+  {
+    g_string_free (line, TRUE);
+    return NULL;
+  }
+  return g_string_free (line, FALSE);
+}
+
+static gchar *
+spawn_and_read_line (gchar **argv, GPid *pid, GError **error)
+{
+  gint out;
+  gchar *line;
+
+  if (!g_spawn_async_with_pipes (NULL, argv, NULL,
+                                 G_SPAWN_SEARCH_PATH | G_SPAWN_DO_NOT_REAP_CHILD,
+                                 NULL, NULL, pid, NULL, &out, NULL, error))
+    return NULL;
+
+  line = read_line (out);
+  if (!line)
+    g_set_error (error, G_SPAWN_ERROR, G_SPAWN_ERROR_FAILED,
+                 "%s exited without printing its address", argv[0]);
+  return line;
+}
+
+static gboolean
+wait_for_name (const gchar *name)
+{
+  DBusConnection *bus = atspi_get_a11y_bus ();
+  gint waited;
+
+  for (waited = 0; waited < STARTUP_TIMEOUT_MS; waited += 10)
+  {
+    if (dbus_bus_name_has_owner (bus, name, NULL))
+      return TRUE;
+    g_usleep (10 * 1000);
+  }
+  return FALSE;
+}
+
+static void
+stop_child (GPid *pid)
+{
+  if (!*pid)
+    return;
+  kill (*pid, SIGTERM);
+  g_spawn_close_pid (*pid);
+  *pid = 0;
+}
+
+static gboolean
+spawn_app (GError **error)
+{
+  gchar *app_argv[5];
+
+  app_argv[0] = (gchar *) g_getenv ("SYNTHETIC_APP");
+  app_argv[1] = g_strdup_printf ("--depth=%d", app_depth);
+  app_argv[2] = g_strdup_printf ("--fanout=%d", app_fanout);
+  app_argv[3] = g_strdup_printf ("--text-size=%d", app_text_size);
+  app_argv[4] = NULL;
+  app_name = spawn_and_read_line (app_argv, &app_pid, error);
+  g_free (app_argv[1]);
+  g_free (app_argv[2]);
+  g_free (app_argv[3]);
+  return (app_name != NULL);
+}
+
+gboolean
+synthetic_start (gint depth, gint fanout, gint text_size, GError **error)
+{
+  gchar *bus_argv[] = { "dbus-daemon", "--session", "--nofork",
+                        "--print-address=1", NULL };
+  gchar *address;
+  const gchar *registryd, *app;
+  guint64 level = 1, total = 0;
+  gint d;
+
+  app = g_getenv ("SYNTHETIC_APP");
+  if (!app)
+  {
+    g_set_error_literal (error, G_SPAWN_ERROR, G_SPAWN_ERROR_NOENT,
+                         "SYNTHETIC_APP is not set");
+    return FALSE;
+  }
+
+  address = spawn_and_read_line (bus_argv, &bus_pid, error);
+  if (!address)
+  {
+    synthetic_stop ();
+    return FALSE;
+  }
+  g_setenv ("AT_SPI_BUS_ADDRESS", address, TRUE);
+  g_free (address);
+
+  registryd = g_getenv ("ATSPI_REGISTRYD");
+  if (registryd && *registryd)
+  {
+    gchar *registry_argv[] = { (gchar *) registryd, NULL };
+
+    if (!g_spawn_async (NULL, registry_argv, NULL, G_SPAWN_DO_NOT_REAP_CHILD,
+                        NULL, NULL, &registry_pid, error))
+    {
+      synthetic_stop ();
+      return FALSE;
+    }
+    if (!wait_for_name (ATSPI_DBUS_NAME_REGISTRY))
+    {
+      g_set_error (error, G_SPAWN_ERROR, G_SPAWN_ERROR_FAILED,
+                   "%s did not register on the bus", registryd);
+      synthetic_stop ();
+      return FALSE;
+    }
+  }
+
+  app_depth = depth;
+  app_fanout = fanout;
+  app_text_size = text_size;
+  if (!spawn_app (error))
+  {
+    synthetic_stop ();
+    return FALSE;
+  }
+
+  for (d = 0; d <= depth; d++, level *= fanout)
+    total += level;
+  n_nodes = total;
+  return TRUE;
+}
+
+void
+synthetic_stop (void)
+{
+  stop_child (&app_pid);
+  stop_child (&registry_pid);
+  stop_child (&bus_pid);
+  g_clear_pointer (&app_name, g_free);
+  n_nodes = 0;
+  g_unsetenv ("AT_SPI_BUS_ADDRESS");
+}
+
+/* Replaces the application with a fresh instance under a new bus name, so
+ * that clients discover it from scratch. */
+gboolean
+synthetic_restart (GError **error)
+{
+  g_return_val_if_fail (app_name != NULL, FALSE);
+
+  stop_child (&app_pid);
+  g_clear_pointer (&app_name, g_free);
+  return spawn_app (error);
+}
+
+const gchar *
+synthetic_get_bus_name (void)
+{
+  return app_name;
+}
+
+guint
+synthetic_get_n_nodes (void)
+{
+  return n_nodes;
+}
+
+AtspiAccessible *
+synthetic_get_root (void)
+{
+  g_return_val_if_fail (app_name != NULL, NULL);
+
+  return _atspi_ref_accessible (app_name, ATSPI_DBUS_PATH_ROOT);
+}
+
+AtspiAccessible *
+synthetic_ref_node (guint index)
+{
+  AtspiAccessible *accessible;
+  gchar *path;
+
+  g_return_val_if_fail (app_name != NULL, NULL);
+  g_return_val_if_fail (index < n_nodes, NULL);
+
+  if (index == 0)
+    return synthetic_get_root ();
+
+  path = g_strdup_printf ("/org/a11y/atspi/accessible/%u", index);
+  accessible = _atspi_ref_accessible (app_name, path);
+  g_free (path);
+  return accessible;
+}
+
+static DBusMessage *
+call_control (DBusMessage *message, GError **error)
+{
+  DBusMessage *reply;
+  DBusError d_error;
+
+  dbus_error_init (&d_error);
+  reply = dbus_connection_send_with_reply_and_block (atspi_get_a11y_bus (),
+                                                     message, -1, &d_error);
+  dbus_message_unref (message);
+  if (!reply)
+  {
+    g_set_error_literal (error, ATSPI_ERROR, ATSPI_ERROR_IPC, d_error.message);
+    dbus_error_free (&d_error);
+  }
+  return reply;
+}
+
+/* Blocks until every event has been sent; the caller then runs the main
+ * loop to have them dispatched. */
+gboolean
+synthetic_emit_storm (const gchar *kind, guint count, GError **error)
+{
+  DBusMessage *message, *reply;
+  dbus_uint32_t d_count = count;
+
+  g_return_val_if_fail (app_name != NULL, FALSE);
+
+  message = dbus_message_new_method_call (app_name, ATSPI_DBUS_PATH_ROOT,
+                                          SYNTHETIC_INTERFACE, "EmitStorm");
+  dbus_message_append_args (message, DBUS_TYPE_STRING, &kind,
+                            DBUS_TYPE_UINT32, &d_count, DBUS_TYPE_INVALID);
+  reply = call_control (message, error);
+  if (!reply)
+    return FALSE;
+  dbus_message_unref (reply);
+  return TRUE;
+}
+
+/* Returns the number of method calls the application has served since the
+ * previous call, not counting calls made by this helper. */
+guint
+synthetic_take_call_count (void)
+{
+  DBusMessage *message, *reply;
+  dbus_uint32_t count = 0;
+
+  g_return_val_if_fail (app_name != NULL, 0);
+
+  message = dbus_message_new_method_call (app_name, ATSPI_DBUS_PATH_ROOT,
+                                          SYNTHETIC_INTERFACE, "TakeCallCount");
+  reply = call_control (message, NULL);
+  if (!reply)
+    return 0;
+  dbus_message_get_args (reply, NULL, DBUS_TYPE_UINT32, &count,
+                         DBUS_TYPE_INVALID);
+  dbus_message_unref (reply);
+  return count;
+}
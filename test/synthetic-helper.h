@@ -0,0 +1,33 @@
+/*
+ * Runs the synthetic application on a private accessibility bus, so that
+ * benchmarks and tests do not depend on the desktop session.
+ */
+
+#ifndef _SYNTHETIC_HELPER_H_
+#define _SYNTHETIC_HELPER_H_
+
+#include "atspi/atspi.h"
+
+G_BEGIN_DECLS
+
+gboolean synthetic_start (gint depth, gint fanout, gint text_size, GError **error);
+
+void synthetic_stop (void);
+
+gboolean synthetic_restart (GError **error);
+
+const gchar *synthetic_get_bus_name (void);
+
+guint synthetic_get_n_nodes (void);
+
+AtspiAccessible *synthetic_get_root (void);
+
+AtspiAccessible *synthetic_ref_node (guint index);
+
+gboolean synthetic_emit_storm (const gchar *kind, guint count, GError **error);
+
+guint synthetic_take_call_count (void);
+
+G_END_DECLS
+
+#endif	/* _SYNTHETIC_HELPER_H_ */
@@ -0,0 +1,104 @@
+/*
+ * Checks that the synthetic application serves the tree it describes and
+ * that its event storms reach libatspi listeners.
+ */
+
+#include "synthetic-helper.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#define DEPTH 3
+#define FANOUT 4
+#define TEXT_SIZE 256
+#define STORM_SIZE 100
+
+static guint n_events;
+
+static guint
+count_nodes (AtspiAccessible *accessible)
+{
+  guint total = 1;
+  gint i, n;
+
+  n = atspi_accessible_get_child_count (accessible, NULL);
+  for (i = 0; i < n; i++)
+  {
+    AtspiAccessible *child = atspi_accessible_get_child_at_index (accessible, i, NULL);
+    g_assert (child != NULL);
+    total += count_nodes (child);
+    g_object_unref (child);
+  }
+  return total;
+}
+
+static void
+on_event (AtspiEvent *event, void *data)
+{
+  if (++n_events == STORM_SIZE)
+    atspi_event_quit ();
+  g_boxed_free (ATSPI_TYPE_EVENT, event);
+}
+
+static gboolean
+on_timeout (void *data)
+{
+  atspi_event_quit ();
+  return FALSE;
+}
+
+int
+main (int argc, char *argv[])
+{
+  AtspiAccessible *root, *node;
+  AtspiEventListener *listener;
+  AtspiRect *rect;
+  GError *error = NULL;
+
+  if (!synthetic_start (DEPTH, FANOUT, TEXT_SIZE, &error))
+  {
+    fprintf (stderr, "Could not start the synthetic application: %s\n",
+             error->message);
+    return 1;
+  }
+  atspi_init ();
+
+  root = synthetic_get_root ();
+  g_assert_cmpuint (count_nodes (root), ==, synthetic_get_n_nodes ());
+
+  rect = atspi_component_get_extents (ATSPI_COMPONENT (root),
+                                      ATSPI_COORD_TYPE_SCREEN, NULL);
+  g_assert_cmpint (rect->x, ==, 0);
+  g_assert_cmpint (rect->y, ==, 0);
+  g_assert_cmpint (rect->width, ==, 1024);
+  g_assert_cmpint (rect->height, ==, 768);
+  g_free (rect);
+
+  node = synthetic_ref_node (1);
+  g_assert_cmpint (atspi_accessible_get_role (node, NULL), ==, ATSPI_ROLE_TABLE);
+  g_assert_cmpint (atspi_table_get_n_rows (ATSPI_TABLE (node), NULL), ==, 2);
+  g_assert_cmpint (atspi_table_get_n_columns (ATSPI_TABLE (node), NULL), ==, 2);
+  g_object_unref (node);
+
+  node = synthetic_ref_node (22);
+  g_assert_cmpint (atspi_accessible_get_role (node, NULL), ==, ATSPI_ROLE_TEXT);
+  g_assert_cmpint (atspi_text_get_character_count (ATSPI_TEXT (node), NULL), ==,
+                   TEXT_SIZE);
+  g_object_unref (node);
+
+  listener = atspi_event_listener_new (on_event, NULL, NULL);
+  atspi_event_listener_register (listener, "object:state-changed", NULL);
+  if (!synthetic_emit_storm ("state-changed", STORM_SIZE, &error))
+  {
+    fprintf (stderr, "Could not emit events: %s\n", error->message);
+    return 1;
+  }
+  g_timeout_add_seconds (10, on_timeout, NULL);
+  atspi_event_main ();
+  g_assert_cmpuint (n_events, ==, STORM_SIZE);
+  g_object_unref (listener);
+
+  g_object_unref (root);
+  atspi_exit ();
+  synthetic_stop ();
+  return 0;
+}